@@ -1,9 +1,9 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sTexture;
+layout (set = 1, binding = 0) uniform sampler2D sTexture;
 
-layout(set = 0, binding = 1) uniform Parameter
+layout(push_constant) uniform Parameter
 {
     float preFilterThreshold;
     float intensity;
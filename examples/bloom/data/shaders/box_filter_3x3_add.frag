@@ -1,10 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sTexture;
-layout (binding = 1) uniform sampler2D sSource;
+layout (set = 1, binding = 0) uniform sampler2D sTexture;
+layout (set = 1, binding = 1) uniform sampler2D sSource;
 
-layout(set = 0, binding = 2) uniform Parameter
+layout(push_constant) uniform Parameter
 {
     float preFilterThreshold;
     float intensity;
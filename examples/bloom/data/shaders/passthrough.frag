@@ -1,7 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sTexture;
+layout (set = 1, binding = 0) uniform sampler2D sTexture;
 
 layout (location = 0) in vec2 texCoords;
 
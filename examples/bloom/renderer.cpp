@@ -5,8 +5,8 @@
 #include "imgui.h"
 #include "objfileloader.h"
 
-const uint32_t SET_ID_CAMERA = 0;
-const uint32_t BINDING_ID_CAMERA = 0;
+// set 0 is the frame descriptor set
+const uint32_t SET_ID_BLIT = 1;
 
 bool Renderer::setup()
 {
@@ -16,7 +16,7 @@ bool Renderer::setup()
     if (ObjFileLoader::read(meshFilename, meshDesc))
     {
         m_mesh.reset(new Mesh(m_device));
-        if (!m_mesh->init(meshDesc, m_cameraUniformBuffer, m_swapchainRenderPass))
+        if (!m_mesh->init(meshDesc, *m_frameDescriptorSet, m_swapchainRenderPass, nullptr, m_bindlessTextures.get()))
             m_mesh.reset();
         else
             setCameraFromBoundingBox(meshDesc.boundingBox.min, meshDesc.boundingBox.max, glm::vec3(1.f, 0.5f, 0.f));
@@ -25,58 +25,42 @@ bool Renderer::setup()
     if (!m_mesh)
         return false;
 
-    const uint32_t numDescriptors = static_cast<uint32_t>( 5 * m_maxDownsampleLoops + 2);    
-    m_descriptorPool = m_device.createDescriptorPool(numDescriptors,
-        { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numDescriptors - 1},
-          { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, numDescriptors } },
-        true);
+    // a blit samples at most 2 inputs
+    m_blitDescriptorAllocator = std::make_unique<DescriptorAllocator>(m_device, 16, std::vector<VkDescriptorPoolSize>{
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 } });
  
-    setupCameraDescriptorSet();
     setClearColor({ 0.0f, 0.0f, 0.0f, 0.0f });
 
-    const std::vector<RenderPassAttachmentDescription> sceneAttachmentData{ {
-        { VK_FORMAT_B8G8R8A8_UNORM, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-        { VK_FORMAT_D32_SFLOAT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL } } };
-    m_sceneRenderPass = m_device.createRenderPass(sceneAttachmentData);
-
-    const std::vector<RenderPassAttachmentDescription> blitAttachmentData{ {
-        { VK_FORMAT_B8G8R8A8_UNORM, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
-    m_blitRenderPass = m_device.createRenderPass(blitAttachmentData);
-
+    m_renderGraph = std::make_unique<RenderGraph>(m_device);
     m_clampToEdgeSampler = m_device.createSampler(true);
 
-    m_bloomParameterUB = UniformBuffer(m_device, &m_bloomParameter);
-
     if (!createPlitPasses())
         return false;
 
-    setupBlitPipelines();
-
-    return true;
+    return setupBlitPipelines();
 }
 
 bool Renderer::createPlitPasses()
 { 
-    if (!createBlitPass(m_blitPasses[eBlitTechnique::COPY], m_blitRenderPass, "data/shaders/passthrough.frag.spv"))
+    const auto blitRenderPass = m_renderGraph->renderPass({ VK_FORMAT_B8G8R8A8_UNORM });
+
+    if (!createBlitPass(m_blitPasses[eBlitTechnique::COPY], blitRenderPass, "data/shaders/passthrough.frag.spv"))
         return false;
 
     if (!createBlitPass(m_blitPasses[eBlitTechnique::COPY_SWAPCHAIN], m_swapchainRenderPass, "data/shaders/passthrough.frag.spv"))
         return false;
 
-    if (!createBlitPass(m_blitPasses[eBlitTechnique::BOX_4x4],        m_blitRenderPass,      "data/shaders/box_filter_4x4.frag.spv"))
+    if (!createBlitPass(m_blitPasses[eBlitTechnique::BOX_4x4],        blitRenderPass,      "data/shaders/box_filter_4x4.frag.spv"))
         return false;
 
-    if (!createBlitPass(m_blitPasses[eBlitTechnique::BOX_3x3],        m_blitRenderPass,       "data/shaders/box_filter_3x3.frag.spv",
-        { { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
+    if (!createBlitPass(m_blitPasses[eBlitTechnique::BOX_3x3],        blitRenderPass,       "data/shaders/box_filter_3x3.frag.spv"))
         return false;
 
     if (!createBlitPass(m_blitPasses[eBlitTechnique::BOX_3x3_ADD],   m_swapchainRenderPass,  "data/shaders/box_filter_3x3_add.frag.spv",
-        { { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT }, 
-        {   2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }, true))
+        { { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }, true))
         return false;
 
-    if (!createBlitPass(m_blitPasses[eBlitTechnique::PREFILTER],     m_blitRenderPass,       "data/shaders/prefilter.frag.spv",
-        { { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
+    if (!createBlitPass(m_blitPasses[eBlitTechnique::PREFILTER],     blitRenderPass,       "data/shaders/prefilter.frag.spv"))
         return false;
 
     return true;
@@ -95,7 +79,8 @@ bool Renderer::createBlitPass(BlitPass& pass, VkRenderPass renderPass, const cha
     std::vector<VkDescriptorSetLayoutBinding> descriptorLayoutBinding({ { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } });
     descriptorLayoutBinding.insert(descriptorLayoutBinding.end(), additionalBindings.begin(), additionalBindings.end());
     pass.descriptorSetLayout = m_device.createDescriptorSetLayout(descriptorLayoutBinding);
-    pass.pipelineLayout = m_device.createPipelineLayout({ pass.descriptorSetLayout });
+    pass.updateTemplate = DescriptorSet::createUpdateTemplate(m_device, pass.descriptorSetLayout, descriptorLayoutBinding);
+    pass.pipelineLayout = m_frameDescriptorSet->createPipelineLayout({ pass.descriptorSetLayout });
 
     GraphicsPipelineSettings blitSettings;
     blitSettings.setDepthTesting(false);
@@ -119,6 +104,7 @@ void Renderer::destroyPlitPasses()
     {
         m_device.destroy(pass.pipelineLayout);
         m_device.destroy(pass.descriptorSetLayout);
+        m_device.destroy(pass.updateTemplate.handle);
         if (pass.pipeline)
             GraphicsPipeline::Release(m_device, pass.pipeline);
         if (pass.shader)
@@ -126,11 +112,23 @@ void Renderer::destroyPlitPasses()
     }
 }
 
-void Renderer::setupBlitPipelines()
+bool Renderer::setupBlitPipelines()
 {
+    const VkExtent2D fullRes = m_swapChain.getImageExtent();
+
+    RenderGraph::ResourceId sceneColor = RenderGraph::InvalidResource;
+    m_renderGraph->addPass("scene", [&](RenderGraph::PassBuilder& builder) {
+        sceneColor = builder.write("scene color", { fullRes, VK_FORMAT_B8G8R8A8_UNORM });
+        builder.write("scene depth", { fullRes, VK_FORMAT_D32_SFLOAT });
+        builder.setClearColor(clearColor());
+    }, [this](CommandBuffer& commandBuffer, const RenderGraph&) {
+        m_mesh->render(commandBuffer);
+    });
+
+    auto bloomImage = sceneColor;
     if (m_enableBloom)
     {
-        VkExtent2D resolution = m_swapChain.getImageExtent();
+        VkExtent2D resolution = fullRes;
         int step;
         for (step = 0; step < m_numDownsampleLoops; step++)
         {
@@ -144,7 +142,7 @@ void Renderer::setupBlitPipelines()
                     step = m_numDownsampleLoops - 1;
             }
             if (m_useDownsampling || step == m_numDownsampleLoops - 1)
-                addBlitPipeline(resolution, step == 0 ? eBlitTechnique::PREFILTER : m_useBoxFilter ? eBlitTechnique::BOX_4x4 : eBlitTechnique::COPY);
+                bloomImage = addBlitPass(resolution, step == 0 ? eBlitTechnique::PREFILTER : m_useBoxFilter ? eBlitTechnique::BOX_4x4 : eBlitTechnique::COPY, { bloomImage });
         }
 
         if (m_useUpsampling)
@@ -153,172 +151,111 @@ void Renderer::setupBlitPipelines()
             {
                 resolution.width  *= 2;
                 resolution.height *= 2;
-                addBlitPipeline(resolution, m_useBoxFilter ? eBlitTechnique::BOX_3x3 : eBlitTechnique::COPY);
+                bloomImage = addBlitPass(resolution, m_useBoxFilter ? eBlitTechnique::BOX_3x3 : eBlitTechnique::COPY, { bloomImage });
             }
         }
     }
+
+    // the last pass renders into the swapchain image outside of the graph
     if (m_showDebug)
-        addBlitPipeline(m_swapChain.getImageExtent(), eBlitTechnique::COPY_SWAPCHAIN);
+        addBlitPipeline(eBlitTechnique::COPY_SWAPCHAIN, { bloomImage });
+    else if (m_enableBloom)
+        addBlitPipeline(eBlitTechnique::BOX_3x3_ADD, { bloomImage, sceneColor });
     else
-        addBlitPipeline(m_swapChain.getImageExtent(), m_enableBloom ? eBlitTechnique::BOX_3x3_ADD : eBlitTechnique::COPY_SWAPCHAIN);
+        addBlitPipeline(eBlitTechnique::COPY_SWAPCHAIN, { sceneColor });
+
+    for (auto input : m_blitPassDescriptions.back().inputs)
+        m_renderGraph->addOutput(input);
+
+    return m_renderGraph->compile();
 }
 
 bool Renderer::postResize()
 {
-    recreateBlitPipeline();
-    return true;
+    return recreateBlitPipeline();
 }
 
-void Renderer::recreateBlitPipeline()
+bool Renderer::recreateBlitPipeline()
 {
     // finish all frames so we can update
     waitForAllFrames();
 
     destroyBlitPipelines();
-    setupBlitPipelines();
+    return setupBlitPipelines();
+}
 
-    m_device.destroy(m_sceneFrameBuffer);
-    m_sceneFrameBuffer = VK_NULL_HANDLE;
+RenderGraph::ResourceId Renderer::addBlitPass(VkExtent2D extent, eBlitTechnique blitTechnique, const std::vector<RenderGraph::ResourceId>& inputs)
+{
+    const auto passId = m_blitPassDescriptions.size();
+    addBlitPipeline(blitTechnique, inputs);
+
+    RenderGraph::ResourceId output = RenderGraph::InvalidResource;
+    m_renderGraph->addPass("blit", [&](RenderGraph::PassBuilder& builder) {
+        for (auto input : inputs)
+            builder.read(input);
+        output = builder.write("blit", { extent, VK_FORMAT_B8G8R8A8_UNORM });
+    }, [this, passId](CommandBuffer& commandBuffer, const RenderGraph&) {
+        blitAttachment(commandBuffer, m_blitPassDescriptions[passId]);
+    });
+
+    return output;
 }
 
-void Renderer::addBlitPipeline(VkExtent2D extent, eBlitTechnique blitTechnique)
+void Renderer::addBlitPipeline(eBlitTechnique blitTechnique, const std::vector<RenderGraph::ResourceId>& inputs)
 {
     BlitPassDescription passDescr;
-    passDescr.frameBufferExtent = extent;
+    passDescr.inputs = inputs;
     passDescr.blitPass = &m_blitPasses[blitTechnique];
-    passDescr.destriptorSet.allocate(m_device, passDescr.blitPass->descriptorSetLayout, m_descriptorPool);
-
-    switch (blitTechnique)
-    {
-    case eBlitTechnique::BOX_3x3:
-    case eBlitTechnique::PREFILTER:
-        passDescr.destriptorSet.setUniformBuffer(1, m_bloomParameterUB);
-        break;
-    case eBlitTechnique::BOX_3x3_ADD:
-        passDescr.destriptorSet.setUniformBuffer(2, m_bloomParameterUB);
-        break;
-    default:
-        break;
-    }
-
+    passDescr.destriptorSet.allocate(*m_blitDescriptorAllocator, passDescr.blitPass->descriptorSetLayout);
     m_blitPassDescriptions.push_back(passDescr);
 }
 
 void Renderer::destroyBlitPipelines()
 {
-    for (auto& descr : m_blitPassDescriptions)
-    {
-        m_device.destroy(descr.frameBuffer);
-        descr.destriptorSet.free(m_device, m_descriptorPool);
-    }
+    // the frames using the sets are complete, so they are dropped with one pool reset instead of freeing them one by one
+    m_blitDescriptorAllocator->reset();
     m_blitPassDescriptions.clear();
-}
-
-void Renderer::setupCameraDescriptorSet()
-{
-    m_cameraDescriptorSetLayout = m_device.createDescriptorSetLayout({ { BINDING_ID_CAMERA, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT } });
-
-    m_cameraUniformDescriptorSet.setUniformBuffer(BINDING_ID_CAMERA, m_cameraUniformBuffer);
-    m_cameraUniformDescriptorSet.allocateAndUpdate(m_device, m_cameraDescriptorSetLayout, m_descriptorPool);
+    m_renderGraph->reset();
 }
 
 void Renderer::shutdown()
 {
     m_mesh.reset();
 
-    m_bloomParameterUB = UniformBuffer();
     destroyBlitPipelines();
     destroyPlitPasses();
-    m_device.destroy(m_cameraDescriptorSetLayout);
-    m_device.destroy(m_descriptorPool);
-    m_device.destroy(m_blitRenderPass);
-    m_device.destroy(m_sceneRenderPass);    
-    m_device.destroy(m_sceneFrameBuffer);
+    m_renderGraph.reset();
+    m_blitDescriptorAllocator.reset();
     m_device.destroy(m_clampToEdgeSampler);
 }
 
 void Renderer::render(const FrameData& frameData)
 {
     auto& commandBuffer = *frameData.resources.graphicsCommandBuffer;
-    VkExtent2D res = m_swapChain.getImageExtent();
-    
-    auto sceneColor = m_imagePool.aquire<ColorAttachment>(m_device, res, VK_FORMAT_B8G8R8A8_UNORM);
-    auto sceneDepth = m_imagePool.aquire<DepthStencilAttachment>(m_device, res, VK_FORMAT_D32_SFLOAT);
-    if (!m_sceneFrameBuffer)
-        m_sceneFrameBuffer = m_device.createFramebuffer(m_sceneRenderPass, { sceneColor->imageView(), sceneDepth->imageView() }, res);
 
     commandBuffer.begin();
-    commandBuffer.beginRenderPass(m_sceneRenderPass, m_sceneFrameBuffer, res, &clearColor());
-    m_mesh->render(commandBuffer);
-    commandBuffer.endRenderPass();
-    m_imagePool.release(std::move(sceneDepth));
-
-    ImagePool::ImageHandle<ColorAttachment> srcImage;
-    ImagePool::ImageHandle<ColorAttachment> dstImage;
+    m_frameDescriptorSet->bind(commandBuffer);
+    m_renderGraph->execute(commandBuffer);
 
-    if (m_enableBloom || m_showDebug)
-    {
-        auto& firstPassDescr = m_blitPassDescriptions[0];
-        res = firstPassDescr.frameBufferExtent;
-        dstImage = m_imagePool.aquire<ColorAttachment>(m_device, res, VK_FORMAT_B8G8R8A8_UNORM);
-        if (!firstPassDescr.frameBuffer)
-            firstPassDescr.frameBuffer = m_device.createFramebuffer(m_blitRenderPass, { dstImage->imageView() }, res);
-
-        commandBuffer.beginRenderPass(m_blitRenderPass, firstPassDescr.frameBuffer, res);
-        blitAttachment(commandBuffer, { sceneColor->imageView() }, firstPassDescr);
-        commandBuffer.endRenderPass();
-
-        srcImage = std::move(dstImage);
-
-        for (auto i = 1; i < m_blitPassDescriptions.size() - 1; i++)
-        {
-            auto& passDescr = m_blitPassDescriptions[i];
-            res = passDescr.frameBufferExtent;
-
-            dstImage = m_imagePool.aquire<ColorAttachment>(m_device, res, VK_FORMAT_B8G8R8A8_UNORM);
-            if (!passDescr.frameBuffer)
-                passDescr.frameBuffer = m_device.createFramebuffer(m_blitRenderPass, { dstImage->imageView() }, res);
-
-            commandBuffer.beginRenderPass(m_blitRenderPass, passDescr.frameBuffer, res);
-            blitAttachment(commandBuffer, { srcImage->imageView() }, passDescr);
-            commandBuffer.endRenderPass();
-
-            srcImage = std::move(dstImage);
-        }
-    }
-
-    auto& passDescr = m_blitPassDescriptions.back();
     commandBuffer.beginRenderPass(m_swapchainRenderPass, frameData.framebuffer, m_swapChain.getImageExtent(), &clearColor());
-    if (m_showDebug)
-    {
-        blitAttachment(commandBuffer, { srcImage->imageView() }, passDescr);
-    }
-    else
-    {
-        if (m_enableBloom)
-        {
-            blitAttachment(commandBuffer, { srcImage->imageView(), sceneColor->imageView() }, passDescr);
-        }
-        else
-        {
-            blitAttachment(commandBuffer, { sceneColor->imageView() }, passDescr);
-        }
-    }
+    blitAttachment(commandBuffer, m_blitPassDescriptions.back());
 
     // this is done in base class
     //vkCmdEndRenderPass(commandBuffer);
     //VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 }
 
-void Renderer::blitAttachment(CommandBuffer& commandBuffer, const std::vector<VkImageView>& attachments, BlitPassDescription& blitPassDescr)
+void Renderer::blitAttachment(CommandBuffer& commandBuffer, BlitPassDescription& blitPassDescr)
 {
     if (!blitPassDescr.destriptorSet.isValid())
     {
-        for (auto i=0; i < attachments.size(); i++)
-            blitPassDescr.destriptorSet.setImageSampler(i, attachments[i], m_clampToEdgeSampler);
-        blitPassDescr.destriptorSet.update(m_device);
+        for (auto i=0; i < blitPassDescr.inputs.size(); i++)
+            blitPassDescr.destriptorSet.setImageSampler(i, m_renderGraph->imageView(blitPassDescr.inputs[i]), m_clampToEdgeSampler);
+        blitPassDescr.destriptorSet.update(m_device, blitPassDescr.blitPass->updateTemplate);
     }
-    blitPassDescr.destriptorSet.bind(commandBuffer, blitPassDescr.blitPass->pipelineLayout, 0);
+    blitPassDescr.destriptorSet.bind(commandBuffer, blitPassDescr.blitPass->pipelineLayout, SET_ID_BLIT);
+    // recorded every frame, so slider changes need no buffer update
+    commandBuffer.pushConstants(blitPassDescr.blitPass->pipelineLayout, FrameDescriptorSet::PushConstantRange.stageFlags, m_bloomParameter);
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, blitPassDescr.blitPass->pipeline);
     vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 }
@@ -327,11 +264,10 @@ void Renderer::createGUIContent()
 {
     ImGui::Begin("Bloom", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize);
     bool updateBlitPipeline = false;
-    bool updatePreFilterParameter = false;
     updateBlitPipeline |= ImGui::Checkbox("Enabled", &m_enableBloom);
     updateBlitPipeline |= ImGui::SliderInt("Resolution reduction steps", &m_numDownsampleLoops, 1, m_maxDownsampleLoops);
-    updatePreFilterParameter |= ImGui::SliderFloat("Intensity", &m_bloomParameter.intensity, 0.f, 10.f);
-    updatePreFilterParameter |= ImGui::SliderFloat("Brightness threshold", &m_bloomParameter.preFilterThreshold, 0.f, 1.f);
+    ImGui::SliderFloat("Intensity", &m_bloomParameter.intensity, 0.f, 10.f);
+    ImGui::SliderFloat("Brightness threshold", &m_bloomParameter.preFilterThreshold, 0.f, 1.f);
     updateBlitPipeline |= ImGui::Checkbox("With downsampling", &m_useDownsampling);
     updateBlitPipeline |= ImGui::Checkbox("With upsampling", &m_useUpsampling);
     updateBlitPipeline |= ImGui::Checkbox("With box filter", &m_useBoxFilter);
@@ -340,7 +276,10 @@ void Renderer::createGUIContent()
     m_useDownsampling |= m_showDebug;
     if (updateBlitPipeline)
         recreateBlitPipeline();
-    if (updatePreFilterParameter)
-        m_bloomParameterUB.assign(&m_bloomParameter, sizeof(m_bloomParameter));
+
+    const auto toMB = [](VkDeviceSize bytes) { return static_cast<float>(bytes) / (1024.0f * 1024.0f); };
+    const auto& graphStats = m_renderGraph->stats();
+    ImGui::Text("Render graph: %u passes, %u barriers", graphStats.passCount - graphStats.culledPassCount, graphStats.barrierCount);
+    ImGui::Text("Render targets: %.1f MB (%.1f MB without aliasing)", toMB(graphStats.memorySize), toMB(graphStats.unaliasedMemorySize));
     ImGui::End();
 }
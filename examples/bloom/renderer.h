@@ -4,8 +4,10 @@
 #include "shader.h"
 #include "vertexbuffer.h"
 #include "descriptorset.h"
+#include "descriptorallocator.h"
 #include "graphicspipeline.h"
 #include "mesh.h"
+#include "rendergraph.h"
 
 class Renderer : public BasicRenderer
 {
@@ -15,14 +17,12 @@ private:
     void shutdown() override;
 
     bool postResize() override;
-    void setupCameraDescriptorSet();
     void createGUIContent() override;
 
-    void recreateBlitPipeline();
+    bool recreateBlitPipeline();
 
-    VkDescriptorSetLayout m_cameraDescriptorSetLayout = VK_NULL_HANDLE;
-    DescriptorSet m_cameraUniformDescriptorSet;
-    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    // reset when the blit chain is rebuilt
+    std::unique_ptr<DescriptorAllocator> m_blitDescriptorAllocator;
 
     std::string meshFilename;
     std::unique_ptr<Mesh> m_mesh;
@@ -42,6 +42,7 @@ private:
         VkPipeline pipeline = VK_NULL_HANDLE;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
         VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        DescriptorSet::UpdateTemplate updateTemplate;
     };
 
     BlitPass m_blitPasses[eBlitTechnique::COUNT];
@@ -49,10 +50,10 @@ private:
     struct BlitPassDescription {
         BlitPass* blitPass = nullptr;
         DescriptorSet destriptorSet;
-        VkFramebuffer frameBuffer = VK_NULL_HANDLE;
-        VkExtent2D frameBufferExtent = { 0,0 };
+        std::vector<RenderGraph::ResourceId> inputs;
     };
     
+    // matches the Parameter push constant block of the blit shaders
     struct BloomParameter
     {
         float preFilterThreshold = 0.5f;
@@ -61,16 +62,15 @@ private:
 
     bool createPlitPasses();
     void destroyPlitPasses();
-    void setupBlitPipelines();
+    bool setupBlitPipelines();
     void destroyBlitPipelines();
-    void addBlitPipeline(VkExtent2D extent, eBlitTechnique blitTechnique);
-    void blitAttachment(CommandBuffer& commandBuffer, const std::vector<VkImageView>& attachments, BlitPassDescription& blitPass);
+    void addBlitPipeline(eBlitTechnique blitTechnique, const std::vector<RenderGraph::ResourceId>& inputs);
+    RenderGraph::ResourceId addBlitPass(VkExtent2D extent, eBlitTechnique blitTechnique, const std::vector<RenderGraph::ResourceId>& inputs);
+    void blitAttachment(CommandBuffer& commandBuffer, BlitPassDescription& blitPass);
     bool createBlitPass(BlitPass& pass, VkRenderPass renderPass, const char* fragmentShaderFilename, const std::vector<VkDescriptorSetLayoutBinding>& additionalBindings = {}, bool alphaBlend = false);
 
     std::vector<BlitPassDescription> m_blitPassDescriptions;
-    VkRenderPass m_sceneRenderPass = VK_NULL_HANDLE;
-    VkRenderPass m_blitRenderPass = VK_NULL_HANDLE;
-    VkFramebuffer m_sceneFrameBuffer = VK_NULL_HANDLE;
+    std::unique_ptr<RenderGraph> m_renderGraph;
     VkSampler m_clampToEdgeSampler = VK_NULL_HANDLE;
     bool m_enableBloom = true;
     bool m_showDebug = false;
@@ -79,6 +79,5 @@ private:
     bool m_useDownsampling = true;
     int m_numDownsampleLoops = 4;
     const int m_maxDownsampleLoops = 6;
-    UniformBuffer m_bloomParameterUB;
     BloomParameter m_bloomParameter;
 };
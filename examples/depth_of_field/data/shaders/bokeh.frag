@@ -1,13 +1,13 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sMainCocTexture;
+layout (set = 1, binding = 0) uniform sampler2D sMainCocTexture;
 
 layout (location = 0) in vec2 texCoords;
 
 layout(location = 0) out vec4 outColor;
 
-layout(set = 0, binding = 1) uniform Parameter
+layout(push_constant) uniform Parameter
 {
     float nearPlane;
     float farPlane;
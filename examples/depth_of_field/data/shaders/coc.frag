@@ -1,11 +1,11 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sDepthTexture;
+layout (set = 1, binding = 0) uniform sampler2D sDepthTexture;
 
 layout (location = 0) in vec2 texCoords;
 
-layout(set = 0, binding = 1) uniform Parameter
+layout(push_constant) uniform Parameter
 {
     float nearPlane;
     float farPlane;
@@ -1,8 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sMainTexture;
-layout (binding = 1) uniform sampler2D sCoCTexture;
+layout (set = 1, binding = 0) uniform sampler2D sMainTexture;
+layout (set = 1, binding = 1) uniform sampler2D sCoCTexture;
 
 layout (location = 0) in vec2 texCoords;
 
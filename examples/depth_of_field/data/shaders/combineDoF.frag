@@ -1,9 +1,9 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D sMainTexture;
-layout (binding = 1) uniform sampler2D sDoFTexture;
-layout (binding = 2) uniform sampler2D sCoCTexture;
+layout (set = 1, binding = 0) uniform sampler2D sMainTexture;
+layout (set = 1, binding = 1) uniform sampler2D sDoFTexture;
+layout (set = 1, binding = 2) uniform sampler2D sCoCTexture;
 
 layout (location = 0) in vec2 texCoords;
 
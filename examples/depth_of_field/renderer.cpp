@@ -5,8 +5,8 @@
 #include "imgui.h"
 #include "objfileloader.h"
 
-const uint32_t SET_ID_CAMERA = 0;
-const uint32_t BINDING_ID_CAMERA = 0;
+// set 0 is the frame descriptor set
+const uint32_t SET_ID_BLIT = 1;
 
 bool Renderer::setup()
 {
@@ -16,7 +16,7 @@ bool Renderer::setup()
     if (ObjFileLoader::read(meshFilename, meshDesc))
     {
         m_mesh.reset(new Mesh(m_device));
-        if (!m_mesh->init(meshDesc, m_cameraUniformBuffer, m_swapchainRenderPass))
+        if (!m_mesh->init(meshDesc, *m_frameDescriptorSet, m_swapchainRenderPass, nullptr, m_bindlessTextures.get()))
             m_mesh.reset();
         else
             setCameraFromBoundingBox(meshDesc.boundingBox.min, meshDesc.boundingBox.max, glm::vec3(1.f, 0.5f, 0.f));
@@ -25,71 +25,51 @@ bool Renderer::setup()
     if (!m_mesh)
         return false;
 
-    const uint32_t numDescriptors = static_cast<uint32_t>(20);    
-    m_descriptorPool = m_device.createDescriptorPool(numDescriptors,
-        { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numDescriptors },
-          { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, numDescriptors } },
-        true);
+    // a blit samples at most 3 inputs
+    m_blitDescriptorAllocator = std::make_unique<DescriptorAllocator>(m_device, 16, std::vector<VkDescriptorPoolSize>{
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 } });
  
-    setupCameraDescriptorSet();
     setClearColor({ 0.0f, 0.0f, 0.0f, 0.0f });
 
-    const std::vector<RenderPassAttachmentDescription> sceneAttachmentData{ {
-        { VK_FORMAT_B8G8R8A8_UNORM, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-        { VK_FORMAT_D32_SFLOAT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
-    m_sceneRenderPass = m_device.createRenderPass(sceneAttachmentData);
-
-    const std::vector<RenderPassAttachmentDescription> colorBlitAttachmentData{ {
-        { VK_FORMAT_B8G8R8A8_UNORM, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
-    m_colorBlitRenderPass = m_device.createRenderPass(colorBlitAttachmentData);
-
-    const std::vector<RenderPassAttachmentDescription> cocBlitAttachmentData{ {
-        { VK_FORMAT_R16_SFLOAT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
-    m_cocBlitRenderPass = m_device.createRenderPass(cocBlitAttachmentData);
-
-    const std::vector<RenderPassAttachmentDescription> combineBlitAttachmentData{ {
-      { VK_FORMAT_R16G16B16A16_SFLOAT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
-    m_combineBlitRenderPass = m_device.createRenderPass(combineBlitAttachmentData);
-
+    m_renderGraph = std::make_unique<RenderGraph>(m_device);
     m_clampToEdgeSampler = m_device.createSampler(true);
 
     m_doFParameter.nearPlane = m_cameraHandler.m_nearPlane;
     m_doFParameter.farPlane = m_cameraHandler.m_farPlane;
 //    m_doFParameter.focusDistance = m_cameraHandler.m_farPlane / 20.f;
 //    m_doFParameter.focusRange = m_cameraHandler.m_farPlane / 100.f;
-    m_doFParameterUB = UniformBuffer(m_device, &m_doFParameter);
 
     if (!createMaterials())
         return false;
 
-    setupBlitPipelines();
-
-    return true;
+    return setupBlitPipelines();
 }
 
 bool Renderer::createMaterials()
 { 
+    const auto colorBlitRenderPass = m_renderGraph->renderPass({ VK_FORMAT_B8G8R8A8_UNORM });
+    const auto cocBlitRenderPass = m_renderGraph->renderPass({ VK_FORMAT_R16_SFLOAT });
+    const auto combineBlitRenderPass = m_renderGraph->renderPass({ VK_FORMAT_R16G16B16A16_SFLOAT });
+
     if (!createMaterial(m_materials[eMaterialType::COPY_SWAPCHAIN], m_swapchainRenderPass, "data/shaders/passthrough.frag.spv"))
         return false;
 
-    if (!createMaterial(m_materials[eMaterialType::DOWNSAMPLE], m_colorBlitRenderPass, "data/shaders/box_filter_3x3.frag.spv"))
+    if (!createMaterial(m_materials[eMaterialType::DOWNSAMPLE], colorBlitRenderPass, "data/shaders/box_filter_3x3.frag.spv"))
         return false;
 
-    if (!createMaterial(m_materials[eMaterialType::COMBINE_COC], m_combineBlitRenderPass, "data/shaders/combineCoc.frag.spv",
+    if (!createMaterial(m_materials[eMaterialType::COMBINE_COC], combineBlitRenderPass, "data/shaders/combineCoc.frag.spv",
          { { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
         return false;
 
-    if (!createMaterial(m_materials[eMaterialType::COMBINE_DOF], m_colorBlitRenderPass, "data/shaders/combineDof.frag.spv",
+    if (!createMaterial(m_materials[eMaterialType::COMBINE_DOF], colorBlitRenderPass, "data/shaders/combineDof.frag.spv",
         { { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT },
           { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
         return false;
 
-    if (!createMaterial(m_materials[eMaterialType::BOKEH], m_colorBlitRenderPass, "data/shaders/bokeh.frag.spv",
-         { { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
+    if (!createMaterial(m_materials[eMaterialType::BOKEH], colorBlitRenderPass, "data/shaders/bokeh.frag.spv"))
         return false;
 
-    if (!createMaterial(m_materials[eMaterialType::COC], m_cocBlitRenderPass, "data/shaders/coc.frag.spv",
-        { { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } }))
+    if (!createMaterial(m_materials[eMaterialType::COC], cocBlitRenderPass, "data/shaders/coc.frag.spv"))
         return false;
 
     return true;
@@ -108,7 +88,8 @@ bool Renderer::createMaterial(Material& pass, VkRenderPass renderPass, const cha
     std::vector<VkDescriptorSetLayoutBinding> descriptorLayoutBinding({ { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } });
     descriptorLayoutBinding.insert(descriptorLayoutBinding.end(), additionalBindings.begin(), additionalBindings.end());
     pass.descriptorSetLayout = m_device.createDescriptorSetLayout(descriptorLayoutBinding);
-    pass.pipelineLayout = m_device.createPipelineLayout({ pass.descriptorSetLayout });
+    pass.updateTemplate = DescriptorSet::createUpdateTemplate(m_device, pass.descriptorSetLayout, descriptorLayoutBinding);
+    pass.pipelineLayout = m_frameDescriptorSet->createPipelineLayout({ pass.descriptorSetLayout });
 
     GraphicsPipelineSettings blitSettings;
     blitSettings.setDepthTesting(false);
@@ -134,6 +115,7 @@ void Renderer::destroyMaterials()
     {
         m_device.destroy(mat.pipelineLayout);
         m_device.destroy(mat.descriptorSetLayout);
+        m_device.destroy(mat.updateTemplate.handle);
         if (mat.pipeline)
             GraphicsPipeline::Release(m_device, mat.pipeline);
         if (mat.shader)
@@ -141,152 +123,123 @@ void Renderer::destroyMaterials()
     }
 }
 
-void Renderer::setupBlitPipelines()
+bool Renderer::setupBlitPipelines()
 {
     VkExtent2D fullRes = m_swapChain.getImageExtent();
     VkExtent2D halfRes = { fullRes.width / 2, fullRes.height / 2 };
 
-    addBlitPipeline(fullRes, VK_FORMAT_R16_SFLOAT,          eMaterialType::COC);
-    addBlitPipeline(halfRes, VK_FORMAT_R16G16B16A16_SFLOAT, eMaterialType::COMBINE_COC);
-    addBlitPipeline(halfRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::BOKEH);
-    addBlitPipeline(halfRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::DOWNSAMPLE);
-    addBlitPipeline(fullRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::COMBINE_DOF);
-    addBlitPipeline(fullRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::COPY_SWAPCHAIN);
+    RenderGraph::ResourceId sceneColor = RenderGraph::InvalidResource;
+    RenderGraph::ResourceId sceneDepth = RenderGraph::InvalidResource;
+    m_renderGraph->addPass("scene", [&](RenderGraph::PassBuilder& builder) {
+        sceneColor = builder.write("scene color", { fullRes, VK_FORMAT_B8G8R8A8_UNORM });
+        sceneDepth = builder.write("scene depth", { fullRes, VK_FORMAT_D32_SFLOAT });
+        builder.setClearColor(clearColor());
+    }, [this](CommandBuffer& commandBuffer, const RenderGraph&) {
+        m_mesh->render(commandBuffer);
+    });
+
+    const auto cocImage           = addBlitPass(fullRes, VK_FORMAT_R16_SFLOAT,          eMaterialType::COC,         { sceneDepth });
+    const auto combinedCoCImage   = addBlitPass(halfRes, VK_FORMAT_R16G16B16A16_SFLOAT, eMaterialType::COMBINE_COC, { sceneColor, cocImage });
+    const auto bokehImage         = addBlitPass(halfRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::BOKEH,       { combinedCoCImage });
+    const auto filteredBokehImage = addBlitPass(halfRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::DOWNSAMPLE,  { bokehImage });
+    const auto combinedDoFImage   = addBlitPass(fullRes, VK_FORMAT_B8G8R8A8_UNORM,      eMaterialType::COMBINE_DOF, { sceneColor, filteredBokehImage, cocImage });
+
+    // the final image is shown outside of the graph, the passes it does not depend on are culled
+    const auto finalImage = m_showCoC ? cocImage : m_enableDoF ? combinedDoFImage : sceneColor;
+    addBlitPipeline(eMaterialType::COPY_SWAPCHAIN, { finalImage });
+    m_renderGraph->addOutput(finalImage);
+
+    return m_renderGraph->compile();
 }
 
 bool Renderer::postResize()
 {
-    recreateDoFPipeline();
-    return true;
+    return recreateDoFPipeline();
 }
 
-void Renderer::recreateDoFPipeline()
+bool Renderer::recreateDoFPipeline()
 {
     // finish all frames so we can update
     waitForAllFrames();
 
     destroyBlitPipelines();
-    setupBlitPipelines();
-    m_imagePool.clear();
+    return setupBlitPipelines();
+}
 
-    m_device.destroy(m_sceneFrameBuffer);
-    m_sceneFrameBuffer = VK_NULL_HANDLE;
+RenderGraph::ResourceId Renderer::addBlitPass(VkExtent2D extent, VkFormat format, eMaterialType materialType, const std::vector<RenderGraph::ResourceId>& inputs)
+{
+    const auto passId = m_blitPassDescriptions.size();
+    addBlitPipeline(materialType, inputs);
+
+    RenderGraph::ResourceId output = RenderGraph::InvalidResource;
+    m_renderGraph->addPass("blit", [&](RenderGraph::PassBuilder& builder) {
+        for (auto input : inputs)
+            builder.read(input);
+        output = builder.write("blit", { extent, format });
+    }, [this, passId](CommandBuffer& commandBuffer, const RenderGraph&) {
+        blitAttachment(commandBuffer, m_blitPassDescriptions[passId]);
+    });
+
+    return output;
 }
-void Renderer::addBlitPipeline(VkExtent2D extent, VkFormat format, eMaterialType materialType)
+
+void Renderer::addBlitPipeline(eMaterialType materialType, const std::vector<RenderGraph::ResourceId>& inputs)
 {
     BlitPassDescription passDescr;
-    passDescr.frameBufferExtent = extent;
-    passDescr.frameBufferFormat = format;
+    passDescr.inputs = inputs;
     passDescr.materialType = materialType;
-    passDescr.destriptorSet.allocate(m_device, m_materials[materialType].descriptorSetLayout, m_descriptorPool);
-
-    switch (materialType)
-    {
-    case eMaterialType::COC:
-    case eMaterialType::BOKEH:
-        passDescr.destriptorSet.setUniformBuffer(1, m_doFParameterUB);
-        break;
-    default:
-        break;
-    }
-
+    passDescr.destriptorSet.allocate(*m_blitDescriptorAllocator, m_materials[materialType].descriptorSetLayout);
     m_blitPassDescriptions.push_back(passDescr);
 }
 
 void Renderer::destroyBlitPipelines()
 {
-    for (auto& descr : m_blitPassDescriptions)
-    {
-        m_device.destroy(descr.frameBuffer);
-        descr.destriptorSet.free(m_device, m_descriptorPool);
-    }
+    // the frames using the sets are complete, so they are dropped with one pool reset instead of freeing them one by one
+    m_blitDescriptorAllocator->reset();
     m_blitPassDescriptions.clear();
-}
-
-void Renderer::setupCameraDescriptorSet()
-{
-    m_cameraDescriptorSetLayout = m_device.createDescriptorSetLayout({ { BINDING_ID_CAMERA, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT } });
-
-    m_cameraUniformDescriptorSet.setUniformBuffer(BINDING_ID_CAMERA, m_cameraUniformBuffer);
-    m_cameraUniformDescriptorSet.allocateAndUpdate(m_device, m_cameraDescriptorSetLayout, m_descriptorPool);
+    m_renderGraph->reset();
 }
 
 void Renderer::shutdown()
 {
     m_mesh.reset();
 
-    m_doFParameterUB = UniformBuffer();
     destroyBlitPipelines();
     destroyMaterials();
-    m_device.destroy(m_cameraDescriptorSetLayout);
-    m_device.destroy(m_descriptorPool);
-    m_device.destroy(m_colorBlitRenderPass);
-    m_device.destroy(m_cocBlitRenderPass);
-    m_device.destroy(m_combineBlitRenderPass);
-    m_device.destroy(m_sceneRenderPass);    
-    m_device.destroy(m_sceneFrameBuffer);
+    m_renderGraph.reset();
+    m_blitDescriptorAllocator.reset();
     m_device.destroy(m_clampToEdgeSampler);
 }
 
 void Renderer::render(const FrameData& frameData)
 {
     auto& commandBuffer = *frameData.resources.graphicsCommandBuffer;
-    const auto fullRes = m_swapChain.getImageExtent();
-
-    auto [sceneColor, sceneDepth] = renderScenePass(commandBuffer, fullRes);
 
-    auto cocImage           = renderBlitPass(commandBuffer, m_blitPassDescriptions[0], { sceneDepth->imageView() });
-    auto combinedCoCImage   = renderBlitPass(commandBuffer, m_blitPassDescriptions[1], { sceneColor->imageView(), cocImage->imageView() });
-    auto bokehImage         = renderBlitPass(commandBuffer, m_blitPassDescriptions[2], { combinedCoCImage->imageView() });
-    auto filteredBokehImage = renderBlitPass(commandBuffer, m_blitPassDescriptions[3], { bokehImage->imageView() });
-    auto combinedDoFCImage  = renderBlitPass(commandBuffer, m_blitPassDescriptions[4], { sceneColor->imageView(), filteredBokehImage->imageView(), cocImage->imageView() });
+    commandBuffer.begin();
+    m_frameDescriptorSet->bind(commandBuffer);
+    m_renderGraph->execute(commandBuffer);
 
     // show final image
-    commandBuffer.beginRenderPass(m_swapchainRenderPass, frameData.framebuffer, fullRes, &clearColor());
-    blitAttachment(commandBuffer, { m_showCoC ? cocImage->imageView() : m_enableDoF ? combinedDoFCImage->imageView() : sceneColor->imageView() }, m_blitPassDescriptions[5]);
+    commandBuffer.beginRenderPass(m_swapchainRenderPass, frameData.framebuffer, m_swapChain.getImageExtent(), &clearColor());
+    blitAttachment(commandBuffer, m_blitPassDescriptions.back());
 
     // this is done in base class
     //vkCmdEndRenderPass(commandBuffer);
     //VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 }
 
-std::pair<Renderer::ColorImageHandle, Renderer::DepthImageHandle> Renderer::renderScenePass(CommandBuffer& commandBuffer, VkExtent2D extend)
-{
-    auto sceneColor = m_imagePool.aquire<ColorAttachment>(m_device, extend, VK_FORMAT_B8G8R8A8_UNORM);
-    auto sceneDepth = m_imagePool.aquire<DepthStencilAttachment>(m_device, extend, VK_FORMAT_D32_SFLOAT);
-    if (!m_sceneFrameBuffer)
-        m_sceneFrameBuffer = m_device.createFramebuffer(m_sceneRenderPass, { sceneColor->imageView(), sceneDepth->imageView() }, extend);
-    commandBuffer.begin();
-    commandBuffer.beginRenderPass(m_sceneRenderPass, m_sceneFrameBuffer, extend, &clearColor());
-    m_mesh->render(commandBuffer);
-    commandBuffer.endRenderPass();
-
-    return { std::move(sceneColor), std::move(sceneDepth) };
-}
-
-Renderer::ColorImageHandle Renderer::renderBlitPass(CommandBuffer& commandBuffer, BlitPassDescription& passDescr, const std::vector<VkImageView>& attachments)
-{
-    const auto& material = m_materials[passDescr.materialType];
-    auto destImage = m_imagePool.aquire<ColorAttachment>(m_device, passDescr.frameBufferExtent, passDescr.frameBufferFormat);
-    if (!passDescr.frameBuffer)
-        passDescr.frameBuffer = m_device.createFramebuffer(material.renderPass, { destImage->imageView() }, passDescr.frameBufferExtent);
-    commandBuffer.beginRenderPass(material.renderPass, passDescr.frameBuffer, passDescr.frameBufferExtent);
-    blitAttachment(commandBuffer, attachments, passDescr);
-    commandBuffer.endRenderPass();
-
-    return std::move(destImage);
-}
-
-void Renderer::blitAttachment(CommandBuffer& commandBuffer, const std::vector<VkImageView>& attachments, BlitPassDescription& blitPassDescr)
+void Renderer::blitAttachment(CommandBuffer& commandBuffer, BlitPassDescription& blitPassDescr)
 {
+    const auto& material = m_materials[blitPassDescr.materialType];
     if (!blitPassDescr.destriptorSet.isValid())
     {
-        for (auto i=0; i < attachments.size(); i++)
-            blitPassDescr.destriptorSet.setImageSampler(i, attachments[i], m_clampToEdgeSampler);
-        blitPassDescr.destriptorSet.update(m_device);
+        for (auto i=0; i < blitPassDescr.inputs.size(); i++)
+            blitPassDescr.destriptorSet.setImageSampler(i, m_renderGraph->imageView(blitPassDescr.inputs[i]), m_clampToEdgeSampler);
+        blitPassDescr.destriptorSet.update(m_device, material.updateTemplate);
     }
-    const auto& material = m_materials[blitPassDescr.materialType];
-    blitPassDescr.destriptorSet.bind(commandBuffer, material.pipelineLayout, 0);
+    blitPassDescr.destriptorSet.bind(commandBuffer, material.pipelineLayout, SET_ID_BLIT);
+    // recorded every frame, so slider changes need no buffer update
+    commandBuffer.pushConstants(material.pipelineLayout, FrameDescriptorSet::PushConstantRange.stageFlags, m_doFParameter);
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
     vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 }
@@ -295,15 +248,17 @@ void Renderer::createGUIContent()
 {
     ImGui::Begin("Depth of field", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize);
     bool updateFinalBlitPass = false;
-    bool updateDoFParameter = false;
     updateFinalBlitPass |= ImGui::Checkbox("Enable Depth of Field", &m_enableDoF);
     updateFinalBlitPass |= ImGui::Checkbox("Show circle of confusion", &m_showCoC);
-    updateDoFParameter |= ImGui::SliderFloat("Focus range", &m_doFParameter.focusRange, 0.1f, m_cameraHandler.m_farPlane);
-    updateDoFParameter |= ImGui::SliderFloat("Focus distance", &m_doFParameter.focusDistance, 0.1f, m_cameraHandler.m_farPlane);
-    updateDoFParameter |= ImGui::SliderFloat("Bokeh radius", &m_doFParameter.bokehRadius, 1.0f, 10.f);
+    ImGui::SliderFloat("Focus range", &m_doFParameter.focusRange, 0.1f, m_cameraHandler.m_farPlane);
+    ImGui::SliderFloat("Focus distance", &m_doFParameter.focusDistance, 0.1f, m_cameraHandler.m_farPlane);
+    ImGui::SliderFloat("Bokeh radius", &m_doFParameter.bokehRadius, 1.0f, 10.f);
     if (updateFinalBlitPass)
-        m_blitPassDescriptions.back().destriptorSet.invalidate();
-    if (updateDoFParameter)
-        m_doFParameterUB.assign(&m_doFParameter, sizeof(m_doFParameter));
+        recreateDoFPipeline();
+
+    const auto toMB = [](VkDeviceSize bytes) { return static_cast<float>(bytes) / (1024.0f * 1024.0f); };
+    const auto& graphStats = m_renderGraph->stats();
+    ImGui::Text("Render graph: %u passes, %u culled, %u barriers", graphStats.passCount - graphStats.culledPassCount, graphStats.culledPassCount, graphStats.barrierCount);
+    ImGui::Text("Render targets: %.1f MB (%.1f MB without aliasing)", toMB(graphStats.memorySize), toMB(graphStats.unaliasedMemorySize));
     ImGui::End();
 }
@@ -4,8 +4,10 @@
 #include "shader.h"
 #include "vertexbuffer.h"
 #include "descriptorset.h"
+#include "descriptorallocator.h"
 #include "graphicspipeline.h"
 #include "mesh.h"
+#include "rendergraph.h"
 
 class Renderer : public BasicRenderer
 {
@@ -15,14 +17,12 @@ private:
     void shutdown() override;
 
     bool postResize() override;
-    void setupCameraDescriptorSet();
     void createGUIContent() override;
 
-    void recreateDoFPipeline();
+    bool recreateDoFPipeline();
 
-    VkDescriptorSetLayout m_cameraDescriptorSetLayout = VK_NULL_HANDLE;
-    DescriptorSet m_cameraUniformDescriptorSet;
-    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    // reset when the blit chain is rebuilt
+    std::unique_ptr<DescriptorAllocator> m_blitDescriptorAllocator;
 
     std::string meshFilename;
     std::unique_ptr<Mesh> m_mesh;
@@ -43,6 +43,7 @@ private:
         VkPipeline pipeline = VK_NULL_HANDLE;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
         VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        DescriptorSet::UpdateTemplate updateTemplate;
         VkRenderPass renderPass = VK_NULL_HANDLE;
     };
 
@@ -51,11 +52,10 @@ private:
     struct BlitPassDescription {
         eMaterialType materialType = eMaterialType::INVALID;
         DescriptorSet destriptorSet;
-        VkFramebuffer frameBuffer = VK_NULL_HANDLE;
-        VkExtent2D frameBufferExtent = { 0,0 };
-        VkFormat frameBufferFormat = VK_FORMAT_UNDEFINED;
+        std::vector<RenderGraph::ResourceId> inputs;
     };
     
+    // matches the Parameter push constant block of the blit shaders
     struct DofParameter
     {
         float nearPlane = 0.f;
@@ -65,28 +65,19 @@ private:
         float bokehRadius = 4.0f;
     };
 
-    using ColorImageHandle = ImagePool::ImageHandle<ColorAttachment>;
-    using DepthImageHandle = ImagePool::ImageHandle<DepthStencilAttachment>;
-
-    std::pair<Renderer::ColorImageHandle, Renderer::DepthImageHandle> renderScenePass(CommandBuffer& commandBuffer, VkExtent2D extend);
     bool createMaterials();
     void destroyMaterials();
-    void setupBlitPipelines();
+    bool setupBlitPipelines();
     void destroyBlitPipelines();
-    void addBlitPipeline(VkExtent2D extent, VkFormat format, eMaterialType blitTechnique);
-    ColorImageHandle renderBlitPass(CommandBuffer& commandBuffer, BlitPassDescription& passDescr, const std::vector<VkImageView>& attachments);
-    void blitAttachment(CommandBuffer& commandBuffer, const std::vector<VkImageView>& attachments, BlitPassDescription& material);
+    void addBlitPipeline(eMaterialType blitTechnique, const std::vector<RenderGraph::ResourceId>& inputs);
+    RenderGraph::ResourceId addBlitPass(VkExtent2D extent, VkFormat format, eMaterialType materialType, const std::vector<RenderGraph::ResourceId>& inputs);
+    void blitAttachment(CommandBuffer& commandBuffer, BlitPassDescription& material);
     bool createMaterial(Material& pass, VkRenderPass renderPass, const char* fragmentShaderFilename, const std::vector<VkDescriptorSetLayoutBinding>& additionalBindings = {}, bool alphaBlend = false);
 
     std::vector<BlitPassDescription> m_blitPassDescriptions;
-    VkRenderPass m_sceneRenderPass = VK_NULL_HANDLE;
-    VkRenderPass m_colorBlitRenderPass = VK_NULL_HANDLE;
-    VkRenderPass m_cocBlitRenderPass = VK_NULL_HANDLE;
-    VkRenderPass m_combineBlitRenderPass = VK_NULL_HANDLE;
-    VkFramebuffer m_sceneFrameBuffer = VK_NULL_HANDLE;
+    std::unique_ptr<RenderGraph> m_renderGraph;
     VkSampler m_clampToEdgeSampler = VK_NULL_HANDLE;
     bool m_enableDoF = true;
     bool m_showCoC = false;
-    UniformBuffer m_doFParameterUB;
     DofParameter m_doFParameter;
 };
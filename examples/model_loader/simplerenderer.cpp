@@ -8,26 +8,21 @@
 bool SimpleRenderer::setup()
 {
     meshFilename = "data/meshes/bunny.obj";
-    
-    auto meshLoadFunc = [&]()
-    {
-        MeshDescription meshDesc;
-        if (ObjFileLoader::read(meshFilename, meshDesc))
-        {
-            m_mesh.reset(new Mesh(m_device));
-            if (!m_mesh->init(meshDesc, m_cameraUniformBuffer, m_swapchainRenderPass))
-                m_mesh.reset();
-            else
-                setCameraFromBoundingBox(meshDesc.boundingBox.min, meshDesc.boundingBox.max, glm::vec3(0, 1, 1));
-        }
-
-        return [&](auto& commandBuffer)
-        {
-            m_mesh->render(commandBuffer);
-        };
-    };
 
-    m_meshDrawFunc = meshLoadFunc();
+    MeshDescription meshDesc;
+    if (ObjFileLoader::read(meshFilename, meshDesc))
+    {
+        // interleaved meshes are placed into a pool with their vertex layout, separate attribute streams get their own buffers
+        const auto& geometry = meshDesc.geometry;
+        if (geometry.vertexAttribs.empty())
+            m_geometryPool = std::make_unique<GeometryPool>(m_device, geometry.vertexSize * static_cast<uint32_t>(sizeof(float)), geometry.interleavedVertexAttribs);
+
+        m_mesh.reset(new Mesh(m_device));
+        if (!m_mesh->init(meshDesc, *m_frameDescriptorSet, m_swapchainRenderPass, m_geometryPool.get(), m_bindlessTextures.get()))
+            m_mesh.reset();
+        else
+            setCameraFromBoundingBox(meshDesc.boundingBox.min, meshDesc.boundingBox.max, glm::vec3(0, 1, 1));
+    }
 
     return m_mesh.get() != nullptr;
 }
@@ -35,11 +30,17 @@ bool SimpleRenderer::setup()
 void SimpleRenderer::shutdown()
 {
     m_mesh.reset();
+    m_geometryPool.reset();
 }
 
 void SimpleRenderer::render(const FrameData& frameData)
 {
-    fillCommandBuffer(*frameData.resources.graphicsCommandBuffer, m_swapchainRenderPass, frameData.framebuffer, m_meshDrawFunc);
+    // every thread records a range of the shapes
+    fillCommandBufferParallel(*frameData.resources.graphicsCommandBuffer, m_swapchainRenderPass, frameData.framebuffer, m_mesh->numShapes(),
+        [&](CommandBuffer& commandBuffer, uint32_t begin, uint32_t end)
+        {
+            m_mesh->render(commandBuffer, begin, end - begin);
+        });
 }
 
 void SimpleRenderer::createGUIContent()
@@ -51,5 +52,7 @@ void SimpleRenderer::createGUIContent()
     ImGui::Text("#vertices: %u", m_mesh->numVertices());
     ImGui::Text("#triangles: %u", m_mesh->numTriangles());
     ImGui::Text("#shapes: %u", m_mesh->numShapes());
+    ImGui::Text("Bindless textures: %s", m_mesh->isBindless() ? "yes" : "no");
+    ImGui::Text("Geometry pool pages: %u", m_geometryPool ? m_geometryPool->pageCount() : 0u);
     ImGui::End();
 }
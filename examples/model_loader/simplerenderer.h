@@ -12,7 +12,7 @@ private:
     void createGUIContent() override;
 
     std::string meshFilename;
+    // outlives the mesh, whose geometry lives in it
+    std::unique_ptr<GeometryPool> m_geometryPool;
     std::unique_ptr<Mesh> m_mesh;
-
-    DrawFunc m_meshDrawFunc;
 };
\ No newline at end of file
@@ -1,12 +1,14 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 0, binding = 0) uniform Camera
+layout(set = 0, binding = 0) uniform Frame
 {
     mat4 mvp;
-    vec4 cameraPos;
+    vec4 cameraPosition;
     float pixelsPerRadians;
-} camera;
+    float time;
+    uint frameIndex;
+} frame;
 
 
 layout(location = 0) in vec2 positions;
@@ -31,6 +33,6 @@ void main()
 
     outColor = vec4(1, hitCount, hitCount - 1, opacity);
        
-    gl_Position = camera.mvp * vec4(positions, 0.0, 1.0);
-    gl_PointSize = camera.pixelsPerRadians * PixelSizePerRadians / gl_Position.w;
+    gl_Position = frame.mvp * vec4(positions, 0.0, 1.0);
+    gl_PointSize = frame.pixelsPerRadians * PixelSizePerRadians / gl_Position.w;
 }
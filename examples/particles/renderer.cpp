@@ -4,17 +4,16 @@
 #include "barrier.h"
 #include "imgui.h"
 
+#include <algorithm>
 #include <random>
 #include <array>
 
-const uint32_t SET_ID_CAMERA = 0;
-const uint32_t BINDING_ID_CAMERA = 0;
-
 const uint32_t SET_ID_GROUND = 1;
 const uint32_t BINDING_ID_GROUND = 0;
 
 const uint32_t BINDING_ID_COMPUTE_PARTICLES = 0;
 const uint32_t BINDING_ID_COMPUTE_INPUT = 1;
+const uint32_t BINDING_ID_COMPUTE_VERTICES = 2;
 
 const uint32_t WORKGROUP_SIZE = 512;
 
@@ -31,18 +30,17 @@ bool Renderer::setup()
     if (!m_computeShader)
         return false;
 
-    m_descriptorPool = m_device.createDescriptorPool(2, 
-        { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
-          { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 } });
+    m_descriptorAllocator = std::make_unique<DescriptorAllocator>(m_device, ParticleBufferCount);
+
+    m_hasSeparateComputeFamily = m_device.computeQueue().familyId() != m_device.graphicsQueue().familyId();
     
     m_particleCount = static_cast<int>(m_particlesPerSecond * m_particleLifetimeInSeconds);
     m_groupCount = static_cast<uint32_t>(std::ceil(static_cast<float>(m_particleCount) / WORKGROUP_SIZE));
 
-    setupCameraDescriptorSet();
     setupParticleVertexBuffer();
     setupGraphicsPipeline();
     setupComputePipeline();
-    createComputeCommandBuffer();
+    createComputeFrameResources();
 
     const auto size = 10.f;
     glm::vec3 min(-size, -size, 0.f);
@@ -52,14 +50,6 @@ bool Renderer::setup()
     return true;
 }
 
-void Renderer::setupCameraDescriptorSet()
-{
-    m_cameraDescriptorSetLayout = m_device.createDescriptorSetLayout({ { BINDING_ID_CAMERA, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT } });
-
-    m_cameraUniformDescriptorSet.setUniformBuffer(BINDING_ID_CAMERA, m_cameraUniformBuffer);
-    m_cameraUniformDescriptorSet.allocateAndUpdate(m_device, m_cameraDescriptorSetLayout, m_descriptorPool);
-}
-
 void Renderer::setupParticleVertexBuffer()
 {
     struct ParticleData
@@ -83,13 +73,26 @@ void Renderer::setupParticleVertexBuffer()
         { 1, 4, offsetof(ParticleData, age) }
     }; 
 
-    m_vertexBuffer.reset(new VertexBuffer(m_device));
-    m_vertexBuffer->createFromInterleavedAttributes(m_particleCount, sizeof(ParticleData), &particles.front().pos.x, vertexDesc);
+    for (auto& vertexBuffer : m_vertexBuffers)
+    {
+        vertexBuffer.reset(new VertexBuffer(m_device, BufferSource::Gpu));
+        vertexBuffer->createFromInterleavedAttributes(m_particleCount, sizeof(ParticleData), &particles.front().pos.x, vertexDesc);
+    }
+
+    const auto stateSize = sizeof(ParticleData) * particles.size();
+    m_particleStateBuffer = GPUStorageBuffer(m_device, stateSize);
+    // the simulation state is only used by compute, so the upload hands it to the compute family, the flush puts
+    // the acquire on the compute queue in front of the next simulation step
+    m_particleStateBuffer.upload(particles.data(), stateSize, 0, m_device.computeQueue().familyId());
+    m_device.uploadManager().flush();
+
+    // the fresh vertex buffers were never released by the compute queue
+    m_releasedToGraphics = {};
 }
 
 void Renderer::setupGraphicsPipeline()
 {
-    m_graphicsPipelineLayout = m_device.createPipelineLayout({ m_cameraDescriptorSetLayout });
+    m_graphicsPipelineLayout = m_frameDescriptorSet->createPipelineLayout();
 
     GraphicsPipelineSettings settings;
     settings.setPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_POINT_LIST).setDepthTesting(false);
@@ -102,53 +105,76 @@ void Renderer::setupGraphicsPipeline()
         m_graphicsPipelineLayout,
         settings,
         m_shader.shaderStageCreateInfos,
-        m_vertexBuffer->getAttributeDescriptions(),
-        m_vertexBuffer->getBindingDescriptions());
+        m_vertexBuffers.front()->getAttributeDescriptions(),
+        m_vertexBuffers.front()->getBindingDescriptions());
 }
 
 void Renderer::setupComputePipeline()
 {
     m_computeInputBuffer = UniformBuffer(m_device, sizeof(ComputeInput));
-    m_computeMappedInputBuffer = static_cast<ComputeInput*>(m_computeInputBuffer.map());
+    m_computeMappedInputBuffer = static_cast<ComputeInput*>(m_computeInputBuffer.data());
     m_computeMappedInputBuffer->particleCount = m_particleCount;
     m_computeMappedInputBuffer->particleLifetimeInSeconds = m_particleLifetimeInSeconds;
     m_computeMappedInputBuffer->particleSpeed = m_particleSpeed;
     m_computeMappedInputBuffer->gravityForce = -0.0005f;
     m_computeMappedInputBuffer->collisionDamping = 0.7f;
     m_computeMappedInputBuffer->emitterPos = m_emitterPosition;
-    m_computeMappedInputBuffer->timeDeltaInSeconds = 0.f;
 
     m_computeDescriptorSetLayout = m_device.createDescriptorSetLayout(
         { { BINDING_ID_COMPUTE_PARTICLES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
-          { BINDING_ID_COMPUTE_INPUT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT } });
+          { BINDING_ID_COMPUTE_INPUT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+          { BINDING_ID_COMPUTE_VERTICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT } });
 
-    m_computeDescriptorSet.allocate(m_device, m_computeDescriptorSetLayout, m_descriptorPool);
-    m_computeDescriptorSet.setStorageBuffer(BINDING_ID_COMPUTE_PARTICLES, *m_vertexBuffer);
-    m_computeDescriptorSet.setBuffer(BINDING_ID_COMPUTE_INPUT, m_computeInputBuffer);
-    m_computeDescriptorSet.update(m_device);
+    for (auto& descriptorSet : m_computeDescriptorSets)
+        descriptorSet.allocate(*m_descriptorAllocator, m_computeDescriptorSetLayout);
+    updateComputeDescriptorSets();
 
-    m_computePipelineLayout = m_device.createPipelineLayout({ m_computeDescriptorSetLayout });
+    m_computePipelineLayout = m_device.createPipelineLayout({ m_computeDescriptorSetLayout }, { CommandBuffer::pushConstantRange<float>(VK_SHADER_STAGE_COMPUTE_BIT) });
 
-    VkComputePipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    pipelineInfo.flags = 0;
-    pipelineInfo.stage = m_computeShader.shaderStageCreateInfos.front();
-    pipelineInfo.layout = m_computePipelineLayout;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = 0;
+    m_computePipeline = m_device.createComputePipeline(m_computePipelineLayout, m_computeShader.shaderStageCreateInfos.front());
+}
 
-    VK_CHECK_RESULT(vkCreateComputePipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_computePipeline));
+void Renderer::updateComputeDescriptorSets()
+{
+    DescriptorUpdateBatch updateBatch;
+    for (auto i = 0u; i < ParticleBufferCount; i++)
+    {
+        auto& descriptorSet = m_computeDescriptorSets[i];
+        descriptorSet.setStorageBuffer(BINDING_ID_COMPUTE_PARTICLES, m_particleStateBuffer.buffer());
+        descriptorSet.setBuffer(BINDING_ID_COMPUTE_INPUT, m_computeInputBuffer);
+        descriptorSet.setStorageBuffer(BINDING_ID_COMPUTE_VERTICES, *m_vertexBuffers[i]);
+        updateBatch.add(descriptorSet);
+    }
+    updateBatch.submit(m_device);
 }
 
 void Renderer::shutdown()
 {
-    m_vertexBuffer.reset();
+    for (auto& vertexBuffer : m_vertexBuffers)
+        vertexBuffer.reset();
+    m_particleStateBuffer = GPUStorageBuffer();
     m_device.destroy(m_graphicsPipelineLayout);
 
-    m_device.destroy(m_cameraDescriptorSetLayout);
-    m_device.destroy(m_descriptorPool);
+    m_descriptorAllocator.reset();
 
-    m_computeCommandBuffers.clear();
+    for (auto& resources : m_computeFrameResources)
+    {
+        resources.commandBuffer.reset();
+        m_device.destroy(resources.commandPool);
+        m_device.destroy(resources.fence);
+        if (m_timingsSupported)
+        {
+            resources.computeQueries.destroy();
+            resources.renderQueries.destroy();
+        }
+    }
+    m_computeFrameResources.clear();
+
+    for (auto i = 0u; i < ParticleBufferCount; i++)
+    {
+        m_device.destroy(m_computeCompleteSemaphores[i]);
+        m_device.destroy(m_renderCompleteSemaphores[i]);
+    }
     m_computeInputBuffer = UniformBuffer();
     m_device.destroy(m_computeDescriptorSetLayout);
     m_device.destroy(m_computePipeline);
@@ -159,68 +185,167 @@ void Renderer::shutdown()
     ShaderManager::Release(m_device, m_computeShader);
 }
 
-void Renderer::renderParticles(CommandBuffer& commandBuffer) const
+void Renderer::renderParticles(CommandBuffer& commandBuffer, uint32_t bufferId) const
 {
-    m_cameraUniformDescriptorSet.bind(commandBuffer, m_graphicsPipelineLayout, SET_ID_CAMERA);
-
+    // the frame descriptor set was bound by fillCommandBuffer
     commandBuffer.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 
-    m_vertexBuffer->bind(commandBuffer);
-    m_vertexBuffer->draw(commandBuffer);
+    m_vertexBuffers[bufferId]->bind(commandBuffer);
+    m_vertexBuffers[bufferId]->draw(commandBuffer);
 }
 
-bool Renderer::createComputeCommandBuffer()
+bool Renderer::createComputeFrameResources()
 {
-    // Create a command buffer for compute operations
-    m_computeCommandBuffers.resize(m_frameResourceCount);
-    for (auto& buffer : m_computeCommandBuffers)
-        buffer = m_device.createComputeCommandBuffer();
+    // timestamps of the compute and the graphics queue are compared to show their overlap
+    m_timingsSupported = m_device.properties().limits.timestampComputeAndGraphics == VK_TRUE;
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (auto i = 0u; i < m_frameResourceCount; i++)
+    {
+        m_computeFrameResources.emplace_back(m_device);
+        auto& resources = m_computeFrameResources.back();
+
+        resources.commandPool = m_device.createCommandPool(m_device.computeQueue().familyId());
+        resources.commandBuffer = m_device.createCommandBuffer(resources.commandPool);
+        VK_CHECK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &resources.fence));
+        if (m_timingsSupported)
+        {
+            resources.computeQueries.init();
+            resources.renderQueries.init();
+        }
+    }
+
+    for (auto i = 0u; i < ParticleBufferCount; i++)
+    {
+        m_computeCompleteSemaphores[i] = m_device.createSemaphore();
+        m_renderCompleteSemaphores[i] = m_device.createSemaphore();
+    }
 
     return true;
 }
- 
-void Renderer::buildComputeCommandBuffer(CommandBuffer& commandBuffer)
+
+void Renderer::buildComputeCommandBuffer(CommandBuffer& commandBuffer, uint32_t bufferId)
 {
+    const auto& resources = m_computeFrameResources[m_frameResourceId];
+
     commandBuffer.begin();
+    if (m_timingsSupported)
+        resources.computeQueries.begin(commandBuffer);
+
+    // the previous dispatch may still write the state, nothing else orders consecutive compute submissions
+    commandBuffer.pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        createBufferMemoryBarrier(m_particleStateBuffer.buffer(), VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
 
-    // Add memory barrier to ensure that the (graphics) vertex shader has fetched attributes before compute starts to write to the buffer
-    auto bufferBarrier = createBufferMemoryBarrier(*m_vertexBuffer,
-        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,    // Vertex shader invocations have finished reading from the buffer
-        VK_ACCESS_SHADER_WRITE_BIT,             // Compute shader wants to write to the buffer
-        m_device.graphicsQueue().familyId(),
-        m_device.computeQueue().familyId());
-  
-    commandBuffer.pipelineBarrier(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, bufferBarrier);
+    // the vertices are overwritten completely, so the graphics queue never releases them and their contents are discarded
 
     commandBuffer.bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
-    VkDescriptorSet descriptorSets{ m_computeDescriptorSet };
+    VkDescriptorSet descriptorSets{ m_computeDescriptorSets[bufferId] };
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipelineLayout, 0, 1, &descriptorSets, 0, 0);
+    commandBuffer.pushConstants(m_computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, m_timeDeltaInSeconds);
 
-    vkCmdDispatch(commandBuffer, m_groupCount, 1, 1);
-
-    // Add memory barrier to ensure that compute shader has finished writing to the buffer
-    // Without this the (rendering) vertex shader may display incomplete results (partial data from last frame) 
-    bufferBarrier = createBufferMemoryBarrier(*m_vertexBuffer,
-        VK_ACCESS_SHADER_WRITE_BIT,             // Compute shader has finished writes to the buffer
-        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,    // Vertex shader invocations want to read from the buffer
-        m_device.computeQueue().familyId(),
-        m_device.graphicsQueue().familyId());
-
-    commandBuffer.pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, bufferBarrier);
+    commandBuffer.dispatch(m_groupCount);
 
+    if (m_hasSeparateComputeFamily)
+    {
+        commandBuffer.pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            createBufferMemoryBarrier(*m_vertexBuffers[bufferId], VK_ACCESS_SHADER_WRITE_BIT, 0,
+                m_device.computeQueue().familyId(), m_device.graphicsQueue().familyId()));
+        m_releasedToGraphics[bufferId] = true;
+    }
+
+    if (m_timingsSupported)
+        resources.computeQueries.end(commandBuffer);
     commandBuffer.end();
 }
 
-void Renderer::render(const FrameData& frameData)
+void Renderer::acquireParticleVertices(CommandBuffer& commandBuffer, uint32_t bufferId)
+{
+    // on a single queue family the semaphore alone makes the compute writes visible
+    if (!m_releasedToGraphics[bufferId])
+        return;
+
+    commandBuffer.pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        createBufferMemoryBarrier(*m_vertexBuffers[bufferId], 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            m_device.computeQueue().familyId(), m_device.graphicsQueue().familyId()));
+    m_releasedToGraphics[bufferId] = false;
+}
+
+void Renderer::readTimings()
 {
-    // compute part
-    m_computeMappedInputBuffer->timeDeltaInSeconds = m_stats.getDeltaTime();
+    auto& resources = m_computeFrameResources[m_frameResourceId];
+    if (!m_timingsSupported || !resources.hasTimings)
+        return;
 
-    buildComputeCommandBuffer(*m_computeCommandBuffers[m_frameResourceId]);
-    m_device.computeQueue().submitAsync(*m_computeCommandBuffers[m_frameResourceId]);
+    uint64_t computeBegin, computeEnd, renderBegin, renderEnd;
+    if (!resources.computeQueries.timestamps(computeBegin, computeEnd) || !resources.renderQueries.timestamps(renderBegin, renderEnd))
+        return;
 
-    // graphics part
-    fillCommandBuffer(*frameData.resources.graphicsCommandBuffer, m_swapchainRenderPass, frameData.framebuffer, [this](auto& commandBuffer) { renderParticles(commandBuffer); });
+    const auto toMs = [this](uint64_t ticks) { return static_cast<float>(ticks) * m_device.properties().limits.timestampPeriod / 1000000.f; };
+    const auto overlapBegin = std::max(computeBegin, renderBegin);
+    const auto overlapEnd = std::min(computeEnd, renderEnd);
+
+    m_computeTimeMs = toMs(computeEnd - computeBegin);
+    m_renderTimeMs = toMs(renderEnd - renderBegin);
+    m_overlapTimeMs = overlapEnd > overlapBegin ? toMs(overlapEnd - overlapBegin) : 0.f;
+}
+
+void Renderer::waitForCompute() const
+{
+    for (const auto& resources : m_computeFrameResources)
+        vkWaitForFences(m_device, 1, &resources.fence, VK_TRUE, UINT64_MAX);
+}
+
+void Renderer::render(const FrameData& frameData)
+{
+    // the graphics work of this frame resource is complete, the compute work may not be
+    auto& resources = m_computeFrameResources[m_frameResourceId];
+    VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &resources.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(m_device, 1, &resources.fence));
+    VK_CHECK_RESULT(vkResetCommandPool(m_device, resources.commandPool, 0));
+    readTimings();
+
+    // compute writes frame N + 1 while graphics draws frame N
+    const auto computeBufferId = m_simulationFrame % ParticleBufferCount;
+    const auto renderBufferId = (m_simulationFrame + 1) % ParticleBufferCount;
+    m_simulationFrame++;
+
+    // compute part, waits until the buffer it overwrites has been drawn
+    m_timeDeltaInSeconds = m_stats.getDeltaTime();
+    buildComputeCommandBuffer(*resources.commandBuffer, computeBufferId);
+
+    QueueSubmission submission;
+    if (m_renderSemaphorePending[computeBufferId])
+        submission.addWait(m_renderCompleteSemaphores[computeBufferId], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    submission.addCommandBuffer(*resources.commandBuffer)
+        .addSignal(m_computeCompleteSemaphores[computeBufferId]);
+    m_device.computeQueue().submit(submission, resources.fence);
+    m_renderSemaphorePending[computeBufferId] = false;
+    m_computeSemaphorePending[computeBufferId] = true;
+
+    // graphics part, waits for the simulation of the previous frame
+    if (m_computeSemaphorePending[renderBufferId])
+        addFrameWait(m_computeCompleteSemaphores[renderBufferId], VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    addFrameSignal(m_renderCompleteSemaphores[renderBufferId]);
+    m_computeSemaphorePending[renderBufferId] = false;
+    m_renderSemaphorePending[renderBufferId] = true;
+
+    fillCommandBuffer(*frameData.resources.graphicsCommandBuffer, m_swapchainRenderPass, frameData.framebuffer,
+        [&](auto& commandBuffer)
+        {
+            renderParticles(commandBuffer, renderBufferId);
+            if (m_timingsSupported)
+                resources.renderQueries.end(commandBuffer);
+        },
+        [&](auto& commandBuffer)
+        {
+            if (m_timingsSupported)
+                resources.renderQueries.begin(commandBuffer);
+            acquireParticleVertices(commandBuffer, renderBufferId);
+        });
+    resources.hasTimings = true;
 }
 
 void Renderer::createGUIContent()
@@ -235,6 +360,8 @@ void Renderer::createGUIContent()
     ImGui::SliderFloat("gravity force", &m_computeMappedInputBuffer->gravityForce, -0.01f, 0.01f, "%.4f");
     ImGui::SliderFloat("collision damping", &m_computeMappedInputBuffer->collisionDamping, 0.0f, 2.0f, "%.1f");
     ImGui::SliderFloat2("emitter position", &m_computeMappedInputBuffer->emitterPos.x, -9.0f, 8.0f, "%.1f");
+    if (m_timingsSupported)
+        ImGui::Text("gpu ms: compute %.3f, render %.3f, overlap %.3f", m_computeTimeMs, m_renderTimeMs, m_overlapTimeMs);
         
     if (updatePartices)
         updateParticleCount();
@@ -244,8 +371,9 @@ void Renderer::createGUIContent()
 
 void Renderer::updateParticleCount()
 {
-    // finish all frames so vertexbuffer is not not used anymore and we can update it
+    // finish all frames so the particle buffers are not used anymore and we can update them
     waitForAllFrames();
+    waitForCompute();
 
     m_particleCount = static_cast<int>(m_particlesPerSecond * m_particleLifetimeInSeconds);
     m_computeMappedInputBuffer->particleCount = m_particleCount;
@@ -253,7 +381,5 @@ void Renderer::updateParticleCount()
     m_groupCount = static_cast<uint32_t>(std::ceil(static_cast<float>(m_particleCount) / WORKGROUP_SIZE));
 
     setupParticleVertexBuffer();
-
-    m_computeDescriptorSet.setStorageBuffer(BINDING_ID_COMPUTE_PARTICLES, *m_vertexBuffer);
-    m_computeDescriptorSet.update(m_device);
+    updateComputeDescriptorSets();
 }
@@ -4,8 +4,12 @@
 #include "shader.h"
 #include "vertexbuffer.h"
 #include "descriptorset.h"
+#include "descriptorallocator.h"
 #include "graphicspipeline.h"
 #include "buffer.h"
+#include "querypool.h"
+
+#include <array>
 
 class Renderer : public BasicRenderer
 {
@@ -14,42 +18,74 @@ private:
     void render(const FrameData& frameData) override;
     void shutdown() override;
     
-    void setupCameraDescriptorSet();
     void setupParticleVertexBuffer();
     void setupGraphicsPipeline();
     void setupComputePipeline();
-    bool createComputeCommandBuffer();
-    void buildComputeCommandBuffer(CommandBuffer& commandBuffer);
-    void renderParticles(CommandBuffer& commandBuffer) const;
+    void updateComputeDescriptorSets();
+    bool createComputeFrameResources();
+    void buildComputeCommandBuffer(CommandBuffer& commandBuffer, uint32_t bufferId);
+    void acquireParticleVertices(CommandBuffer& commandBuffer, uint32_t bufferId);
+    void renderParticles(CommandBuffer& commandBuffer, uint32_t bufferId) const;
+    void readTimings();
+    void waitForCompute() const;
     void updateParticleCount();
     void createGUIContent() override;
 
-    std::unique_ptr<VertexBuffer> m_vertexBuffer;
+    // compute writes one vertex buffer while the graphics queue draws the other one, written in the previous frame
+    static const uint32_t ParticleBufferCount = 2;
+    std::array<std::unique_ptr<VertexBuffer>, ParticleBufferCount> m_vertexBuffers;
+    GPUStorageBuffer m_particleStateBuffer;
+    uint32_t m_simulationFrame = 0;
+    bool m_hasSeparateComputeFamily = false;
+    std::array<bool, ParticleBufferCount> m_releasedToGraphics = {};
+
+    // binary semaphores per vertex buffer, pending until the other queue has waited on the signal
+    std::array<VkSemaphore, ParticleBufferCount> m_computeCompleteSemaphores = {};
+    std::array<VkSemaphore, ParticleBufferCount> m_renderCompleteSemaphores = {};
+    std::array<bool, ParticleBufferCount> m_computeSemaphorePending = {};
+    std::array<bool, ParticleBufferCount> m_renderSemaphorePending = {};
+
     Shader m_shader;
     VkPipeline m_graphicsPipeline;
     VkPipelineLayout m_graphicsPipelineLayout;
-    VkDescriptorSetLayout m_cameraDescriptorSetLayout = VK_NULL_HANDLE;
-    DescriptorSet m_cameraUniformDescriptorSet;
 
-    VkCommandPool m_computeCommandPool = VK_NULL_HANDLE;
-    std::vector<CommandBufferPtr> m_computeCommandBuffers;
+    // the graphics frame fence does not cover the compute submission, so it has its own
+    struct ComputeFrameResources
+    {
+        explicit ComputeFrameResources(const Device& device) : computeQueries(device), renderQueries(device) {}
+
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        CommandBufferPtr commandBuffer;
+        VkFence fence = VK_NULL_HANDLE;
+        QueryPool computeQueries;
+        QueryPool renderQueries;
+        bool hasTimings = false;
+    };
+    std::vector<ComputeFrameResources> m_computeFrameResources;
+    bool m_timingsSupported = false;
+    float m_computeTimeMs = 0.f;
+    float m_renderTimeMs = 0.f;
+    float m_overlapTimeMs = 0.f;
+
     VkPipeline m_computePipeline;
     VkPipelineLayout m_computePipelineLayout;
     VkDescriptorSetLayout m_computeDescriptorSetLayout = VK_NULL_HANDLE;
-    DescriptorSet m_computeDescriptorSet;
+    std::array<DescriptorSet, ParticleBufferCount> m_computeDescriptorSets;
     Shader m_computeShader;
     UniformBuffer m_computeInputBuffer;
     struct ComputeInput
     {
         int particleCount;
-        float timeDeltaInSeconds;
         float particleLifetimeInSeconds;
         float particleSpeed;
         float gravityForce;
         float collisionDamping;
-        glm::vec2 emitterPos;
+        // std140 aligns vec2 to 8 bytes
+        alignas(8) glm::vec2 emitterPos;
     };
     ComputeInput* m_computeMappedInputBuffer = nullptr;
+    // pushed, the uniform buffer may still be read by the previous dispatch
+    float m_timeDeltaInSeconds = 0.f;
 
     int m_particleCount = 0u;
     int m_particlesPerSecond = 2000u;
@@ -59,5 +95,5 @@ private:
     
     uint32_t m_groupCount = 0u;
 
-    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::unique_ptr<DescriptorAllocator> m_descriptorAllocator;
 };
@@ -1,17 +1,32 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 0, binding = 0) uniform Camera 
+layout(set = 0, binding = 0) uniform Frame
 {
     mat4 mvp;
-} camera;
+    vec4 cameraPosition;
+    float pixelsPerRadians;
+    float time;
+    uint frameIndex;
+} frame;
 
-layout(set = 1, binding = 0) uniform Material 
+struct Material
 {
     vec4 ambient;
     vec4 diffuse;
     vec4 emission;
-} material;
+    uint textureIndex;
+};
+
+layout(set = 1, binding = 0) readonly buffer Materials
+{
+    Material materials[];
+};
+
+layout(push_constant) uniform DrawParameters
+{
+    uint materialId;
+} draw;
 
 layout(location = 0) in vec3 positions;
 layout(location = 1) in vec3 normals;
@@ -24,6 +39,8 @@ out gl_PerVertex {
 
 void main()
 {
-    gl_Position = camera.mvp * vec4(positions, 1.0);
+    Material material = materials[draw.materialId];
+
+    gl_Position = frame.mvp * vec4(positions, 1.0);
     color = material.ambient + material.diffuse * max(0.2, dot(normalize(vec3(0.5,1,0)), normals)) + material.emission;
 }
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(set = 0, binding = 0) uniform Frame
+{
+    mat4 mvp;
+    vec4 cameraPosition;
+    float pixelsPerRadians;
+    float time;
+    uint frameIndex;
+} frame;
+
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 emission;
+    uint textureIndex;
+};
+
+layout(set = 1, binding = 0) readonly buffer Materials
+{
+    Material materials[];
+};
+
+layout(push_constant) uniform DrawParameters
+{
+    uint materialId;
+} draw;
+
+
+layout(location = 0) in vec3 positions;
+layout(location = 1) in vec3 normals;
+layout(location = 2) in vec2 texCoords;
+
+layout(location = 0) out vec3 color;
+layout(location = 1) out vec2 texCoord;
+layout(location = 2) flat out uint textureIndex;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    Material material = materials[draw.materialId];
+
+    gl_Position = frame.mvp * vec4(positions, 1.0);
+    color = material.ambient.rgb + material.diffuse.rgb * max(0.2, dot(normalize(vec3(0.5,1,0)), normals)) + material.emission.rgb;
+    texCoord = texCoords;
+    textureIndex = material.textureIndex;
+}
@@ -4,7 +4,7 @@
 layout(location = 0) in vec3 color;
 layout(location = 1) in vec2 texCoord;
 
-layout(set = 1, binding = 1) uniform sampler2D texSampler;
+layout(set = 2, binding = 0) uniform sampler2D texSampler;
 
 layout(location = 0) out vec4 outColor;
 
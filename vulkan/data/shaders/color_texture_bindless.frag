@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 color;
+layout(location = 1) in vec2 texCoord;
+layout(location = 2) flat in uint textureIndex;
+
+// the index comes from the material of the draw, so it is dynamically uniform and needs no nonuniformEXT
+layout(set = 2, binding = 0) uniform sampler textureSampler;
+layout(set = 2, binding = 1) uniform texture2D textures[];
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    outColor = vec4(color, 1) * texture(sampler2D(textures[textureIndex], textureSampler), texCoord);
+}
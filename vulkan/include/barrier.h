@@ -2,8 +2,20 @@
 
 #include <vulkan/vulkan.h>
 
-VkPipelineStageFlags getPipelineStageFlags(VkAccessFlags access);
+// how a command uses a resource, images also need the layout of the use
+struct ResourceAccess
+{
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags access = 0;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+// the narrowest stages and accesses of an image in the layout, shaderStages are the stages sampling or storing to it
+ResourceAccess getLayoutAccess(VkImageLayout layout, VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+VkImageSubresourceRange createImageSubresourceRange(VkFormat imageFormat, uint32_t baseMipLevel = 0, uint32_t levelCount = 1, uint32_t baseArrayLayer = 0, uint32_t layerCount = 1);
 
 VkImageMemoryBarrier createImageMemoryBarrier(VkImage image, VkFormat imageFormat, VkImageLayout oldLayout, VkImageLayout newLayout);
+VkImageMemoryBarrier createImageMemoryBarrier(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout);
 
 VkBufferMemoryBarrier createBufferMemoryBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
\ No newline at end of file
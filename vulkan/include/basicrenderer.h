@@ -4,8 +4,11 @@
 #include "device.h"
 #include "image.h"
 #include "buffer.h"
-#include "imagepool.h"
 #include "commandbuffer.h" 
+#include "frameringbuffer.h"
+#include "framedescriptorset.h"
+#include "parallelrecorder.h"
+#include "bindlesstextures.h"
 
 #include "../utils/camerainputhandler.h"
 #include "../utils/statistics.h"
@@ -36,16 +39,24 @@ public:
 
 protected:
     using DrawFunc = std::function<void(CommandBuffer&)>;
-    void fillCommandBuffer(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, const DrawFunc&);
+    // preRenderPassFunc records commands in front of the render pass, e.g. barriers
+    void fillCommandBuffer(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, const DrawFunc&, const DrawFunc& preRenderPassFunc = nullptr);
+    // splits drawCount draws across the recording threads, the gui is added to the same render pass afterwards
+    void fillCommandBufferParallel(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t drawCount, const ParallelRecorder::RecordFunc&);
     void setCameraFromBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& lookDir);
     void setClearColor(VkClearColorValue clearColor);
     const VkClearColorValue& clearColor() const;
-    void updateMVPUniform();
+    void updateCameraParameter();
     void waitForAllFrames() const;
+    // additional dependencies of the current frame submission, e.g. on async compute work
+    void addFrameWait(VkSemaphore semaphore, VkPipelineStageFlags waitStages, uint64_t value = 0);
+    void addFrameSignal(VkSemaphore semaphore, uint64_t value = 0);
     virtual void createGUIContent() {};
 
     struct BaseFrameResources
     {
+        // reset as a whole once the frame is complete
+        VkCommandPool commandPool;
         CommandBufferPtr graphicsCommandBuffer;
         VkFence frameCompleteFence;
     };
@@ -65,20 +76,25 @@ protected:
     SwapChain m_swapChain;
     VkRenderPass m_swapchainRenderPass;
     Statistics m_stats;
-    ImagePool m_imagePool;
 
-    struct CameraParameter
-    {
-        glm::mat4x4 mvp;
-        glm::vec4 pos;
-        float pixelsPerRadians;
-    };
-    UniformBuffer m_cameraUniformBuffer;
-    CameraParameter * m_mappedCameraUniformBuffer = nullptr;
+    // transient per frame data, recycled once the frame resource is reused
+    FrameRingBuffer m_frameRingBuffer;
+
+    // camera, time and frame index as set 0 of all graphics pipelines, fillCommandBuffer and fillCommandBufferParallel bind it,
+    // renderers beginning their command buffers themselves bind it once after begin
+    std::unique_ptr<FrameDescriptorSet> m_frameDescriptorSet;
+
+    std::unique_ptr<ParallelRecorder> m_parallelRecorder;
+
+    // shared by all meshes, null without descriptor indexing support
+    std::unique_ptr<BindlessTextures> m_bindlessTextures;
 
 private:
     std::vector<BaseFrameResources> m_frameResources;
+    FrameDescriptorSet::Parameter m_frameParameter;
+    uint64_t m_startTimeInMicroseconds = 0;
     std::vector<VkFramebuffer> m_framebuffers;
+    QueueSubmission m_frameSubmission;
 
     bool createInstance();
     bool createDevice();
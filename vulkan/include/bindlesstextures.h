@@ -0,0 +1,46 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// One descriptor set holding a sampler and a large, partially bound array of sampled images. Textures are
+// added once and referenced by their index, so draws select their texture through e.g. a material buffer
+// instead of binding a set per texture. The array is update after bind, adding or removing textures does not
+// invalidate command buffers the set is bound in. Needs Device::descriptorIndexingSupported.
+//
+// In the shaders:
+//     layout(set = N, binding = 0) uniform sampler textureSampler;
+//     layout(set = N, binding = 1) uniform texture2D textures[];
+class BindlessTextures : public DeviceRef, NonCopyable
+{
+public:
+    // far below the update after bind sampled image limits guaranteed with descriptor indexing
+    static constexpr uint32_t Capacity = 4096;
+    static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+    explicit BindlessTextures(const Device& device);
+    ~BindlessTextures();
+
+    // the image view has to be in the shader read only layout when sampled, returns InvalidIndex when the array is full
+    uint32_t add(VkImageView imageView);
+    // the index is reused by the next add, so the command buffers sampling the texture have to be complete
+    void remove(uint32_t index);
+
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId) const;
+
+    VkDescriptorSetLayout layout() const { return m_layout; }
+    uint32_t count() const { return m_nextIndex - static_cast<uint32_t>(m_freeIndices.size()); }
+
+private:
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+    VkDescriptorPool m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+
+    // indices below m_nextIndex were handed out, the removed ones are reused first
+    uint32_t m_nextIndex = 0;
+    std::vector<uint32_t> m_freeIndices;
+};
@@ -23,6 +23,7 @@ enum class MemoryType
 {
     DeviceLocal = int(VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
     CpuVisible = int(VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+    CpuCached = int(VkMemoryPropertyFlagBits::VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT),
 };
 
 constexpr MemoryType operator|(MemoryType a, MemoryType b)
@@ -46,12 +47,12 @@ protected:
     }
 
 public:
-    static constexpr bool isCpuVisible = has(Memory, MemoryType::CpuVisible);
+    static constexpr bool isCpuVisible = (uint32_t(Memory) & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
 
     Buffer() = default;
 
-    Buffer(const Device& device, uint64_t size)
-        : BufferBase(device, size, VkBufferUsageFlagBits(Usage), VkMemoryPropertyFlags(Memory))
+    Buffer(const Device& device, uint64_t size, BufferSource source = BufferSource::Gpu)
+        : BufferBase(device, size, VkBufferUsageFlagBits(Usage), VkMemoryPropertyFlags(Memory), source)
     {
     }
 
@@ -83,16 +84,22 @@ public:
         return *this;
     }
 
-    void* map(uint64_t size = VK_WHOLE_SIZE, uint64_t offset = 0) const
+    void* data() const
+    {
+        static_assert(isCpuVisible);
+        return BufferBase::data();
+    }
+
+    void flush(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE) const
     {
         static_assert(isCpuVisible);
-        return BufferBase::map(size, offset);
+        BufferBase::flush(offset, size);
     }
 
-    void unmap() const
+    void invalidate(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE) const
     {
         static_assert(isCpuVisible);
-        BufferBase::unmap();
+        BufferBase::invalidate(offset, size);
     }
 
     template<typename T>
@@ -107,11 +114,25 @@ public:
         static_assert(isCpuVisible);
         BufferBase::fill(fillFunc);
     }
+
+    UploadHandle upload(const void* data, uint64_t size, uint64_t offset = 0, uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED) const
+    {
+        static_assert(!isCpuVisible && has(Usage, BufferUsage::TransferDst));
+        return BufferBase::upload(data, size, offset, dstQueueFamilyId);
+    }
+
+    UploadHandle upload(const WriteFunc& writeFunc, uint64_t size, uint64_t offset = 0, uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED) const
+    {
+        static_assert(!isCpuVisible && has(Usage, BufferUsage::TransferDst));
+        return BufferBase::upload(writeFunc, size, offset, dstQueueFamilyId);
+    }
 };
 
+using GPUGeometryBuffer = Buffer<BufferUsage::AttributeBit | BufferUsage::IndexBit | BufferUsage::StorageBit | BufferUsage::TransferDst, MemoryType::DeviceLocal>;
 using GPUAttributeStorageBuffer = Buffer<BufferUsage::AttributeBit | BufferUsage::StorageBit | BufferUsage::TransferDst, MemoryType::DeviceLocal>;
 using GPUAttributeBuffer = Buffer<BufferUsage::AttributeBit | BufferUsage::TransferDst, MemoryType::DeviceLocal>;
 using GPUIndexBuffer = Buffer<BufferUsage::IndexBit | BufferUsage::TransferDst, MemoryType::DeviceLocal>;
+using GPUStorageBuffer = Buffer<BufferUsage::StorageBit | BufferUsage::TransferDst, MemoryType::DeviceLocal>;
 
 using CPUAttributeBuffer = Buffer<BufferUsage::AttributeBit, MemoryType::CpuVisible>;
 using CPUIndexBuffer = Buffer<BufferUsage::IndexBit, MemoryType::CpuVisible>;
@@ -2,6 +2,7 @@
 
 #include "deviceref.h"
 #include "noncopyable.h"
+#include "memoryallocator.h"
 
 #include <functional>
 #include <assert.h>
@@ -10,6 +11,13 @@
 
 class Device;
 
+// what writes the contents of a device local buffer, buffers filled from the cpu prefer host visible vram
+enum class BufferSource
+{
+    Gpu,
+    Cpu
+};
+
 class BufferBase : public DeviceRef, NonCopyable
 {
 public:
@@ -20,32 +28,46 @@ public:
 
     uint64_t size() const;
     VkBuffer buffer() const;
-    VkDeviceMemory memory() const;  
+    VkDeviceMemory memory() const;
+    VkDeviceSize memoryOffset() const;
+    MemoryCategory memoryCategory() const;
 
     using FillFunc = std::function<void(void*)>;
+    // fills [offset, offset + size) of an upload, which may be split into several chunks
+    using WriteFunc = std::function<void(void* destination, uint64_t offset, uint64_t size)>;
+
+    // batch id of the UploadManager, 0 if the data is visible right away
+    using UploadHandle = uint64_t;
 
 protected:
     BufferBase() = default;
-    BufferBase(const Device&, uint64_t size, VkBufferUsageFlagBits usageFlags, VkMemoryPropertyFlags memoryProperties);
+    BufferBase(const Device&, uint64_t size, VkBufferUsageFlagBits usageFlags, VkMemoryPropertyFlags memoryProperties, BufferSource source = BufferSource::Gpu);
 
     void swap(BufferBase& other);
 
-    void* map(uint64_t size = VK_WHOLE_SIZE, uint64_t offset = 0) const;
-    void unmap() const;
+    // cpu visible buffers stay mapped for their whole lifetime
+    void* data() const;
+    void flush(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE) const;
+    void invalidate(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE) const;
 
     template<typename T>
     void assign(T* inputData, uint64_t size) const
     {
         assert(size <= m_size);
-        const auto dstData = map(m_size, 0);
-        std::memcpy(dstData, inputData, size);
-        unmap();
+        std::memcpy(data(), inputData, size);
+        flush(0, size);
     }
 
     void fill(const FillFunc& fillFunc) const;
 
+    // writes through the mapping if the buffer was placed in host visible memory, through a staging copy otherwise
+    // offset and size are relative to the buffer, big uploads are streamed through the staging ring in chunks
+    // a staged upload is handed to the queue family which uses the buffer, the graphics one by default
+    UploadHandle upload(const void* data, uint64_t size, uint64_t offset = 0, uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED) const;
+    UploadHandle upload(const WriteFunc& writeFunc, uint64_t size, uint64_t offset = 0, uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED) const;
+
 private:
     uint64_t m_size = 0;
     VkBuffer m_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    MemoryAllocation m_allocation;
 };
@@ -2,6 +2,11 @@
 
 #include "deviceref.h"
 #include "vulkanhelper.h"
+#include "resourcestatetracker.h"
+
+#include <cassert>
+#include <type_traits>
+#include <vector>
 
 class CommandBuffer : public DeviceRef
 {
@@ -13,24 +18,64 @@ public:
     CommandBuffer& operator=(const CommandBuffer&) = delete;
 
     void begin();
+    // secondary command buffers continue the given render pass and set viewport and scissor to the extent
+    void beginSecondary(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent);
     void end();
 
     void bindPipeline(VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline);
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    // the guaranteed minimum of maxPushConstantsSize
+    static constexpr uint32_t MaxPushConstantSize = 128;
+
+    // declares the range of a push constant block for the pipeline layout
+    template<typename T>
+    static VkPushConstantRange pushConstantRange(VkShaderStageFlags stages, uint32_t offset = 0)
+    {
+        static_assert(sizeof(T) % 4 == 0, "push constant blocks have to be a multiple of 4 bytes");
+        static_assert(sizeof(T) <= MaxPushConstantSize, "push constant block is larger than all devices support");
+        assert(offset % 4 == 0 && offset + sizeof(T) <= MaxPushConstantSize);
+        return { stages, offset, static_cast<uint32_t>(sizeof(T)) };
+    }
+
+    // the stages have to match the ones of the layout ranges overlapping the block
+    template<typename T>
+    void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, const T& constants, uint32_t offset = 0)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "push constants are copied byte wise");
+        const auto range = pushConstantRange<T>(stages, offset);
+        vkCmdPushConstants(m_commandBuffer, layout, range.stageFlags, range.offset, range.size, &constants);
+    }
+
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
     void copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent2D resolution);
+    void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, VkOffset2D imageOffset, VkExtent2D extent);
 
     void pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkImageMemoryBarrier barrier);
     void pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkBufferMemoryBarrier barrier);
+    void pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, const std::vector<VkImageMemoryBarrier>& barriers);
 
-    void beginRenderPass(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent, const VkClearColorValue *clearColor = nullptr);
+    // with secondary contents the draws have to be recorded into secondary command buffers, see executeCommands
+    void beginRenderPass(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent, const VkClearColorValue *clearColor = nullptr,
+        VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void endRenderPass();
 
+    void executeCommands(const std::vector<VkCommandBuffer>& commandBuffers);
+
+    void dispatch(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+
+    // declares how the next commands use the resource, the barriers this needs are batched and recorded
+    // in front of the next render pass, dispatch or copy, currentLayout is only used for the first access of an image
+    void bufferAccess(VkBuffer buffer, const ResourceAccess& access);
+    void imageAccess(VkImage image, const VkImageSubresourceRange& range, VkImageLayout currentLayout, const ResourceAccess& access);
+    // records the pending barriers, needed in front of commands which are not wrapped here
+    void flushBarriers();
+
     operator VkCommandBuffer() { return m_commandBuffer; }
 
 private:
-    CommandBuffer(const Device& device, VkCommandPool commandPool);
+    CommandBuffer(const Device& device, VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
     VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
     VkCommandPool m_usedCommandPool = VK_NULL_HANDLE;
+    ResourceStateTracker m_stateTracker;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "types.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Recycles the primary command buffers of one time submits like uploads. A command buffer is handed back
+// once the fence of its submission signaled and gets reset when it is begun again, so repeated
+// submissions allocate nothing. Like the command pool it allocates from, it is not thread safe.
+class CommandBufferCache : public DeviceRef, NonCopyable
+{
+public:
+    // the command pool needs VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT and has to outlive the cache
+    CommandBufferCache(const Device& device, VkCommandPool commandPool);
+    ~CommandBufferCache();
+
+    CommandBufferPtr acquire();
+    void recycle(CommandBufferPtr commandBuffer);
+
+    uint32_t allocatedCount() const { return m_allocatedCount; }
+
+private:
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    std::vector<CommandBufferPtr> m_freeCommandBuffers;
+    uint32_t m_allocatedCount = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Allocates descriptor sets from a chain of pools, a new and bigger pool is added whenever the current one is exhausted.
+// Sets are never freed one by one, reset returns all of them at once with vkResetDescriptorPool, so an owner
+// rebuilding its sets or a frame discarding its temporary sets pays for one reset per pool.
+class DescriptorAllocator : public DeviceRef, NonCopyable
+{
+public:
+    // descriptors of every type a pool reserves per set, a single set has to fit into a pool
+    static const std::vector<VkDescriptorPoolSize> DefaultSizesPerSet;
+
+    explicit DescriptorAllocator(const Device& device, uint32_t setsPerPool = 16, const std::vector<VkDescriptorPoolSize>& sizesPerSet = DefaultSizesPerSet);
+    ~DescriptorAllocator();
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+    // invalidates all allocated sets, the command buffers using them have to be complete
+    void reset();
+
+    uint32_t poolCount() const { return static_cast<uint32_t>(m_usedPools.size() + m_freePools.size()); }
+
+private:
+    VkDescriptorPool createPool();
+
+    std::vector<VkDescriptorPoolSize> m_sizesPerSet;
+    uint32_t m_setsPerPool = 0;
+    // the last used pool is the current one, the others are exhausted
+    std::vector<VkDescriptorPool> m_usedPools;
+    // reset pools kept for reuse
+    std::vector<VkDescriptorPool> m_freePools;
+};
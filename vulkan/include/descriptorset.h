@@ -3,12 +3,32 @@
 #include "buffer.h"
 
 #include <vulkan/vulkan.h>
+#include <array>
 #include <vector>
-#include <list>
 
+class DescriptorAllocator;
+
+// Keeps the descriptors of its bindings inline, setting a binding again only replaces its entry,
+// so re-pointing a set and updating it does not allocate. Only setImageArray stores its infos on the heap.
 class DescriptorSet
 {
 public:
+    static constexpr uint32_t MaxBindings = 8;
+
+    // the data of update templates, see createUpdateTemplate
+    union DescriptorInfo
+    {
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+    };
+
+    // one entry per binding of the layout, destroy the handle
+    struct UpdateTemplate
+    {
+        VkDescriptorUpdateTemplate handle = VK_NULL_HANDLE;
+        uint32_t entryCount = 0;
+    };
+
     template<MemoryType Memory>
     void setBuffer(uint32_t bindingId, const Buffer<BufferUsage::UniformBit, Memory>& buffer)
     {
@@ -21,12 +41,25 @@ public:
     void setUniformBuffer(uint32_t bindingId, VkBuffer uniformBuffer);
     void setStorageBuffer(uint32_t bindingId, VkBuffer storageBuffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 
-    void allocate(VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool pool);
-    void allocateAndUpdate(VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool pool);
+    // the offset is passed at bind time, range is the size visible to the shader
+    void setDynamicUniformBuffer(uint32_t bindingId, VkBuffer uniformBuffer, VkDeviceSize range);
+    void setDynamicStorageBuffer(uint32_t bindingId, VkBuffer storageBuffer, VkDeviceSize range);
+
+    // the set lives until the allocator is reset, it is not freed on its own
+    void allocate(DescriptorAllocator& allocator, VkDescriptorSetLayout layout);
+    void allocateAndUpdate(DescriptorAllocator& allocator, VkDescriptorSetLayout layout);
+    // writes the bindings set since the last update
     void update(VkDevice device);
-    void free(VkDevice device, VkDescriptorPool pool);
+    // writes all bindings with one call, the set has to hold exactly the bindings the template was created for
+    void update(VkDevice device, const UpdateTemplate& updateTemplate);
+
+    // for sets of the layout with single descriptor bindings, created once per layout and destroyed by the caller,
+    // a null handle for layouts with more than MaxBindings bindings
+    static UpdateTemplate createUpdateTemplate(VkDevice device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
 
     void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId) const;
+    // one offset per dynamic binding in binding order, the array is read during the call only
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId, const uint32_t* dynamicOffsets, uint32_t dynamicOffsetCount) const;
     static void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, const std::vector<VkDescriptorSet>& descriptorSets);
 
     bool isValid() const;
@@ -35,11 +68,47 @@ public:
     operator VkDescriptorSet() const { return m_descriptorSet; }
 
 private:
-    std::vector<VkWriteDescriptorSet> m_descriptorWrites;
+    friend class DescriptorUpdateBatch;
+
+    // one write per binding set since the last update plus the image array
+    static constexpr uint32_t MaxWrites = MaxBindings + 1;
+
+    struct Binding
+    {
+        uint32_t bindingId = 0;
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+        DescriptorInfo info = {};
+        bool isDirty = false;
+    };
+
+    void setImageInfo(uint32_t bindingId, VkDescriptorType type, VkImageView imageView, VkSampler sampler);
+    void setBufferInfo(uint32_t bindingId, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+    // null if all MaxBindings bindings are in use
+    Binding* acquireBinding(uint32_t bindingId, VkDescriptorType type);
+    // fills up to MaxWrites writes pointing into the set and marks the bindings as written
+    uint32_t collectWrites(VkWriteDescriptorSet* writes);
+
     VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
 
-    std::list<std::vector<VkDescriptorImageInfo>> m_imageInfos;
-    std::vector<VkDescriptorBufferInfo> m_bufferInfos;
+    // sorted by binding id, the order update templates expect
+    std::array<Binding, MaxBindings> m_bindings;
+    uint32_t m_bindingCount = 0;
+
+    std::vector<VkDescriptorImageInfo> m_imageArray;
+    uint32_t m_imageArrayBindingId = 0;
+    bool m_isImageArrayDirty = false;
 
     bool m_isValid = false;
 };
+
+// Collects the changed descriptors of many sets for one vkUpdateDescriptorSets call. The storage is kept
+// across submits, so a batch reused every frame only allocates while it grows. The added sets must not move before submit.
+class DescriptorUpdateBatch
+{
+public:
+    void add(DescriptorSet& descriptorSet);
+    void submit(VkDevice device);
+
+private:
+    std::vector<VkWriteDescriptorSet> m_writes;
+};
@@ -4,10 +4,17 @@
 #include "deviceref.h"
 #include "types.h"
 #include "queue.h"
+#include "memoryallocator.h"
+#include "uploadmanager.h"
+#include "commandbuffercache.h"
+#include "handlecache.h"
+#include "pipelinecache.h"
 
 #include <vulkan/vulkan.h>
 #include <vector>
 #include <array>
+#include <memory>
+#include <unordered_map>
 
 struct GraphicsPipelineSettings;
 class VertexBuffer;
@@ -21,53 +28,111 @@ struct RenderPassAttachmentDescription
     VkImageLayout       finalLayout;
 };
 
+bool isDepthAttachment(VkFormat format);
+
 class Device
 {
 public:
     bool init(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers);
     void destroy();
 
-    VkRenderPass createRenderPass(const std::vector<RenderPassAttachmentDescription>& attachmentDescriptions) const;
+    // without external dependencies the attachments have to be synchronized with barriers around the render pass
+    VkRenderPass createRenderPass(const std::vector<RenderPassAttachmentDescription>& attachmentDescriptions, bool externalDependencies = true) const;
 
     VkFramebuffer createFramebuffer(VkRenderPass renderPass, const std::vector<VkImageView>& attachments, VkExtent2D extent) const;
 
+    // Descriptor set and pipeline layouts are shared: creating one with the same bindings or the same set layouts and
+    // push constants returns the existing handle with another reference, destroy drops a reference.
+    // Pipelines acquired with the same layout are thereby shared as well.
     VkPipelineLayout createPipelineLayout(const std::vector<VkDescriptorSetLayout>& layouts = {}, const std::vector<VkPushConstantRange>& pushConstants = {}) const;
 
     VkPipeline createPipeline(VkRenderPass renderPass, VkPipelineLayout layout, const GraphicsPipelineSettings& settings,
         const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
         const std::vector<VkVertexInputAttributeDescription>& attributeDesc,
         const std::vector<VkVertexInputBindingDescription>& bindingDesc) const;
+    VkPipeline createComputePipeline(VkPipelineLayout layout, const VkPipelineShaderStageCreateInfo& shaderStage) const;
+
+    // used by all pipelines, loaded on init and saved on destroy
+    PipelineCache& pipelineCache() const { return *m_pipelineCache; }
 
     VkSampler createSampler(bool clampToEdge = false) const;
 
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) const;
     void copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent2D resolution) const;
 
-    VkDescriptorSetLayout createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) const;
+    // bindingFlags are per binding and need descriptorIndexingSupported, update after bind bindings need a pool created with that flag
+    VkDescriptorSetLayout createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags = {}) const;
 
-    VkDescriptorPool createDescriptorPool(uint32_t count, const std::vector<VkDescriptorPoolSize>& sizes, bool allowIndividualFreeing = false) const;
+    // sets are not freed individually, see DescriptorAllocator
+    VkDescriptorPool createDescriptorPool(uint32_t count, const std::vector<VkDescriptorPoolSize>& sizes,
+        VkDescriptorPoolCreateFlags flags = 0) const;
 
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
 
+    // best ranked type having all required properties, ~0u if there is none
+    static uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memProperties, uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0);
+
     operator VkDevice() const { return m_device; }
 
     VkPhysicalDevice vkPysicalDevice() const { return m_physicalDevice; };
     const Queue& presentationQueue() const { return m_presentQueue; };
     const Queue& graphicsQueue() const { return m_graphicsQueue; };
     const Queue& computeQueue() const { return m_computeQueue; };
+    const Queue& transferQueue() const { return m_transferQueue; };
 
     const VkPhysicalDeviceProperties& properties() const { return m_deviceProperties; }
     const VkPhysicalDeviceFeatures& features() const { return m_deviceFeatures; }
 
+    MemoryAllocator& memoryAllocator() const { return *m_memoryAllocator; }
+    MemoryStats memoryStats() const;
+    // budget and usage of every heap for the whole process, false without VK_EXT_memory_budget
+    bool memoryBudget(VkPhysicalDeviceMemoryBudgetPropertiesEXT& budgetProperties) const;
+    UploadManager& uploadManager() const { return *m_uploadManager; }
+
+    VkSemaphore createSemaphore() const;
+    // timeline semaphores need timelineSemaphoreSupported, they are waited on and queried from the cpu by value
+    VkSemaphore createTimelineSemaphore(uint64_t initialValue = 0) const;
+    // false when the timeout in nanoseconds expired before the value was reached
+    bool waitSemaphore(VkSemaphore timelineSemaphore, uint64_t value, uint64_t timeout = UINT64_MAX) const;
+    uint64_t semaphoreValue(VkSemaphore timelineSemaphore) const;
+    bool timelineSemaphoreSupported() const { return m_timelineSemaphoreSupported; }
+
+    // vkCmdPipelineBarrier2 with stages per barrier, needs synchronization2Supported
+    bool synchronization2Supported() const { return m_synchronization2Supported; }
+    void pipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfoKHR& dependencyInfo) const;
+
+    // partially bound sampled image arrays which are indexed dynamically and updated while bound, see BindlessTextures
+    bool descriptorIndexingSupported() const { return m_descriptorIndexingSupported; }
+
     CommandBufferPtr createCommandBuffer() const;
     CommandBufferPtr createComputeCommandBuffer() const;
+    CommandBufferPtr createTransferCommandBuffer() const;
+
+    // pools without VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT are reset as a whole with vkResetCommandPool
+    VkCommandPool createCommandPool(uint32_t queueFamilyId, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT) const;
+    CommandBufferPtr createCommandBuffer(VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+
+    // recycled command buffers for one time submits on the graphics, the compute and the transfer queue
+    CommandBufferCache& commandBufferCache() const { return *m_commandBufferCache; }
+    CommandBufferCache& computeCommandBufferCache() const { return m_computeCommandBufferCache ? *m_computeCommandBufferCache : *m_commandBufferCache; }
+    CommandBufferCache& transferCommandBufferCache() const { return m_transferCommandBufferCache ? *m_transferCommandBufferCache : *m_commandBufferCache; }
+
+    // graphics command pools for recording on worker threads, one per thread and frame resource.
+    // A pool and the command buffers allocated from it may only be used by one thread at a time.
+    void createThreadCommandPools(uint32_t threadCount, uint32_t frameCount);
+    CommandBufferPtr createSecondaryCommandBuffer(uint32_t threadId, uint32_t frameId) const;
+    // resets the pools of all threads for the frame resource, its command buffers must not be pending anymore
+    void resetThreadCommandPools(uint32_t frameId) const;
 
     template<typename T>
     void destroy(T t) const
     {
         detail::destroy(*this, t);
     }
+    void destroy(VkDescriptorSetLayout layout) const;
+    void destroy(VkPipelineLayout layout) const;
 
 private:
     struct QueueFamilyIds
@@ -75,24 +140,51 @@ private:
         uint32_t graphics = UINT32_MAX;
         uint32_t compute = UINT32_MAX;
         uint32_t present = UINT32_MAX;
+        uint32_t transfer = UINT32_MAX;
     };
 
     bool checkPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, QueueFamilyIds& queueFamilyIds);
+    bool isExtensionSupported(const char* extensionName) const;
     void createCommandPools();
 
-    static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
-
     VkDevice m_device = VK_NULL_HANDLE;
     VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
     VkCommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
     VkCommandPool m_computeCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandPool> m_threadCommandPools;
+    uint32_t m_threadCommandPoolFrameCount = 0;
 
     Queue m_presentQueue;
     Queue m_graphicsQueue;
     Queue m_computeQueue;
+    Queue m_transferQueue;
 
     VkPhysicalDeviceProperties m_deviceProperties;
     VkPhysicalDeviceFeatures m_deviceFeatures;
+
+    std::unique_ptr<MemoryAllocator> m_memoryAllocator;
+    std::unique_ptr<UploadManager> m_uploadManager;
+    std::unique_ptr<CommandBufferCache> m_commandBufferCache;
+    std::unique_ptr<CommandBufferCache> m_computeCommandBufferCache;
+    std::unique_ptr<CommandBufferCache> m_transferCommandBufferCache;
+    std::unique_ptr<PipelineCache> m_pipelineCache;
+    bool m_memoryBudgetSupported = false;
+
+    // the instance targets 1.1, so the timeline semaphore entry points come from VK_KHR_timeline_semaphore
+    bool m_timelineSemaphoreSupported = false;
+    PFN_vkWaitSemaphoresKHR m_vkWaitSemaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR m_vkGetSemaphoreCounterValue = nullptr;
+
+    bool m_synchronization2Supported = false;
+    PFN_vkCmdPipelineBarrier2KHR m_vkCmdPipelineBarrier2 = nullptr;
+
+    bool m_descriptorIndexingSupported = false;
+
+    mutable HandleCache<VkDescriptorSetLayout> m_descriptorSetLayoutCache;
+    mutable HandleCache<VkPipelineLayout> m_pipelineLayoutCache;
+    // the set layouts a pipeline layout holds a reference on
+    mutable std::unordered_map<VkPipelineLayout, std::vector<VkDescriptorSetLayout>> m_pipelineLayoutSetLayouts;
 };
 
 template<typename T>
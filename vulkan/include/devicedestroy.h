@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 
 class Device;
+struct MemoryAllocation;
 
 namespace detail
 {
@@ -13,8 +14,14 @@ namespace detail
     void destroy(const Device& device, VkSampler sampler);
     void destroy(const Device& device, VkPipelineLayout layout);
     void destroy(const Device& device, VkPipeline pipeline);
+    void destroy(const Device& device, VkPipelineCache pipelineCache);
     void destroy(const Device& device, VkRenderPass renderpass);
     void destroy(const Device& device, VkFramebuffer framebuffer);
     void destroy(const Device& device, VkDescriptorSetLayout layout);
     void destroy(const Device& device, VkDescriptorPool pool);
+    void destroy(const Device& device, VkDescriptorUpdateTemplate updateTemplate);
+    void destroy(const Device& device, VkFence fence);
+    void destroy(const Device& device, VkSemaphore semaphore);
+    void destroy(const Device& device, VkCommandPool commandPool);
+    void destroy(const Device& device, const MemoryAllocation& allocation);
 }
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "descriptorset.h"
+#include "descriptorallocator.h"
+
+#include "../utils/glm.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+class FrameRingBuffer;
+
+// The set all graphics pipeline layouts start with, holding the parameters of the current frame as a dynamic uniform
+// buffer in the frame ring buffer. Layouts from createPipelineLayout share the set layout and the push constant range,
+// so binding their pipelines and their other sets keeps the frame set bound: it is bound once per command buffer.
+class FrameDescriptorSet : public DeviceRef, NonCopyable
+{
+public:
+    static constexpr uint32_t SetId = 0;
+    // used by all layouts so they stay compatible, the shaders declare the part they use, the blocks are pushed with
+    // CommandBuffer::pushConstants and these stages
+    static const VkPushConstantRange PushConstantRange;
+
+    // matches the Frame uniform block of the shaders
+    struct Parameter
+    {
+        glm::mat4x4 mvp;
+        glm::vec4 cameraPosition;
+        float pixelsPerRadians = 0.f;
+        float time = 0.f;
+        uint32_t frameIndex = 0;
+    };
+
+    FrameDescriptorSet(const Device& device, const FrameRingBuffer& ringBuffer);
+    ~FrameDescriptorSet();
+
+    // after FrameRingBuffer::beginFrame, the previous parameters may still be read by pending frames
+    void update(FrameRingBuffer& ringBuffer, const Parameter& parameter);
+    // secondary command buffers do not inherit it, each one binds it again
+    void bind(VkCommandBuffer commandBuffer) const;
+
+    VkDescriptorSetLayout layout() const { return m_layout; }
+    // the frame set followed by the given sets, destroyed by the caller
+    VkPipelineLayout createPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts = {}) const;
+
+private:
+    DescriptorAllocator m_descriptorAllocator;
+    VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    DescriptorSet m_descriptorSet;
+    uint32_t m_offset = 0;
+};
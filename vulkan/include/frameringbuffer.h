@@ -0,0 +1,64 @@
+#pragma once
+
+#include "buffer.h"
+#include "deviceref.h"
+#include "noncopyable.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Linear allocator for transient per frame data (uniforms, gui geometry, ...) inside one persistently mapped buffer.
+// Memory written during a frame is recycled when beginFrame is called for the same frame resource again,
+// which has to happen after the frameCompleteFence of that frame resource has been waited on.
+class FrameRingBuffer : public DeviceRef, NonCopyable
+{
+public:
+    using StorageBuffer = Buffer<BufferUsage::AttributeBit | BufferUsage::IndexBit | BufferUsage::UniformBit | BufferUsage::StorageBit, MemoryType::CpuVisible>;
+
+    struct Allocation
+    {
+        void* data = nullptr;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        uint32_t offset = 0;
+        VkDeviceSize size = 0;
+
+        bool isValid() const { return data != nullptr; }
+    };
+
+    FrameRingBuffer() = default;
+    FrameRingBuffer(const Device& device, VkDeviceSize size, uint32_t frameCount);
+
+    FrameRingBuffer(FrameRingBuffer&& other);
+    FrameRingBuffer& operator=(FrameRingBuffer&& other);
+
+    void beginFrame(uint32_t frameId);
+
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+    Allocation allocateUniform(VkDeviceSize size);
+    Allocation allocateStorage(VkDeviceSize size);
+
+    template<typename T>
+    Allocation pushUniform(const T& data)
+    {
+        const auto allocation = allocateUniform(sizeof(T));
+        if (allocation.isValid())
+            *static_cast<T*>(allocation.data) = data;
+        return allocation;
+    }
+
+    VkBuffer buffer() const { return m_buffer.buffer(); }
+    VkDeviceSize size() const { return m_buffer.size(); }
+    VkDeviceSize usedBytes() const { return m_head - m_tail; }
+
+private:
+    void swap(FrameRingBuffer& other);
+
+    StorageBuffer m_buffer;
+    uint8_t* m_data = nullptr;
+
+    // monotonically increasing byte positions, the physical offset is position % size
+    VkDeviceSize m_head = 0;
+    VkDeviceSize m_tail = 0;
+    std::vector<VkDeviceSize> m_frameEnds;
+    uint32_t m_currentFrame = 0;
+};
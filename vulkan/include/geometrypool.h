@@ -0,0 +1,115 @@
+#pragma once
+
+#include "buffer.h"
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "tlsfallocator.h"
+#include "vertexbuffer.h"
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+// Places vertex and index ranges into pages of fixed capacity, tries the existing pages first and only adds
+// a page when none of them has room. It does not own memory, GeometryPool creates a buffer per page.
+class GeometryPageAllocator
+{
+public:
+    static constexpr uint32_t InvalidPage = UINT32_MAX;
+
+    struct Range
+    {
+        uint32_t page = InvalidPage;
+        // counted in vertices and indices
+        TlsfAllocator::Allocation vertices;
+        TlsfAllocator::Allocation indices;
+
+        bool isValid() const { return page != InvalidPage; }
+    };
+
+    GeometryPageAllocator(uint32_t verticesPerPage, uint32_t indicesPerPage);
+
+    // requests bigger than a page get a page of their own
+    Range allocate(uint32_t vertexCount, uint32_t indexCount);
+    void free(const Range& range);
+    // drops the page added by the last allocate, if its memory could not be created
+    void removeLastPage();
+
+    uint32_t pageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+    uint64_t vertexCapacity(uint32_t page) const { return m_pages[page].vertexAllocator.size(); }
+    uint64_t indexCapacity(uint32_t page) const { return m_pages[page].indexAllocator.size(); }
+
+private:
+    struct Page
+    {
+        TlsfAllocator vertexAllocator;
+        TlsfAllocator indexAllocator;
+    };
+
+    bool tryAllocate(Page& page, uint32_t vertexCount, uint32_t indexCount, Range& range) const;
+
+    uint32_t m_verticesPerPage = 0;
+    uint32_t m_indicesPerPage = 0;
+    std::vector<Page> m_pages;
+};
+
+// Sub-allocates the interleaved vertices and 32 bit indices of many meshes from a few large buffers.
+// All meshes of a pool share one vertex layout, so drawing them only needs a bind per page
+// and vkCmdDrawIndexed with the vertexOffset and firstIndex of each allocation.
+class GeometryPool : public DeviceRef, NonCopyable
+{
+public:
+    static constexpr uint32_t InvalidPage = GeometryPageAllocator::InvalidPage;
+
+    struct Allocation
+    {
+        uint32_t page = InvalidPage;
+        int32_t vertexOffset = 0;
+        uint32_t firstIndex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        TlsfAllocator::Handle vertexHandle = TlsfAllocator::InvalidHandle;
+        TlsfAllocator::Handle indexHandle = TlsfAllocator::InvalidHandle;
+
+        bool isValid() const { return page != InvalidPage; }
+    };
+
+    // capacities of a page, meshes which are bigger get a page of their own
+    GeometryPool(const Device& device, uint32_t vertexSize, const std::vector<VertexBuffer::InterleavedAttributeDescription>& descriptions,
+        uint32_t verticesPerPage = 1024 * 1024, uint32_t indicesPerPage = 3 * 1024 * 1024);
+    ~GeometryPool();
+
+    bool isCompatible(uint32_t vertexSize, const std::vector<VertexBuffer::InterleavedAttributeDescription>& descriptions) const;
+
+    Allocation allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+    // the vertices are produced straight into the staging memory, offsets are bytes relative to the first vertex
+    Allocation allocate(const BufferBase::WriteFunc& writeVertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+    // the ranges are reused right away, so they must not be referenced by pending command buffers anymore
+    void free(Allocation& allocation);
+
+    void bind(VkCommandBuffer commandBuffer, uint32_t page) const;
+    // firstIndex is relative to the allocation, indexCount 0 draws all its indices
+    void drawIndexed(VkCommandBuffer commandBuffer, const Allocation& allocation, uint32_t firstIndex = 0, uint32_t indexCount = 0, uint32_t instanceCount = 1) const;
+
+    const std::vector<VkVertexInputBindingDescription>& getBindingDescriptions() const { return m_bindingDescriptions; }
+    const std::vector<VkVertexInputAttributeDescription>& getAttributeDescriptions() const { return m_attributesDescriptions; }
+
+    uint32_t pageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+
+private:
+    struct Page
+    {
+        GPUGeometryBuffer buffer;
+        // indices live behind the vertices in the same buffer
+        VkDeviceSize indexOffset = 0;
+    };
+
+    std::unique_ptr<Page> createPage(uint64_t vertexCapacity, uint64_t indexCapacity) const;
+
+    uint32_t m_vertexSize = 0;
+    std::vector<VertexBuffer::InterleavedAttributeDescription> m_descriptions;
+    std::vector<VkVertexInputAttributeDescription> m_attributesDescriptions;
+    std::vector<VkVertexInputBindingDescription> m_bindingDescriptions;
+    GeometryPageAllocator m_pageAllocator;
+    std::vector<std::unique_ptr<Page>> m_pages;
+};
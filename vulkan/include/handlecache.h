@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Reference counted handles deduplicated by their create info. The creator writes everything the create info
+// consists of into the key, looks it up first and only creates and adds a handle when there is none. Lookups hash
+// the key and compare it as a whole, so handles are only shared for equal create infos. Every acquire, add or
+// addReference has to be matched by a release.
+template<typename Handle>
+class HandleCache
+{
+public:
+    using Key = std::vector<uint64_t>;
+
+    // adds a reference to the handle created for the key, a null handle if there is none yet
+    Handle acquire(const Key& key)
+    {
+        const auto iter = m_handles.find(key);
+        if (iter == m_handles.end())
+            return Handle{};
+
+        m_entries.at(iter->second).refCount++;
+        return iter->second;
+    }
+
+    // the handle starts with one reference
+    void add(const Key& key, Handle handle)
+    {
+        assert(m_handles.count(key) == 0);
+        const auto iter = m_handles.emplace(key, handle).first;
+        m_entries[handle] = { &iter->first, 1 };
+    }
+
+    // for handles which are used by other cached handles, false if the handle is not in the cache
+    bool addReference(Handle handle)
+    {
+        const auto iter = m_entries.find(handle);
+        if (iter == m_entries.end())
+            return false;
+
+        iter->second.refCount++;
+        return true;
+    }
+
+    // returns true when the last reference was dropped and the handle has to be destroyed
+    bool release(Handle handle)
+    {
+        const auto iter = m_entries.find(handle);
+        assert(iter != m_entries.end());
+
+        if (--iter->second.refCount > 0)
+            return false;
+
+        m_handles.erase(*iter->second.key);
+        m_entries.erase(iter);
+        return true;
+    }
+
+    size_t size() const { return m_entries.size(); }
+
+    // empties the cache, returns the handles which were not released
+    std::vector<Handle> takeAll()
+    {
+        std::vector<Handle> handles;
+        for (const auto& entry : m_entries)
+            handles.push_back(entry.first);
+
+        m_entries.clear();
+        m_handles.clear();
+        return handles;
+    }
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t h = key.size();
+            for (auto value : key)
+                h ^= std::hash<uint64_t>()(value) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    struct Entry
+    {
+        // points into m_handles, whose nodes do not move
+        const Key* key;
+        size_t refCount;
+    };
+
+    std::unordered_map<Key, Handle, KeyHash> m_handles;
+    std::unordered_map<Handle, Entry> m_entries;
+};
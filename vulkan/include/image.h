@@ -47,6 +47,12 @@ public:
     {
     }
 
+    template<typename = void>
+    Image(const Device& device, const WriteFunc& writeFunc, VkExtent2D resolution, VkFormat format)
+        : ImageBase(device, writeFunc, resolution, format, VkImageUsageFlagBits(Usage))
+    {
+    }
+
     template<ImageUsage U, MemoryType M>
     Image(Image<U, M>&& other)
     {
@@ -2,14 +2,20 @@
 
 #include "deviceref.h"
 #include "noncopyable.h"
+#include "memoryallocator.h"
 
 #include <vulkan/vulkan.h>
+#include <functional>
 
+class CommandBuffer;
 class Device;
 
 class ImageBase : public DeviceRef, NonCopyable
 {
 public:
+    // fills [offset, offset + size) of the tightly packed pixel data, which may be uploaded in several chunks
+    using WriteFunc = std::function<void(void* destination, uint64_t offset, uint64_t size)>;
+
     ~ImageBase();
 
     VkImage image() const;
@@ -17,11 +23,14 @@ public:
     VkDeviceMemory memory() const;
     VkFormat format() const;
     VkExtent2D resolution() const;
+    MemoryCategory memoryCategory() const;
 
     bool transpareny() const;
     void setTranspareny(bool);
 
+    // the transition is queued into the pending upload batch and executed before the next frame is submitted
     void setLayout(VkImageLayout layout);
+    void setLayout(VkImageLayout layout, CommandBuffer& commandBuffer);
 
     operator bool() const;
     bool operator==(const ImageBase& rhs) const;
@@ -29,6 +38,7 @@ public:
 protected:
     ImageBase() = default;
     ImageBase(const Device& device, uint8_t* pixelData, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage);
+    ImageBase(const Device& device, const WriteFunc& writeFunc, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage);
     ImageBase(const Device& device, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage);
 
     void swap(ImageBase& other);
@@ -36,7 +46,7 @@ protected:
 private:
     VkImage m_image = VK_NULL_HANDLE;
     VkImageView m_imageView = VK_NULL_HANDLE;
-    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    MemoryAllocation m_allocation;
     VkImageLayout m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
     VkFormat m_format = VK_FORMAT_UNDEFINED;
     bool m_hasTransparency = false;
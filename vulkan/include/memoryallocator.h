@@ -0,0 +1,130 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "tlsfallocator.h"
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Device;
+struct MemoryBlock;
+
+enum class MemoryCategory
+{
+    Geometry,
+    Texture,
+    RenderTarget,
+    Staging,
+    Uniform,
+    Count
+};
+
+const char* memoryCategoryName(MemoryCategory category);
+
+struct MemoryAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mappedData = nullptr;
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    bool isCoherent = true;
+    MemoryCategory category = MemoryCategory::Geometry;
+
+    // nullptr for dedicated allocations
+    MemoryBlock* block = nullptr;
+    TlsfAllocator::Handle handle = TlsfAllocator::InvalidHandle;
+
+    bool isValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+struct MemoryAllocatorStats
+{
+    uint32_t blockCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize reservedBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+
+    // bytes written straight into device local host visible memory vs. through a staging copy
+    VkDeviceSize directUploadBytes = 0;
+    VkDeviceSize stagedUploadBytes = 0;
+
+    // 0 when all free memory is one contiguous range, approaches 1 when it is scattered
+    float fragmentation = 0.0f;
+};
+
+struct MemoryStats
+{
+    struct Heap
+    {
+        VkDeviceSize size = 0;
+        // budget and usage of the whole process as reported by VK_EXT_memory_budget,
+        // without the extension the heap size and the bytes allocated by this library
+        VkDeviceSize budget = 0;
+        VkDeviceSize usage = 0;
+        VkDeviceSize allocatedBytes = 0;
+        bool deviceLocal = false;
+    };
+
+    struct Category
+    {
+        VkDeviceSize bytes = 0;
+        uint32_t allocationCount = 0;
+    };
+
+    std::vector<Heap> heaps;
+    std::array<Category, static_cast<size_t>(MemoryCategory::Count)> categories = {};
+    bool hasBudget = false;
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, one block list per memory type.
+// Linear (buffers) and optimal (images) resources never share a block to respect bufferImageGranularity.
+class MemoryAllocator : public DeviceRef, NonCopyable
+{
+public:
+    explicit MemoryAllocator(const Device& device);
+    ~MemoryAllocator();
+
+    // preferred properties are only granted while the heap of the better type has budget left
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category, bool linearResource, VkMemoryPropertyFlags preferredProperties = 0);
+    void free(const MemoryAllocation& allocation);
+
+    void recordUpload(VkDeviceSize size, bool direct);
+
+    // offset and size are relative to the allocation, no-ops for host coherent memory
+    void flush(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+    void invalidate(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+    MemoryAllocatorStats stats() const;
+    MemoryStats memoryStats() const;
+
+private:
+    uint32_t findMemoryType(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties) const;
+    MemoryAllocation allocateFromBlocks(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linearResource);
+    MemoryAllocation allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex);
+    MemoryBlock* createBlock(uint32_t memoryTypeIndex, bool linearResource);
+    void destroyBlock(MemoryBlock& block);
+    void* mapMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) const;
+    bool isNonCoherent(uint32_t memoryTypeIndex) const;
+    VkMappedMemoryRange mappedMemoryRange(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+    std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_blockSizes = {};
+    std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_heapUsage = {};
+    std::array<MemoryStats::Category, static_cast<size_t>(MemoryCategory::Count)> m_categoryStats = {};
+    std::array<std::vector<std::unique_ptr<MemoryBlock>>, VK_MAX_MEMORY_TYPES> m_blocks;
+
+    uint32_t m_dedicatedAllocationCount = 0;
+    VkDeviceSize m_dedicatedAllocationBytes = 0;
+    VkDeviceSize m_directUploadBytes = 0;
+    VkDeviceSize m_stagedUploadBytes = 0;
+
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "types.h"
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CommandBuffer;
+
+// Splits the draws of a render pass across worker threads. Every thread records its range into a secondary
+// command buffer allocated from its own per thread and frame command pool of the Device, the primary
+// command buffer executes them in thread order. The calling thread records the first range itself.
+class ParallelRecorder : public DeviceRef, NonCopyable
+{
+public:
+    // records the draws [begin, end) of the split list
+    using RecordFunc = std::function<void(CommandBuffer& commandBuffer, uint32_t begin, uint32_t end)>;
+
+    // Device::createThreadCommandPools has to be called with at least the same counts before
+    ParallelRecorder(const Device& device, uint32_t threadCount, uint32_t frameCount);
+    ~ParallelRecorder();
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(m_threadData.size()); }
+
+    // resets the command pools of the frame resource to reuse its secondary command buffers, so its fence has to be waited on before
+    void beginFrame(uint32_t frameId);
+
+    // begins the render pass with secondary contents, only record calls are allowed until endRenderPass
+    void beginRenderPass(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+        const VkClearColorValue* clearColor = nullptr);
+    void endRenderPass();
+    bool isRecording() const { return m_commandBuffer != nullptr; }
+
+    // blocks until all threads have recorded their part and executes the secondary command buffers
+    void record(uint32_t drawCount, const RecordFunc& recordFunc);
+    // a single secondary command buffer recorded on the calling thread, for work which is not worth splitting
+    void recordOnCallingThread(const std::function<void(CommandBuffer&)>& recordFunc);
+
+private:
+    struct ThreadData
+    {
+        // per frame resource, grows with the number of record calls in a frame
+        std::vector<std::vector<CommandBufferPtr>> commandBuffers;
+        uint32_t usedCount = 0;
+    };
+
+    CommandBuffer& nextCommandBuffer(uint32_t threadId);
+    void recordRange(uint32_t threadId);
+    void workerLoop(uint32_t threadId);
+
+    std::vector<ThreadData> m_threadData;
+    std::vector<std::thread> m_workers;
+
+    CommandBuffer* m_commandBuffer = nullptr;
+    uint32_t m_frameId = 0;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VkFramebuffer m_framebuffer = VK_NULL_HANDLE;
+    VkExtent2D m_extent = { 0, 0 };
+
+    // current job, workers pick it up when the generation changes
+    std::mutex m_mutex;
+    std::condition_variable m_jobCondition;
+    std::condition_variable m_doneCondition;
+    const RecordFunc* m_recordFunc = nullptr;
+    uint32_t m_drawCount = 0;
+    uint64_t m_generation = 0;
+    uint32_t m_pendingWorkers = 0;
+    bool m_shutdown = false;
+    std::vector<VkCommandBuffer> m_recordedCommandBuffers;
+};
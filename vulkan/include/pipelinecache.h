@@ -0,0 +1,40 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// Keeps the pipelines compiled by the driver across runs. The cache starts with the data of the file if the file was
+// written for the same device and driver, and is written back when it is destroyed. The time spent in pipeline
+// creation is summed up, so the gain of a warm cache can be compared at startup.
+class PipelineCache : public DeviceRef, NonCopyable
+{
+public:
+    PipelineCache(const Device& device, const std::string& filename);
+    ~PipelineCache();
+
+    operator VkPipelineCache() const { return m_pipelineCache; }
+
+    // writes a temporary file first and renames it, so an interrupted save keeps the previous file
+    bool save() const;
+
+    // the cache was created with the data of the file
+    bool isWarm() const { return m_warm; }
+
+    void addCreationTime(uint64_t microseconds);
+    uint32_t createdPipelineCount() const { return m_createdPipelineCount; }
+    uint64_t creationTimeInMicroseconds() const { return m_creationTimeInMicroseconds; }
+
+    // checks the header the driver puts in front of the data against the device
+    static bool isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties);
+
+private:
+    std::string m_filename;
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    bool m_warm = false;
+    uint32_t m_createdPipelineCount = 0;
+    uint64_t m_creationTimeInMicroseconds = 0;
+};
@@ -17,6 +17,8 @@ public:
     void end(VkCommandBuffer commandBuffer) const;
 
     std::chrono::microseconds duration() const;
+    // raw ticks of both timestamps, comparable between the queues of the device. Does not wait for the results.
+    bool timestamps(uint64_t& begin, uint64_t& end) const;
 
 private:
     VkQueryPool m_queryPool = VK_NULL_HANDLE;
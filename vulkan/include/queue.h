@@ -1,9 +1,45 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <vector>
 
 class CommandBuffer;
 
+// Collects command buffers with their wait and signal semaphores into one or more VkSubmitInfos,
+// which go to the queue with a single vkQueueSubmit. Values are only used by timeline semaphores,
+// null semaphores are skipped so optional dependencies need no special casing.
+class QueueSubmission
+{
+public:
+    QueueSubmission& addWait(VkSemaphore semaphore, VkPipelineStageFlags waitStages, uint64_t value = 0);
+    QueueSubmission& addCommandBuffer(VkCommandBuffer commandBuffer);
+    QueueSubmission& addSignal(VkSemaphore semaphore, uint64_t value = 0);
+
+    // following waits, command buffers and signals go into a new VkSubmitInfo
+    QueueSubmission& nextSubmit();
+
+    bool empty() const { return m_submits.empty(); }
+    void clear() { m_submits.clear(); }
+
+private:
+    friend class Queue;
+
+    struct Submit
+    {
+        std::vector<VkSemaphore> waitSemaphores;
+        std::vector<VkPipelineStageFlags> waitStages;
+        std::vector<uint64_t> waitValues;
+        std::vector<VkCommandBuffer> commandBuffers;
+        std::vector<VkSemaphore> signalSemaphores;
+        std::vector<uint64_t> signalValues;
+        bool hasTimelineValues = false;
+    };
+
+    Submit& currentSubmit();
+
+    std::vector<Submit> m_submits;
+};
+
 class Queue
 {
     friend class Device;
@@ -15,7 +51,11 @@ public:
         VkFence submitFence = VK_NULL_HANDLE,
         VkPipelineStageFlags waitStages = 0) const;
 
+    void submit(const QueueSubmission& submission, VkFence submitFence = VK_NULL_HANDLE) const;
+
+    // waits on a fence of the queue, other work on the queue keeps running
     void submitBlocking(CommandBuffer& commandBuffer) const;
+    void submitBlocking(const QueueSubmission& submission) const;
 
     uint32_t familyId() const { return m_queueFamilyIndex; }
     operator VkQueue() const { return m_queue; }
@@ -25,4 +65,6 @@ private:
 
     VkQueue m_queue = VK_NULL_HANDLE;
     uint32_t m_queueFamilyIndex = UINT32_MAX;
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkFence m_blockingFence = VK_NULL_HANDLE;
 };
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "memoryallocator.h"
+#include "imageview.h"
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class CommandBuffer;
+struct RenderPassAttachmentDescription;
+
+// Chain of render passes which declare the images they render into and the images they sample.
+// compile() culls the passes not contributing to an output, places all images into one allocation in which
+// images with disjoint lifetimes alias, creates render passes and framebuffers and derives the barriers between
+// the passes. The compiled graph is executed every frame and has to be declared again when it changes, e.g. on resize.
+class RenderGraph : public DeviceRef, NonCopyable
+{
+public:
+    using ResourceId = uint32_t;
+    static constexpr ResourceId InvalidResource = UINT32_MAX;
+
+    struct ImageDescription
+    {
+        VkExtent2D extent = { 0, 0 };
+        VkFormat format = VK_FORMAT_UNDEFINED;
+    };
+
+    class PassBuilder
+    {
+    public:
+        // a new image the pass renders into, all images written by a pass need the same extent
+        ResourceId write(const std::string& name, const ImageDescription& description);
+        // sampled in the fragment shader
+        void read(ResourceId resource);
+        // clears the color attachments with the color and depth to 1, the contents are undefined otherwise
+        void setClearColor(const VkClearColorValue& clearColor);
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t passId);
+
+        RenderGraph& m_graph;
+        uint32_t m_passId;
+    };
+
+    using SetupFunc = std::function<void(PassBuilder&)>;
+    // records the draws, the render pass is begun and ended by the graph
+    using ExecuteFunc = std::function<void(CommandBuffer&, const RenderGraph&)>;
+
+    struct Stats
+    {
+        uint32_t passCount = 0;
+        uint32_t culledPassCount = 0;
+        uint32_t imageCount = 0;
+        uint32_t barrierCount = 0;
+        VkDeviceSize memorySize = 0;
+        // what the images would need without aliasing
+        VkDeviceSize unaliasedMemorySize = 0;
+    };
+
+    // lifetime in compiled passes, both ends inclusive
+    struct TransientLifetime
+    {
+        VkDeviceSize size = 0;
+        VkDeviceSize alignment = 1;
+        uint32_t firstPass = 0;
+        uint32_t lastPass = 0;
+    };
+
+    explicit RenderGraph(const Device& device);
+    ~RenderGraph();
+
+    // drops the declared passes and the compiled images, frames using them must have finished
+    void reset();
+
+    // setup is called right away to declare the resources of the pass
+    void addPass(const std::string& name, const SetupFunc& setup, const ExecuteFunc& execute);
+    // the image is used after execute, it is left in the shader read only layout for sampling in the fragment shader
+    void addOutput(ResourceId resource);
+
+    bool compile();
+    bool isCompiled() const { return m_compiled; }
+    void execute(CommandBuffer& commandBuffer) const;
+
+    // VK_NULL_HANDLE for images of culled passes
+    VkImageView imageView(ResourceId resource) const;
+    // compatible with the render passes of all passes writing images of these formats, for pipeline creation
+    VkRenderPass renderPass(const std::vector<VkFormat>& formats);
+
+    const Stats& stats() const { return m_stats; }
+
+    // places the resources so that the ones alive at the same time do not overlap, returns the size of the memory they need
+    static VkDeviceSize placeTransientResources(const std::vector<TransientLifetime>& lifetimes, std::vector<VkDeviceSize>& offsets);
+
+private:
+    struct Resource
+    {
+        std::string name;
+        ImageDescription description;
+        uint32_t writer = 0;
+        bool isOutput = false;
+
+        // read by a pass which was not culled or an output
+        bool isSampled = false;
+        VkImage image = VK_NULL_HANDLE;
+        ImageView imageView;
+        VkDeviceSize memoryOffset = 0;
+        VkDeviceSize memorySize = 0;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<ResourceId> reads;
+        std::vector<ResourceId> writes;
+        bool clear = false;
+        VkClearColorValue clearColor = {};
+        ExecuteFunc execute;
+    };
+
+    struct Barriers
+    {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+
+        void add(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage);
+        void record(CommandBuffer& commandBuffer) const;
+    };
+
+    struct CompiledPass
+    {
+        uint32_t passId = 0;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent = { 0, 0 };
+        // executed in front of the render pass
+        Barriers barriers;
+    };
+
+    std::vector<bool> findLivePasses() const;
+    bool createImages(const std::vector<uint32_t>& firstUse, const std::vector<uint32_t>& lastUse);
+    void createBarriers();
+    VkRenderPass acquireRenderPass(const std::vector<RenderPassAttachmentDescription>& attachments);
+    void destroyCompiledResources();
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<CompiledPass> m_compiledPasses;
+    // brings the outputs into the shader read only layout
+    Barriers m_outputBarriers;
+    MemoryAllocation m_allocation;
+    bool m_compiled = false;
+    Stats m_stats;
+
+    // kept across reset, pipelines are created with them
+    std::map<std::vector<uint64_t>, VkRenderPass> m_renderPasses;
+};
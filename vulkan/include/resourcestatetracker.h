@@ -0,0 +1,65 @@
+#pragma once
+
+#include "barrier.h"
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Remembers the last access of every buffer and image subresource used in a command buffer and derives the barriers
+// the next access needs. Reads after reads and accesses already made visible need none, the stages of a barrier only
+// cover the previous and the next access. Barriers collect until they are taken, so all accesses declared in front
+// of a draw or dispatch end up in a single barrier command.
+class ResourceStateTracker
+{
+public:
+    struct Barrier
+    {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkAccessFlags srcAccess = 0;
+        VkAccessFlags dstAccess = 0;
+
+        // either a whole buffer or an image subresource range
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageSubresourceRange range = {};
+    };
+
+    void bufferAccess(VkBuffer buffer, const ResourceAccess& access);
+    // currentLayout is the layout the image has before its first use in the command buffer
+    void imageAccess(VkImage image, const VkImageSubresourceRange& range, VkImageLayout currentLayout, const ResourceAccess& access);
+
+    bool hasPendingBarriers() const { return !m_pendingBufferBarriers.empty() || !m_pendingImageBarriers.empty(); }
+    // adjacent layers and mips sharing the same transition are merged into one barrier
+    std::vector<Barrier> takePendingBarriers();
+
+    // forgets all states, for reusing the command buffer
+    void reset();
+
+private:
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        // reads since the last write which already waited on it
+        VkPipelineStageFlags readStages = 0;
+        VkAccessFlags readAccess = 0;
+    };
+
+    // image, mip level, array layer
+    using SubresourceKey = std::tuple<VkImage, uint32_t, uint32_t>;
+
+    // updates the state, returns false if the access needs no barrier
+    static bool updateState(State& state, const ResourceAccess& access, bool isImage, Barrier& barrier);
+    static void mergePending(Barrier& pending, const Barrier& barrier);
+
+    std::map<VkBuffer, State> m_bufferStates;
+    std::map<SubresourceKey, State> m_imageStates;
+    std::map<VkBuffer, Barrier> m_pendingBufferBarriers;
+    std::map<SubresourceKey, Barrier> m_pendingImageBarriers;
+};
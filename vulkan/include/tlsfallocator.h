@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Two level segregated fit allocator managing offsets inside a single range.
+// It does not own any memory itself, it only hands out [offset, offset + size) ranges.
+class TlsfAllocator
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle InvalidHandle = UINT32_MAX;
+    static constexpr uint64_t MinAlignment = 16;
+
+    struct Allocation
+    {
+        Handle handle = InvalidHandle;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t usedBytes = 0;
+        uint64_t freeBytes = 0;
+        uint64_t largestFreeRange = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRangeCount = 0;
+    };
+
+    TlsfAllocator() = default;
+    explicit TlsfAllocator(uint64_t size);
+
+    Allocation allocate(uint64_t size, uint64_t alignment);
+    void free(Handle handle);
+
+    uint64_t size() const { return m_size; }
+    uint32_t allocationCount() const { return m_allocationCount; }
+    bool empty() const { return m_allocationCount == 0; }
+
+    Stats stats() const;
+
+private:
+    static constexpr uint32_t SecondLevelLog2 = 4;
+    static constexpr uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+    static constexpr uint32_t FirstLevelCount = 64 - SecondLevelLog2 + 1;
+
+    struct Node
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        Handle prevPhysical = InvalidHandle;
+        Handle nextPhysical = InvalidHandle;
+        Handle prevFree = InvalidHandle;
+        Handle nextFree = InvalidHandle;
+        bool isFree = false;
+    };
+
+    static void mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+    Handle createNode(uint64_t offset, uint64_t size);
+    void releaseNode(Handle handle);
+    Handle findFreeNode(uint64_t size) const;
+    Handle split(Handle handle, uint64_t size);
+    void insertFreeNode(Handle handle);
+    void removeFreeNode(Handle handle);
+
+    uint64_t m_size = 0;
+    uint32_t m_allocationCount = 0;
+    uint64_t m_firstLevelBitmap = 0;
+    std::array<uint32_t, FirstLevelCount> m_secondLevelBitmaps = {};
+    std::array<std::array<Handle, SecondLevelCount>, FirstLevelCount> m_freeLists;
+    std::vector<Node> m_nodes;
+    std::vector<Handle> m_unusedNodes;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "buffer.h"
+#include "deviceref.h"
+#include "noncopyable.h"
+#include "types.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Records staging copies and image layout transitions into batches, which are submitted without blocking.
+// All data goes through one persistently mapped staging ring, uploads larger than a chunk are split up
+// and the ring space of a batch is reused once its fence is signaled, so staging memory stays bounded.
+// With a dedicated transfer queue family the ownership of the destination is released on the transfer queue
+// and acquired on the queue of the family which uses the data, so later submissions see it without a cpu wait.
+// With timeline semaphores the batch ids are signaled as values, otherwise every batch gets a fence and semaphore.
+// Batches are recorded from the graphics command pool and submitted to the graphics queue (also the copies without a
+// dedicated transfer family), which frame recording uses unguarded, so uploads have to come from the render thread.
+class UploadManager : public DeviceRef, NonCopyable
+{
+public:
+    // id of the batch an upload was recorded into, 0 for uploads which are already visible
+    using Handle = uint64_t;
+
+    static constexpr VkDeviceSize DefaultStagingBufferSize = 64ull * 1024 * 1024;
+
+    explicit UploadManager(const Device& device, VkDeviceSize stagingBufferSize = DefaultStagingBufferSize);
+    ~UploadManager();
+
+    // called once per chunk with the mapped staging memory and the range of the chunk inside the upload
+    using WriteFunc = BufferBase::WriteFunc;
+
+    // the data is copied into the staging ring before returning, may wait for older batches when the ring is full
+    // the destination ends up owned by dstQueueFamilyId, the graphics or compute family, VK_QUEUE_FAMILY_IGNORED means graphics
+    Handle uploadBuffer(const void* data, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset = 0,
+        uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED);
+    Handle uploadImage(const void* pixelData, VkImage image, VkFormat format, VkExtent2D resolution, VkImageLayout finalLayout,
+        uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED);
+
+    // the data is produced straight into the staging ring, so it never needs to exist as a whole in cpu memory
+    Handle uploadBuffer(const WriteFunc& writeFunc, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset = 0,
+        uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED);
+    Handle uploadImage(const WriteFunc& writeFunc, VkImage image, VkFormat format, VkExtent2D resolution, VkImageLayout finalLayout,
+        uint32_t dstQueueFamilyId = VK_QUEUE_FAMILY_IGNORED);
+
+    // deferred transition, all transitions of a batch end up in a single barrier on the graphics queue
+    Handle transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+    // submits the batch which is currently recorded, has to happen before the uploaded data is used
+    Handle flush();
+
+    bool isComplete(Handle handle);
+    void wait(Handle handle);
+    void waitIdle();
+
+    // waits for all pending uploads before the ring is replaced
+    void setStagingBufferSize(VkDeviceSize size);
+    VkDeviceSize stagingBufferSize() const { return m_stagingBuffer.size(); }
+
+private:
+    struct BufferCopy
+    {
+        VkDeviceSize stagingOffset;
+        VkBuffer destination;
+        VkDeviceSize destinationOffset;
+        VkDeviceSize size;
+    };
+
+    struct ImageCopy
+    {
+        VkDeviceSize stagingOffset;
+        VkImage destination;
+        VkOffset2D offset;
+        VkExtent2D extent;
+    };
+
+    // commands are only recorded on submission, so every group of barriers needs a single vkCmdPipelineBarrier
+    struct Batch
+    {
+        Handle id = 0;
+        CommandBufferPtr transferCommandBuffer;
+        CommandBufferPtr acquireCommandBuffer;
+        // only for uploads used by a compute family other than the graphics one
+        CommandBufferPtr computeAcquireCommandBuffer;
+        VkSemaphore computeSemaphore = VK_NULL_HANDLE;
+        // only without timeline semaphores
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        std::vector<BufferCopy> bufferCopies;
+        std::vector<ImageCopy> imageCopies;
+        std::vector<VkImageMemoryBarrier> copyBarriers;
+        // the destination family of the ownership transfer is already set
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::vector<VkImageMemoryBarrier> layoutTransitions;
+        VkDeviceSize stagedBytes = 0;
+        // ring position up to which the staging memory is in use by this batch
+        VkDeviceSize stagingEnd = 0;
+    };
+
+    VkDeviceSize maxChunkSize() const { return m_stagingBuffer.size() / 4; }
+    // returns the offset inside the staging ring
+    VkDeviceSize allocateStaging(const WriteFunc& writeFunc, VkDeviceSize uploadOffset, VkDeviceSize size);
+
+    // family of the queue which records the copies
+    uint32_t copyQueueFamilyId() const;
+    uint32_t consumerQueueFamilyId(uint32_t dstQueueFamilyId) const;
+    bool isRenderThread() const { return std::this_thread::get_id() == m_renderThread; }
+
+    Batch& recordingBatch();
+    Handle finishRecording(Batch& batch);
+    void recordCopies(Batch& batch);
+    void submit(Batch& batch);
+    bool isBatchComplete(const Batch& batch) const;
+    void waitForBatch(const Batch& batch) const;
+    void retireCompletedBatches();
+    void destroyBatch(Batch& batch);
+
+    StagingBuffer m_stagingBuffer;
+    uint8_t* m_stagingData = nullptr;
+    // monotonically increasing byte positions, the physical offset is position % size
+    VkDeviceSize m_stagingHead = 0;
+    VkDeviceSize m_stagingTail = 0;
+
+    std::unique_ptr<Batch> m_recordingBatch;
+    std::deque<std::unique_ptr<Batch>> m_submittedBatches;
+    Handle m_nextBatchId = 1;
+    Handle m_completedBatchId = 0;
+    bool m_hasDedicatedTransferQueue = false;
+
+    // reach the id of a batch when its copies are done on the transfer queue and when the whole batch is done
+    VkSemaphore m_transferTimeline = VK_NULL_HANDLE;
+    VkSemaphore m_completionTimeline = VK_NULL_HANDLE;
+
+    // the thread which created the device and submits the frames
+    std::thread::id m_renderThread;
+};
@@ -44,14 +44,17 @@ public:
         uint32_t interleavedOffset = 0;
     };
 
-    VertexBuffer(Device& device);
+    // vertex buffers which are written by compute shaders pass BufferSource::Gpu
+    VertexBuffer(Device& device, BufferSource source = BufferSource::Cpu);
     ~VertexBuffer();
 
-    void createFromSeparateAttributes(const std::vector<AttributeDescription>& descriptions);
-    void createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, float* attributeData, const std::vector<InterleavedAttributeDescription>& descriptions);
+    static VkFormat attributeFormat(uint32_t componentCount);
 
-    void setIndices(const uint16_t *indices, uint32_t numIndices);
-    void setIndices(const uint32_t *indices, uint32_t numIndices);
+    // 32 bit indices passed here are stored behind the vertex streams in the same buffer and uploaded together with them
+    void createFromSeparateAttributes(const std::vector<AttributeDescription>& descriptions, const uint32_t* indices = nullptr, uint32_t numIndices = 0);
+    void createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, float* attributeData, const std::vector<InterleavedAttributeDescription>& descriptions, const uint32_t* indices = nullptr, uint32_t numIndices = 0);
+    // the vertices are produced straight into the staging memory, offsets are bytes relative to the first vertex
+    void createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, const BufferBase::WriteFunc& writeVertices, const std::vector<InterleavedAttributeDescription>& descriptions, const uint32_t* indices = nullptr, uint32_t numIndices = 0);
 
     void bind(VkCommandBuffer commandBuffer) const;
     void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1) const;
@@ -63,28 +66,19 @@ public:
     const uint32_t numVertices() const { return m_numVertices; }
     const uint32_t numIndices() const { return m_numIndices; }
 
-    operator VkBuffer() const { return m_vertexBuffer; }
+    operator VkBuffer() const { return m_buffer; }
 
 private:
-    void createIndexBuffer(const void *indices, uint32_t numIndices, VkIndexType indexType);
+    void createBuffer(VkDeviceSize vertexSize, const uint32_t* indices, uint32_t numIndices);
 
-    template<BufferUsage Usage, MemoryType Memory>
-    void fillBuffer(Buffer<Usage, Memory>& buffer, const BufferBase::FillFunc& memcpyFunc)
-    {
-        static_assert(!Buffer<Usage, Memory>::isCpuVisible);
-        // TODO: use single persistent staging buffer?
-        StagingBuffer stagingBuffer(device(), buffer.size());
-        stagingBuffer.fill(memcpyFunc);
-        device().copyBuffer(stagingBuffer, buffer, buffer.size());
-    }
-
-    GPUAttributeBuffer m_vertexBuffer;
-    GPUIndexBuffer m_indexBuffer;
-    VkIndexType m_indexType = VK_INDEX_TYPE_UINT16;
+    GPUGeometryBuffer m_buffer;
+    VkDeviceSize m_indexOffset = 0;
+    BufferSource m_source = BufferSource::Cpu;
 
     uint32_t m_numVertices = 0;
     uint32_t m_numIndices = 0;
     std::vector<VkVertexInputAttributeDescription> m_attributesDescriptions;
     std::vector<VkVertexInputBindingDescription> m_bindingDescriptions;
     std::vector<VkDeviceSize> m_bindingOffsets;
+    std::vector<VkBuffer> m_bindingBuffers;
 };
@@ -57,30 +57,58 @@ namespace
     }
 }
 
-VkPipelineStageFlags getPipelineStageFlags(VkAccessFlags access)
+ResourceAccess getLayoutAccess(VkImageLayout layout, VkPipelineStageFlags shaderStages)
 {
-    if (access & (VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT))
+    switch (layout)
     {
-        return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-    }
-    if (access & (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT))
-    {
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
-    }
-    if (access & (VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT))
-    {
-        return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    }
-    if ((access & ~(VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT)) == 0)
-    {
-        return VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    case VK_IMAGE_LAYOUT_UNDEFINED:
+        return { 0, 0, layout };
+
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+        return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+        return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+        return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+        return { shaderStages, VK_ACCESS_SHADER_READ_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+        return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+        return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, layout };
+
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+        // presentation is ordered by the semaphores of the present
+        return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, layout };
+
+    case VK_IMAGE_LAYOUT_GENERAL: // assume storage image
+        return { shaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, layout };
+
+    default:
+        break;
     }
 
-    assert(!"Unknown access flags.");
-    return 0;
+    assert(!"Unsupported layout.");
+    return { 0, 0, layout };
+}
+
+VkImageSubresourceRange createImageSubresourceRange(VkFormat imageFormat, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer, uint32_t layerCount)
+{
+    return { getImageAspect(imageFormat), baseMipLevel, levelCount, baseArrayLayer, layerCount };
 }
 
 VkImageMemoryBarrier createImageMemoryBarrier(VkImage image, VkFormat imageFormat, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    return createImageMemoryBarrier(image, createImageSubresourceRange(imageFormat), oldLayout, newLayout);
+}
+
+VkImageMemoryBarrier createImageMemoryBarrier(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout)
 {
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -89,13 +117,9 @@ VkImageMemoryBarrier createImageMemoryBarrier(VkImage image, VkFormat imageForma
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.image = image;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange = range;
     barrier.srcAccessMask = getLayoutAccessFlags(oldLayout);
     barrier.dstAccessMask = getLayoutAccessFlags(newLayout);
-    barrier.subresourceRange.aspectMask = getImageAspect(imageFormat);
 
     return barrier;
 }
@@ -5,12 +5,14 @@
 
 #include "../utils/arcball_camera.h"
 #include "../utils/flythrough_camera.h"
+#include "../utils/timer.h"
 
 #include <GLFW/glfw3.h>
 
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <thread>
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -48,17 +50,31 @@ bool BasicRenderer::init(GLFWwindow* window)
     m_swapchainRenderPass = m_device.createRenderPass(defaultAttachmentData);
     createSwapChainFramebuffers();
 
-    m_cameraUniformBuffer = UniformBuffer(m_device, sizeof(CameraParameter));
-    m_mappedCameraUniformBuffer = reinterpret_cast<CameraParameter*>(m_cameraUniformBuffer.map());
-
     const auto frameResourceCount = 2u;
 
     createFrameResources(frameResourceCount);
+    m_frameRingBuffer = FrameRingBuffer(m_device, 4 * 1024 * 1024, frameResourceCount);
+    m_frameDescriptorSet = std::make_unique<FrameDescriptorSet>(m_device, m_frameRingBuffer);
+    m_startTimeInMicroseconds = Timer::getMicroseconds();
+
+    const auto recordThreadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), 8u);
+    m_device.createThreadCommandPools(recordThreadCount, frameResourceCount);
+    m_parallelRecorder = std::make_unique<ParallelRecorder>(m_device, recordThreadCount, frameResourceCount);
+
+    if (m_device.descriptorIndexingSupported())
+        m_bindlessTextures = std::make_unique<BindlessTextures>(m_device);
 
     m_gui = std::unique_ptr<GUI>(new GUI(m_device));
-    m_gui->setup(frameResourceCount, m_swapChain.getImageExtent().width, m_swapChain.getImageExtent().height, m_swapchainRenderPass);
+    m_gui->setup(m_swapChain.getImageExtent().width, m_swapChain.getImageExtent().height, m_swapchainRenderPass);
 
-    return setup();
+    if (!setup())
+        return false;
+
+    const auto& pipelineCache = m_device.pipelineCache();
+    std::cout << "Created " << pipelineCache.createdPipelineCount() << " pipelines in " << pipelineCache.creationTimeInMicroseconds() / 1000.0
+        << " ms with a " << (pipelineCache.isWarm() ? "warm" : "cold") << " pipeline cache" << std::endl;
+
+    return true;
 }
 
 bool BasicRenderer::createInstance()
@@ -83,7 +99,7 @@ bool BasicRenderer::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo instanceCreateInfo = {};
     instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -128,7 +144,8 @@ bool BasicRenderer::createFrameResources(uint32_t numFrames)
 
     for (auto& resource : m_frameResources)
     {
-        resource.graphicsCommandBuffer = m_device.createCommandBuffer();
+        resource.commandPool = m_device.createCommandPool(m_device.graphicsQueue().familyId());
+        resource.graphicsCommandBuffer = m_device.createCommandBuffer(resource.commandPool);
         VK_CHECK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &resource.frameCompleteFence));
     }
 
@@ -156,15 +173,18 @@ void BasicRenderer::destroy()
     vkDeviceWaitIdle(m_device);
     
     m_gui.reset();
+    m_parallelRecorder.reset();
 
-    m_cameraUniformBuffer = UniformBuffer();
+    m_frameRingBuffer = FrameRingBuffer();
     m_swapChainDepthAttachment = DepthStencilAttachment();
     m_device.destroy(m_swapchainRenderPass);
     destroyFramebuffers();
     destroyFrameResources();
     m_swapChain.destroy();
-    m_imagePool.clear();
     shutdown();
+    // after shutdown, the meshes remove their textures on destruction
+    m_bindlessTextures.reset();
+    m_frameDescriptorSet.reset();
 
     m_device.destroy();
     vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
@@ -188,7 +208,7 @@ bool BasicRenderer::resize(uint32_t /*width*/, uint32_t /*height*/)
 
         m_gui->onResize(m_swapChain.getImageExtent().width, m_swapChain.getImageExtent().height);
 
-        updateMVPUniform();
+        updateCameraParameter();
         postResize();
 
         return true;
@@ -204,9 +224,11 @@ void BasicRenderer::destroyFramebuffers()
 
 void BasicRenderer::destroyFrameResources()
 {
-    for (const auto& resource : m_frameResources)
+    for (auto& resource : m_frameResources)
     {
         vkDestroyFence(m_device, resource.frameCompleteFence, nullptr);
+        resource.graphicsCommandBuffer.reset();
+        m_device.destroy(resource.commandPool);
     }
     m_frameResources.clear();
 }
@@ -223,6 +245,14 @@ void BasicRenderer::draw()
     m_frameResourceId = (m_frameResourceId + 1) % m_frameResourceCount;
     vkWaitForFences(m_device, 1, &m_frameResources[m_frameResourceId].frameCompleteFence, VK_TRUE, UINT64_MAX);
     vkResetFences(m_device, 1, &m_frameResources[m_frameResourceId].frameCompleteFence);
+    VK_CHECK_RESULT(vkResetCommandPool(m_device, m_frameResources[m_frameResourceId].commandPool, 0));
+    m_frameRingBuffer.beginFrame(m_frameResourceId);
+    m_parallelRecorder->beginFrame(m_frameResourceId);
+
+    // a copy per frame, so changing the camera does not touch the parameters pending frames read
+    m_frameParameter.time = static_cast<float>(Timer::getMicroseconds() - m_startTimeInMicroseconds) * 1e-6f;
+    m_frameDescriptorSet->update(m_frameRingBuffer, m_frameParameter);
+    m_frameParameter.frameIndex++;
 
     // aquire image for rendering
     uint32_t swapChainImageId(0);
@@ -235,24 +265,37 @@ void BasicRenderer::draw()
     render({ m_frameResources[m_frameResourceId], m_framebuffers[swapChainImageId] });
 
     // gui rendering
-    m_gui->draw(m_frameResourceId, commandBuffer);
+    if (m_parallelRecorder->isRecording())
+    {
+        // no inline commands are allowed in a render pass with secondary contents
+        m_parallelRecorder->recordOnCallingThread([&](CommandBuffer& guiCommandBuffer) { m_gui->record(m_frameRingBuffer, guiCommandBuffer); });
+        m_parallelRecorder->endRenderPass();
+        commandBuffer.end();
+    }
+    else
+    {
+        m_gui->draw(m_frameRingBuffer, commandBuffer);
+    }
     
-    // submission
-    m_device.graphicsQueue().submitAsync(
-        commandBuffer,
-        m_swapChain.getImageAvailableSemaphore(),
-        m_swapChain.getRenderFinishedSemaphore(),
-        m_frameResources[m_frameResourceId].frameCompleteFence,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    // submission, pending uploads go first so the frame sees their data
+    m_device.uploadManager().flush();
+    m_frameSubmission.addWait(m_swapChain.getImageAvailableSemaphore(), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+        .addCommandBuffer(commandBuffer)
+        .addSignal(m_swapChain.getRenderFinishedSemaphore());
+    m_device.graphicsQueue().submit(m_frameSubmission, m_frameResources[m_frameResourceId].frameCompleteFence);
+    m_frameSubmission.clear();
 
     // presentation
     if (!m_swapChain.present(swapChainImageId))
         resize(m_swapChain.getImageExtent().width, m_swapChain.getImageExtent().height);
 }
 
-void BasicRenderer::fillCommandBuffer(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, const DrawFunc& drawFunc)
+void BasicRenderer::fillCommandBuffer(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, const DrawFunc& drawFunc, const DrawFunc& preRenderPassFunc)
 {
     commandBuffer.begin();
+    m_frameDescriptorSet->bind(commandBuffer);
+    if (preRenderPassFunc)
+        preRenderPassFunc(commandBuffer);
     commandBuffer.beginRenderPass(renderPass, framebuffer, m_swapChain.getImageExtent());
 
     VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(m_swapChain.getImageExtent().width), static_cast<float>(m_swapChain.getImageExtent().height), 0.0f, 1.0f };
@@ -264,17 +307,28 @@ void BasicRenderer::fillCommandBuffer(CommandBuffer& commandBuffer, VkRenderPass
     drawFunc(commandBuffer);
 }
 
-void BasicRenderer::updateMVPUniform()
+void BasicRenderer::fillCommandBufferParallel(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t drawCount, const ParallelRecorder::RecordFunc& recordFunc)
 {
-    m_mappedCameraUniformBuffer->mvp = m_cameraHandler.mvp(m_swapChain.getImageExtent().width / static_cast<float>(m_swapChain.getImageExtent().height));
-    m_mappedCameraUniformBuffer->pos = glm::make_vec4(m_cameraHandler.cameraPosition());
-    m_mappedCameraUniformBuffer->pixelsPerRadians = static_cast<float>(m_swapChain.getImageExtent().height) / m_cameraHandler.m_fovRadians;
+    commandBuffer.begin();
+    m_parallelRecorder->beginRenderPass(commandBuffer, renderPass, framebuffer, m_swapChain.getImageExtent());
+    m_parallelRecorder->record(drawCount, [&](CommandBuffer& threadCommandBuffer, uint32_t begin, uint32_t end)
+    {
+        m_frameDescriptorSet->bind(threadCommandBuffer);
+        recordFunc(threadCommandBuffer, begin, end);
+    });
+}
+
+void BasicRenderer::updateCameraParameter()
+{
+    m_frameParameter.mvp = m_cameraHandler.mvp(m_swapChain.getImageExtent().width / static_cast<float>(m_swapChain.getImageExtent().height));
+    m_frameParameter.cameraPosition = glm::make_vec4(m_cameraHandler.cameraPosition());
+    m_frameParameter.pixelsPerRadians = static_cast<float>(m_swapChain.getImageExtent().height) / m_cameraHandler.m_fovRadians;
 }
 
 void BasicRenderer::setCameraFromBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& lookDir)
 {
     m_cameraHandler.setCameraFromBoundingBox(min, max, lookDir);
-    updateMVPUniform();
+    updateCameraParameter();
 }
 
 void BasicRenderer::setClearColor(VkClearColorValue clearColor)
@@ -290,7 +344,7 @@ const VkClearColorValue& BasicRenderer::clearColor() const
 void BasicRenderer::update()
 {
     if (m_inputHandler.update())
-        updateMVPUniform();
+        updateCameraParameter();
 }
 
 void BasicRenderer::mouseButton(int button, int action, int mods)
@@ -302,7 +356,7 @@ void BasicRenderer::mouseMove(double x, double y)
 {
     const auto disableCameraUpdate = ImGui::IsAnyItemActive();
     if (m_inputHandler.move(static_cast<float>(x), static_cast<float>(y), m_stats.getDeltaTime(), m_swapChain.getImageExtent().width, m_swapChain.getImageExtent().height, disableCameraUpdate))
-        updateMVPUniform();
+        updateCameraParameter();
 }
 
 void BasicRenderer::waitForAllFrames() const
@@ -310,3 +364,13 @@ void BasicRenderer::waitForAllFrames() const
     for (const auto& frameResource : m_frameResources)
         vkWaitForFences(m_device, 1, &frameResource.frameCompleteFence, VK_TRUE, UINT64_MAX);
 }
+
+void BasicRenderer::addFrameWait(VkSemaphore semaphore, VkPipelineStageFlags waitStages, uint64_t value)
+{
+    m_frameSubmission.addWait(semaphore, waitStages, value);
+}
+
+void BasicRenderer::addFrameSignal(VkSemaphore semaphore, uint64_t value)
+{
+    m_frameSubmission.addSignal(semaphore, value);
+}
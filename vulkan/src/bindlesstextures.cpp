@@ -0,0 +1,95 @@
+#include "bindlesstextures.h"
+#include "vulkanhelper.h"
+#include "device.h"
+
+#include <cassert>
+
+namespace
+{
+    const uint32_t SamplerBinding = 0;
+    const uint32_t TextureBinding = 1;
+}
+
+BindlessTextures::BindlessTextures(const Device& device)
+    : DeviceRef(device)
+{
+    assert(device.descriptorIndexingSupported());
+
+    m_sampler = device.createSampler();
+
+    const std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        { SamplerBinding, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &m_sampler },
+        { TextureBinding, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, Capacity, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+    };
+    // unused elements may stay unwritten and the written ones may change while the set is bound
+    const std::vector<VkDescriptorBindingFlagsEXT> bindingFlags = {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+    };
+    m_layout = device.createDescriptorSetLayout(bindings, bindingFlags);
+
+    m_pool = device.createDescriptorPool(1, {
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, Capacity } },
+        VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_layout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &m_descriptorSet));
+}
+
+BindlessTextures::~BindlessTextures()
+{
+    destroy(m_pool);
+    destroy(m_layout);
+    destroy(m_sampler);
+}
+
+uint32_t BindlessTextures::add(VkImageView imageView)
+{
+    uint32_t index = InvalidIndex;
+    if (!m_freeIndices.empty())
+    {
+        index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+    }
+    else if (m_nextIndex < Capacity)
+    {
+        index = m_nextIndex++;
+    }
+    else
+    {
+        return InvalidIndex;
+    }
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.imageView = imageView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_descriptorSet;
+    write.dstBinding = TextureBinding;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device(), 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void BindlessTextures::remove(uint32_t index)
+{
+    assert(index < m_nextIndex);
+    // the stale descriptor is left in place, partially bound arrays only require the elements used by a draw to be valid
+    m_freeIndices.push_back(index);
+}
+
+void BindlessTextures::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId) const
+{
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setId, 1, &m_descriptorSet, 0, nullptr);
+}
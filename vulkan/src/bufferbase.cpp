@@ -1,11 +1,22 @@
 #include "bufferbase.h"
+#include "buffer.h"
 #include "device.h"
 
 #include "vulkanhelper.h"
 
 namespace
 {
-    std::pair<VkBuffer, VkDeviceMemory> createBufferAndMemory(const Device& device, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties)
+    MemoryCategory getMemoryCategory(VkBufferUsageFlags usage)
+    {
+        if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+            return MemoryCategory::Uniform;
+        if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+            return MemoryCategory::Geometry;
+        return MemoryCategory::Staging;
+    }
+
+    std::pair<VkBuffer, MemoryAllocation> createBufferAndMemory(const Device& device, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties,
+        BufferSource source)
     {
         VkBufferCreateInfo bufferInfo = {};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -19,30 +30,30 @@ namespace
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = device.findMemoryType(memRequirements.memoryTypeBits, memoryProperties);
+        // device local buffers which get filled from the cpu rather live in host visible vram than pay for a staging copy,
+        // buffers written by shaders stay in the plain device local memory
+        VkMemoryPropertyFlags preferredProperties = 0;
+        if ((memoryProperties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && source == BufferSource::Cpu)
+            preferredProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-        VkDeviceMemory memory;
-        vkAllocateMemory(device, &allocInfo, nullptr, &memory);
-        vkBindBufferMemory(device, buffer, memory, 0);
+        const auto allocation = device.memoryAllocator().allocate(memRequirements, memoryProperties, getMemoryCategory(usage), true, preferredProperties);
+        VK_CHECK_RESULT(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
 
-        return { buffer, memory };
+        return { buffer, allocation };
     }
 }
 
-BufferBase::BufferBase(const Device& device, uint64_t size, VkBufferUsageFlagBits usageFlags, VkMemoryPropertyFlags memoryProperties)
+BufferBase::BufferBase(const Device& device, uint64_t size, VkBufferUsageFlagBits usageFlags, VkMemoryPropertyFlags memoryProperties, BufferSource source)
     : DeviceRef(device)
     , m_size(size)
 {
-    std::tie(m_buffer, m_memory) = createBufferAndMemory(device, size, usageFlags, memoryProperties);
+    std::tie(m_buffer, m_allocation) = createBufferAndMemory(device, size, usageFlags, memoryProperties, source);
 }
 
 BufferBase::~BufferBase()
 {
     destroy(m_buffer);
-    destroy(m_memory);
+    destroy(m_allocation);
 }
 
 bool BufferBase::isValid() const
@@ -62,26 +73,69 @@ VkBuffer BufferBase::buffer() const
 
 VkDeviceMemory BufferBase::memory() const
 {
-    return m_memory;
+    return m_allocation.memory;
+}
+
+VkDeviceSize BufferBase::memoryOffset() const
+{
+    return m_allocation.offset;
+}
+
+MemoryCategory BufferBase::memoryCategory() const
+{
+    return m_allocation.category;
 }
 
 void BufferBase::fill(const FillFunc& fillfunc) const
 {
-    auto data = map(m_size, 0);
-    fillfunc(data);
-    unmap();
+    fillfunc(data());
+    flush();
+}
+
+BufferBase::UploadHandle BufferBase::upload(const void* inputData, uint64_t size, uint64_t offset, uint32_t dstQueueFamilyId) const
+{
+    assert(offset + size <= m_size);
+
+    if (m_allocation.mappedData != nullptr)
+    {
+        std::memcpy(static_cast<uint8_t*>(data()) + offset, inputData, size);
+        flush(offset, size);
+        device().memoryAllocator().recordUpload(size, true);
+        return 0;
+    }
+
+    return device().uploadManager().uploadBuffer(inputData, m_buffer, size, offset, dstQueueFamilyId);
+}
+
+BufferBase::UploadHandle BufferBase::upload(const WriteFunc& writeFunc, uint64_t size, uint64_t offset, uint32_t dstQueueFamilyId) const
+{
+    assert(offset + size <= m_size);
+
+    if (m_allocation.mappedData != nullptr)
+    {
+        writeFunc(static_cast<uint8_t*>(data()) + offset, 0, size);
+        flush(offset, size);
+        device().memoryAllocator().recordUpload(size, true);
+        return 0;
+    }
+
+    return device().uploadManager().uploadBuffer(writeFunc, m_buffer, size, offset, dstQueueFamilyId);
+}
+
+void* BufferBase::data() const
+{
+    assert(m_allocation.mappedData != nullptr);
+    return m_allocation.mappedData;
 }
 
-void* BufferBase::map(uint64_t size, uint64_t offset) const
+void BufferBase::flush(uint64_t offset, uint64_t size) const
 {
-    void* data;
-    VK_CHECK_RESULT(vkMapMemory(device(), m_memory, offset, size, 0, &data));
-    return data;
+    device().memoryAllocator().flush(m_allocation, offset, size);
 }
 
-void BufferBase::unmap() const
+void BufferBase::invalidate(uint64_t offset, uint64_t size) const
 {
-    vkUnmapMemory(device(), m_memory);
+    device().memoryAllocator().invalidate(m_allocation, offset, size);
 }
 
 void BufferBase::swap(BufferBase& other)
@@ -89,5 +143,5 @@ void BufferBase::swap(BufferBase& other)
     DeviceRef::swap(other);
     std::swap(m_size, other.m_size);
     std::swap(m_buffer, other.m_buffer);
-    std::swap(m_memory, other.m_memory);
+    std::swap(m_allocation, other.m_allocation);
 }
\ No newline at end of file
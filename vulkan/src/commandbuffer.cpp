@@ -1,17 +1,18 @@
 #include "commandbuffer.h"
 #include "vulkanhelper.h"
 #include "device.h"
+#include "barrier.h"
 
 #include <array>
 
-CommandBuffer::CommandBuffer(const Device& device, VkCommandPool commandPool)
+CommandBuffer::CommandBuffer(const Device& device, VkCommandPool commandPool, VkCommandBufferLevel level)
     : DeviceRef(device)
     , m_usedCommandPool(commandPool)
 {
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.level = level;
     allocInfo.commandBufferCount = 1;
 
     VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &m_commandBuffer));
@@ -29,14 +30,41 @@ void CommandBuffer::begin()
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     VK_CHECK_RESULT(vkBeginCommandBuffer(m_commandBuffer, &beginInfo));
+    m_stateTracker.reset();
+}
+
+void CommandBuffer::beginSecondary(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_commandBuffer, &beginInfo));
+    m_stateTracker.reset();
+
+    // dynamic state is not inherited from the primary command buffer
+    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(renderAreaExtent.width), static_cast<float>(renderAreaExtent.height), 0.0f, 1.0f };
+    vkCmdSetViewport(m_commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor = { { 0, 0 }, renderAreaExtent };
+    vkCmdSetScissor(m_commandBuffer, 0, 1, &scissor);
 }
 
 void CommandBuffer::end()
 {
+    flushBarriers();
     VK_CHECK_RESULT(vkEndCommandBuffer(m_commandBuffer));
 }
 
-void CommandBuffer::beginRenderPass(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent, const VkClearColorValue *clearColor)
+void CommandBuffer::beginRenderPass(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D renderAreaExtent, const VkClearColorValue *clearColor,
+    VkSubpassContents contents)
 {
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -53,7 +81,13 @@ void CommandBuffer::beginRenderPass(VkRenderPass renderPass, VkFramebuffer frame
         renderPassInfo.pClearValues = clearValues.data();
     }
 
-    vkCmdBeginRenderPass(m_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // barriers are not allowed inside the render pass
+    flushBarriers();
+    vkCmdBeginRenderPass(m_commandBuffer, &renderPassInfo, contents);
+
+    // only vkCmdExecuteCommands is allowed inside a subpass with secondary contents
+    if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS)
+        return;
 
     VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(renderAreaExtent.width), static_cast<float>(renderAreaExtent.height), 0.0f, 1.0f };
     vkCmdSetViewport(m_commandBuffer, 0, 1, &viewport);
@@ -67,40 +101,168 @@ void CommandBuffer::endRenderPass()
     vkCmdEndRenderPass(m_commandBuffer);
 }
 
-void CommandBuffer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void CommandBuffer::executeCommands(const std::vector<VkCommandBuffer>& commandBuffers)
+{
+    if (!commandBuffers.empty())
+        vkCmdExecuteCommands(m_commandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+}
+
+void CommandBuffer::dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    flushBarriers();
+    vkCmdDispatch(m_commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+void CommandBuffer::bufferAccess(VkBuffer buffer, const ResourceAccess& access)
+{
+    m_stateTracker.bufferAccess(buffer, access);
+}
+
+void CommandBuffer::imageAccess(VkImage image, const VkImageSubresourceRange& range, VkImageLayout currentLayout, const ResourceAccess& access)
+{
+    m_stateTracker.imageAccess(image, range, currentLayout, access);
+}
+
+void CommandBuffer::flushBarriers()
+{
+    if (!m_stateTracker.hasPendingBarriers())
+        return;
+
+    const auto barriers = m_stateTracker.takePendingBarriers();
+
+    // synchronization2 keeps the stages per barrier instead of combining them for the whole command
+    if (device().synchronization2Supported())
+    {
+        std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+        std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+        for (const auto& barrier : barriers)
+        {
+            if (barrier.buffer != VK_NULL_HANDLE)
+            {
+                VkBufferMemoryBarrier2KHR bufferBarrier = {};
+                bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+                bufferBarrier.srcStageMask = barrier.srcStages;
+                bufferBarrier.srcAccessMask = barrier.srcAccess;
+                bufferBarrier.dstStageMask = barrier.dstStages;
+                bufferBarrier.dstAccessMask = barrier.dstAccess;
+                bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.buffer = barrier.buffer;
+                bufferBarrier.offset = 0;
+                bufferBarrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(bufferBarrier);
+            }
+            else
+            {
+                VkImageMemoryBarrier2KHR imageBarrier = {};
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+                imageBarrier.srcStageMask = barrier.srcStages;
+                imageBarrier.srcAccessMask = barrier.srcAccess;
+                imageBarrier.dstStageMask = barrier.dstStages;
+                imageBarrier.dstAccessMask = barrier.dstAccess;
+                imageBarrier.oldLayout = barrier.oldLayout;
+                imageBarrier.newLayout = barrier.newLayout;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.image = barrier.image;
+                imageBarrier.subresourceRange = barrier.range;
+                imageBarriers.push_back(imageBarrier);
+            }
+        }
+
+        VkDependencyInfoKHR dependencyInfo = {};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        device().pipelineBarrier2(m_commandBuffer, dependencyInfo);
+        return;
+    }
+
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    for (const auto& barrier : barriers)
+    {
+        srcStages |= barrier.srcStages;
+        dstStages |= barrier.dstStages;
+
+        if (barrier.buffer != VK_NULL_HANDLE)
+        {
+            bufferBarriers.push_back(createBufferMemoryBarrier(barrier.buffer, barrier.srcAccess, barrier.dstAccess));
+        }
+        else
+        {
+            auto imageBarrier = createImageMemoryBarrier(barrier.image, barrier.range, barrier.oldLayout, barrier.newLayout);
+            imageBarrier.srcAccessMask = barrier.srcAccess;
+            imageBarrier.dstAccessMask = barrier.dstAccess;
+            imageBarriers.push_back(imageBarrier);
+        }
+    }
+
+    // without synchronization2 empty stage masks are not allowed
+    if (srcStages == 0)
+        srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    if (dstStages == 0)
+        dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    vkCmdPipelineBarrier(m_commandBuffer, srcStages, dstStages, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void CommandBuffer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
 {
     VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
 
+    flushBarriers();
     vkCmdCopyBuffer(m_commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 }
 
 void CommandBuffer::copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent2D resolution)
+{
+    copyBufferToImage(buffer, 0, image, { 0, 0 }, resolution);
+}
+
+void CommandBuffer::copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, VkOffset2D imageOffset, VkExtent2D extent)
 {
     VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = 0;
     region.imageSubresource.baseArrayLayer = 0;
     region.imageSubresource.layerCount = 1;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { resolution.width, resolution.height, 1 };
+    region.imageOffset = { imageOffset.x, imageOffset.y, 0 };
+    region.imageExtent = { extent.width, extent.height, 1 };
 
+    flushBarriers();
     vkCmdCopyBufferToImage(m_commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
 
 void CommandBuffer::pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkImageMemoryBarrier barrier)
 {
+    flushBarriers();
     vkCmdPipelineBarrier(m_commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
 void CommandBuffer::pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkBufferMemoryBarrier barrier)
 {
+    flushBarriers();
     vkCmdPipelineBarrier(m_commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
 }
 
+void CommandBuffer::pipelineBarrier(VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, const std::vector<VkImageMemoryBarrier>& barriers)
+{
+    flushBarriers();
+    vkCmdPipelineBarrier(m_commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
 void CommandBuffer::bindPipeline(VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline)
 {
     vkCmdBindPipeline(m_commandBuffer, pipelineBindPoint, pipeline);
@@ -0,0 +1,33 @@
+#include "commandbuffercache.h"
+#include "commandbuffer.h"
+#include "device.h"
+
+CommandBufferCache::CommandBufferCache(const Device& device, VkCommandPool commandPool)
+    : DeviceRef(device)
+    , m_commandPool(commandPool)
+{
+}
+
+CommandBufferCache::~CommandBufferCache()
+{
+    m_freeCommandBuffers.clear();
+}
+
+CommandBufferPtr CommandBufferCache::acquire()
+{
+    if (m_freeCommandBuffers.empty())
+    {
+        m_allocatedCount++;
+        return device().createCommandBuffer(m_commandPool);
+    }
+
+    auto commandBuffer = std::move(m_freeCommandBuffers.back());
+    m_freeCommandBuffers.pop_back();
+    return commandBuffer;
+}
+
+void CommandBufferCache::recycle(CommandBufferPtr commandBuffer)
+{
+    if (commandBuffer)
+        m_freeCommandBuffers.push_back(std::move(commandBuffer));
+}
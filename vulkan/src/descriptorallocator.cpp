@@ -0,0 +1,95 @@
+#include "descriptorallocator.h"
+#include "vulkanhelper.h"
+#include "device.h"
+
+#include <algorithm>
+
+namespace
+{
+    const uint32_t MaxSetsPerPool = 4096;
+}
+
+const std::vector<VkDescriptorPoolSize> DescriptorAllocator::DefaultSizesPerSet = {
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+    { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2 },
+    { VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 }
+};
+
+DescriptorAllocator::DescriptorAllocator(const Device& device, uint32_t setsPerPool, const std::vector<VkDescriptorPoolSize>& sizesPerSet)
+    : DeviceRef(device)
+    , m_sizesPerSet(sizesPerSet)
+    , m_setsPerPool(std::max(setsPerPool, 1u))
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    for (auto pool : m_usedPools)
+        destroy(pool);
+    for (auto pool : m_freePools)
+        destroy(pool);
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    if (!m_usedPools.empty())
+    {
+        allocInfo.descriptorPool = m_usedPools.back();
+        const auto result = vkAllocateDescriptorSets(device(), &allocInfo, &descriptorSet);
+        if (result == VK_SUCCESS)
+            return descriptorSet;
+
+        // any other error is not recoverable by adding a pool
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+        {
+            VK_CHECK_RESULT(result);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    if (!m_freePools.empty())
+    {
+        m_usedPools.push_back(m_freePools.back());
+        m_freePools.pop_back();
+    }
+    else
+    {
+        m_usedPools.push_back(createPool());
+    }
+
+    allocInfo.descriptorPool = m_usedPools.back();
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device(), &allocInfo, &descriptorSet));
+    return descriptorSet;
+}
+
+void DescriptorAllocator::reset()
+{
+    for (auto pool : m_usedPools)
+        VK_CHECK_RESULT(vkResetDescriptorPool(device(), pool, 0));
+
+    m_freePools.insert(m_freePools.end(), m_usedPools.begin(), m_usedPools.end());
+    m_usedPools.clear();
+}
+
+VkDescriptorPool DescriptorAllocator::createPool()
+{
+    std::vector<VkDescriptorPoolSize> sizes = m_sizesPerSet;
+    for (auto& size : sizes)
+        size.descriptorCount *= m_setsPerPool;
+
+    const auto pool = device().createDescriptorPool(m_setsPerPool, sizes);
+
+    // the next pool doubles, so the pool count only grows with the logarithm of the set count
+    m_setsPerPool = std::min(m_setsPerPool * 2, MaxSetsPerPool);
+    return pool;
+}
@@ -1,144 +1,226 @@
 #include "descriptorset.h"
+#include "descriptorallocator.h"
 #include "vulkanhelper.h"
+#include "device.h"
+
+#include <algorithm>
 
 void DescriptorSet::setImageSampler(uint32_t bindingId, VkImageView textureImageView, VkSampler sampler)
 {
-    VkDescriptorImageInfo imageInfo = {};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = textureImageView;
-    imageInfo.sampler = sampler;
-    m_imageInfos.push_back({ imageInfo });
-
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstBinding = bindingId;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite.descriptorCount = 1;
-    m_descriptorWrites.push_back(descriptorWrite);
+    setImageInfo(bindingId, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureImageView, sampler);
 }
 
 void DescriptorSet::setSampler(uint32_t bindingId, VkSampler sampler)
 {
-    VkDescriptorImageInfo imageInfo = {};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = nullptr;
-    imageInfo.sampler = sampler;
-    m_imageInfos.push_back({ imageInfo });
-
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstBinding = bindingId;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-    descriptorWrite.descriptorCount = 1;
-    m_descriptorWrites.push_back(descriptorWrite);
+    setImageInfo(bindingId, VK_DESCRIPTOR_TYPE_SAMPLER, VK_NULL_HANDLE, sampler);
 }
 
 void DescriptorSet::setImageArray(uint32_t bindingId, const std::vector<VkImageView>& imageViews)
 {
-    std::vector<VkDescriptorImageInfo> imageInfos(imageViews.size());
+    assert(m_imageArray.empty() || m_imageArrayBindingId == bindingId);
+
+    m_imageArray.resize(imageViews.size());
     for (uint32_t i = 0u; i < imageViews.size(); i++)
     {
-        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfos[i].imageView = imageViews[i];
-        imageInfos[i].sampler = nullptr;
+        m_imageArray[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        m_imageArray[i].imageView = imageViews[i];
+        m_imageArray[i].sampler = VK_NULL_HANDLE;
     }
-    m_imageInfos.push_back(imageInfos);
-
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstBinding = bindingId;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    descriptorWrite.descriptorCount = static_cast<uint32_t>(imageInfos.size());
-    m_descriptorWrites.push_back(descriptorWrite);
+    m_imageArrayBindingId = bindingId;
+    m_isImageArrayDirty = !m_imageArray.empty();
 }
 
 void DescriptorSet::setUniformBuffer(uint32_t bindingId, VkBuffer uniformBuffer)
 {
-    VkDescriptorBufferInfo bufferInfo = {};
-    bufferInfo.buffer = uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = VK_WHOLE_SIZE;
-    m_bufferInfos.push_back(bufferInfo);
-
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstBinding = bindingId;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite.descriptorCount = 1;
-    m_descriptorWrites.push_back(descriptorWrite);
+    setBufferInfo(bindingId, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer, 0, VK_WHOLE_SIZE);
 }
 
 void DescriptorSet::setStorageBuffer(uint32_t bindingId, VkBuffer storageBuffer, VkDeviceSize offset, VkDeviceSize size)
 {
-    VkDescriptorBufferInfo bufferInfo = {};
-    bufferInfo.buffer = storageBuffer;
-    bufferInfo.offset = offset;
-    bufferInfo.range = size;
-    m_bufferInfos.push_back(bufferInfo);
+    setBufferInfo(bindingId, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffer, offset, size);
+}
 
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstBinding = bindingId;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorWrite.descriptorCount = 1;
-    m_descriptorWrites.push_back(descriptorWrite);
+void DescriptorSet::setDynamicUniformBuffer(uint32_t bindingId, VkBuffer uniformBuffer, VkDeviceSize range)
+{
+    setBufferInfo(bindingId, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformBuffer, 0, range);
 }
 
-void DescriptorSet::allocate(VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool pool)
+void DescriptorSet::setDynamicStorageBuffer(uint32_t bindingId, VkBuffer storageBuffer, VkDeviceSize range)
 {
-    assert(m_descriptorSet == VK_NULL_HANDLE);
+    setBufferInfo(bindingId, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, storageBuffer, 0, range);
+}
 
-    const VkDescriptorSetLayout descriptorSetLayout{ layout };
+void DescriptorSet::setImageInfo(uint32_t bindingId, VkDescriptorType type, VkImageView imageView, VkSampler sampler)
+{
+    auto binding = acquireBinding(bindingId, type);
+    if (!binding)
+        return;
 
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &m_descriptorSet));
+    binding->info.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    binding->info.image.imageView = imageView;
+    binding->info.image.sampler = sampler;
 }
 
-void DescriptorSet::update(VkDevice device)
+void DescriptorSet::setBufferInfo(uint32_t bindingId, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
 {
-    assert(m_descriptorSet != VK_NULL_HANDLE);
+    auto binding = acquireBinding(bindingId, type);
+    if (!binding)
+        return;
 
-    auto bufferIter = m_bufferInfos.begin();
-    auto imageIter = m_imageInfos.begin();
+    binding->info.buffer.buffer = buffer;
+    binding->info.buffer.offset = offset;
+    binding->info.buffer.range = range;
+}
 
-    for (auto& descriptorWrite : m_descriptorWrites)
+DescriptorSet::Binding* DescriptorSet::acquireBinding(uint32_t bindingId, VkDescriptorType type)
+{
+    auto position = 0u;
+    while (position < m_bindingCount && m_bindings[position].bindingId < bindingId)
+        position++;
+
+    if (position == m_bindingCount || m_bindings[position].bindingId != bindingId)
     {
-        descriptorWrite.dstSet = m_descriptorSet;
-        if (descriptorWrite.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
-            descriptorWrite.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+        if (m_bindingCount == MaxBindings)
         {
-            assert(bufferIter != m_bufferInfos.end());
-            descriptorWrite.pBufferInfo = const_cast<const VkDescriptorBufferInfo*>(&(*bufferIter));
-            bufferIter++;
+            std::cout << "Descriptor set binding " << bindingId << " dropped, a set holds at most " << MaxBindings << " bindings" << std::endl;
+            assert(false);
+            return nullptr;
         }
+        for (auto i = m_bindingCount; i > position; i--)
+            m_bindings[i] = m_bindings[i - 1];
+        m_bindingCount++;
+    }
+
+    auto& binding = m_bindings[position];
+    binding = {};
+    binding.bindingId = bindingId;
+    binding.type = type;
+    binding.isDirty = true;
+    return &binding;
+}
+
+uint32_t DescriptorSet::collectWrites(VkWriteDescriptorSet* writes)
+{
+    assert(m_descriptorSet != VK_NULL_HANDLE);
+
+    auto writeCount = 0u;
+    auto addWrite = [&](uint32_t bindingId, VkDescriptorType type, uint32_t descriptorCount)
+    {
+        auto& descriptorWrite = writes[writeCount++];
+        descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = m_descriptorSet;
+        descriptorWrite.dstBinding = bindingId;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = type;
+        descriptorWrite.descriptorCount = descriptorCount;
+        return &descriptorWrite;
+    };
+
+    for (auto i = 0u; i < m_bindingCount; i++)
+    {
+        auto& binding = m_bindings[i];
+        if (!binding.isDirty)
+            continue;
+
+        auto descriptorWrite = addWrite(binding.bindingId, binding.type, 1);
+        if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+            binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+            binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+            binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
+            descriptorWrite->pBufferInfo = &binding.info.buffer;
         else
-        {
-            assert(imageIter != m_imageInfos.end());
-            descriptorWrite.pImageInfo = const_cast<const VkDescriptorImageInfo*>(&imageIter->front());
-            imageIter++;
-        }
+            descriptorWrite->pImageInfo = &binding.info.image;
+        binding.isDirty = false;
+    }
+
+    if (m_isImageArrayDirty)
+    {
+        auto descriptorWrite = addWrite(m_imageArrayBindingId, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, static_cast<uint32_t>(m_imageArray.size()));
+        descriptorWrite->pImageInfo = m_imageArray.data();
+        m_isImageArrayDirty = false;
     }
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(m_descriptorWrites.size()), m_descriptorWrites.data(), 0, nullptr);
 
-    m_imageInfos.clear();
-    m_bufferInfos.clear();
-    m_descriptorWrites.clear();
     m_isValid = true;
+    return writeCount;
 }
 
-void DescriptorSet::allocateAndUpdate(VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool pool)
+void DescriptorSet::allocate(DescriptorAllocator& allocator, VkDescriptorSetLayout layout)
 {
-    allocate(device, layout, pool);
-    update(device);
+    assert(m_descriptorSet == VK_NULL_HANDLE);
+    m_descriptorSet = allocator.allocate(layout);
+}
+
+void DescriptorSet::update(VkDevice device)
+{
+    std::array<VkWriteDescriptorSet, MaxWrites> descriptorWrites;
+    const auto writeCount = collectWrites(descriptorWrites.data());
+    if (writeCount > 0)
+        vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
+}
+
+void DescriptorSet::update(VkDevice device, const UpdateTemplate& updateTemplate)
+{
+    assert(m_descriptorSet != VK_NULL_HANDLE);
+    assert(updateTemplate.handle != VK_NULL_HANDLE);
+    assert(m_imageArray.empty());
+    // the template reads an entry per binding of the layout, a missing binding would leave an entry unwritten
+    assert(m_bindingCount == updateTemplate.entryCount);
+
+    std::array<DescriptorInfo, MaxBindings> data = {};
+    for (auto i = 0u; i < m_bindingCount; i++)
+    {
+        data[i] = m_bindings[i].info;
+        m_bindings[i].isDirty = false;
+    }
+    vkUpdateDescriptorSetWithTemplate(device, m_descriptorSet, updateTemplate.handle, data.data());
+    m_isValid = true;
+}
+
+DescriptorSet::UpdateTemplate DescriptorSet::createUpdateTemplate(VkDevice device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    if (bindings.size() > MaxBindings)
+    {
+        std::cout << "No update template for " << bindings.size() << " bindings, a set holds at most " << MaxBindings << " bindings" << std::endl;
+        assert(false);
+        return {};
+    }
+
+    // the set keeps its bindings sorted, so entry i reads the info of the i-th lowest binding
+    std::vector<VkDescriptorSetLayoutBinding> sortedBindings = bindings;
+    std::sort(sortedBindings.begin(), sortedBindings.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries(sortedBindings.size());
+    for (auto i = 0u; i < sortedBindings.size(); i++)
+    {
+        assert(sortedBindings[i].descriptorCount == 1);
+
+        auto& entry = entries[i];
+        entry.dstBinding = sortedBindings[i].binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = 1;
+        entry.descriptorType = sortedBindings[i].descriptorType;
+        entry.offset = i * sizeof(DescriptorInfo);
+        entry.stride = sizeof(DescriptorInfo);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo templateInfo = {};
+    templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    templateInfo.pDescriptorUpdateEntries = entries.data();
+    templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    templateInfo.descriptorSetLayout = layout;
+
+    UpdateTemplate updateTemplate;
+    VK_CHECK_RESULT(vkCreateDescriptorUpdateTemplate(device, &templateInfo, nullptr, &updateTemplate.handle));
+    updateTemplate.entryCount = static_cast<uint32_t>(entries.size());
+    return updateTemplate;
+}
+
+void DescriptorSet::allocateAndUpdate(DescriptorAllocator& allocator, VkDescriptorSetLayout layout)
+{
+    allocate(allocator, layout);
+    update(allocator.device());
 }
 
 void DescriptorSet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId) const
@@ -147,17 +229,15 @@ void DescriptorSet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelin
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setId, 1, &m_descriptorSet, 0, nullptr);
 }
 
-void DescriptorSet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, const std::vector<VkDescriptorSet>& descriptorSets)
+void DescriptorSet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setId, const uint32_t* dynamicOffsets, uint32_t dynamicOffsetCount) const
 {
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, firstSet, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+    assert(m_descriptorSet != VK_NULL_HANDLE);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setId, 1, &m_descriptorSet, dynamicOffsetCount, dynamicOffsets);
 }
 
-void DescriptorSet::free(VkDevice device, VkDescriptorPool pool)
+void DescriptorSet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, const std::vector<VkDescriptorSet>& descriptorSets)
 {
-    assert(m_descriptorSet != VK_NULL_HANDLE);
-    vkFreeDescriptorSets(device, pool, 1, &m_descriptorSet);
-    m_descriptorSet = VK_NULL_HANDLE;
-    m_isValid = false;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, firstSet, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
 }
 
 bool DescriptorSet::isValid() const
@@ -169,3 +249,19 @@ void DescriptorSet::invalidate()
 {
     m_isValid = false;
 }
+
+void DescriptorUpdateBatch::add(DescriptorSet& descriptorSet)
+{
+    const auto offset = m_writes.size();
+    m_writes.resize(offset + DescriptorSet::MaxWrites);
+    m_writes.resize(offset + descriptorSet.collectWrites(&m_writes[offset]));
+}
+
+void DescriptorUpdateBatch::submit(VkDevice device)
+{
+    if (!m_writes.empty())
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(m_writes.size()), m_writes.data(), 0, nullptr);
+
+    // keeps the capacity for the next batch
+    m_writes.clear();
+}
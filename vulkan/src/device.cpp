@@ -7,10 +7,30 @@
 #include "barrier.h"
 #include "commandbuffer.h"
 #include "queue.h"
+#include "../utils/timer.h"
 
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <cstring>
 
+namespace
+{
+    const char* PipelineCacheFilename = "pipelinecache.bin";
+
+    // handles are pointers or 64 bit integers depending on the platform
+    template<typename T>
+    uint64_t handleKey(T handle)
+    {
+        return (uint64_t)(handle);
+    }
+
+    int countBits(VkMemoryPropertyFlags flags)
+    {
+        return static_cast<int>(std::bitset<32>(flags).count());
+    }
+}
+
 bool Device::init(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers)
 {
     uint32_t numDevices = 0;
@@ -40,29 +60,91 @@ bool Device::init(VkInstance instance, VkSurfaceKHR surface, bool enableValidati
         return false;
     }
 
+    if (queueFamilyIds.transfer == UINT32_MAX)
+        queueFamilyIds.transfer = queueFamilyIds.graphics;
+
+    // one queue per distinct family
+    std::vector<uint32_t> queueFamilies = { queueFamilyIds.graphics, queueFamilyIds.compute, queueFamilyIds.present, queueFamilyIds.transfer };
+    std::sort(queueFamilies.begin(), queueFamilies.end());
+    queueFamilies.erase(std::unique(queueFamilies.begin(), queueFamilies.end()), queueFamilies.end());
+
     const float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo = {
-        VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,     // VkStructureType              sType
-        nullptr,                                        // const void                  *pNext
-        0,                                              // VkDeviceQueueCreateFlags     flags
-        queueFamilyIds.graphics,                        // uint32_t                     queueFamilyIndex
-        1,                                              // uint32_t                     queueCount
-        &queuePriority                                  // const float                 *pQueuePriorities
-    };
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (auto queueFamily : queueFamilies)
+    {
+        queueCreateInfos.push_back({
+            VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,     // VkStructureType              sType
+            nullptr,                                        // const void                  *pNext
+            0,                                              // VkDeviceQueueCreateFlags     flags
+            queueFamily,                                    // uint32_t                     queueFamilyIndex
+            1,                                              // uint32_t                     queueCount
+            &queuePriority                                  // const float                 *pQueuePriorities
+        });
+    }
 
     std::vector<const char*> extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    // the budget query goes through vkGetPhysicalDeviceMemoryProperties2, which is core since 1.1
+    m_memoryBudgetSupported = m_deviceProperties.apiVersion >= VK_API_VERSION_1_1 && isExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (m_memoryBudgetSupported)
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {};
+    timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = {};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+    descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    if (m_deviceProperties.apiVersion >= VK_API_VERSION_1_1)
+    {
+        // only structs of supported extensions may be chained into the query
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        void** next = &features.pNext;
+        if (isExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+        {
+            *next = &timelineSemaphoreFeatures;
+            next = &timelineSemaphoreFeatures.pNext;
+        }
+        if (isExtensionSupported(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+        {
+            *next = &synchronization2Features;
+            next = &synchronization2Features.pNext;
+        }
+        if (isExtensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+        {
+            *next = &descriptorIndexingFeatures;
+            next = &descriptorIndexingFeatures.pNext;
+        }
+        vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features);
+
+        m_timelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+        m_synchronization2Supported = synchronization2Features.synchronization2 == VK_TRUE;
+        // what a texture array indexed per draw and updated while bound needs
+        m_descriptorIndexingSupported = m_deviceFeatures.shaderSampledImageArrayDynamicIndexing == VK_TRUE &&
+            descriptorIndexingFeatures.runtimeDescriptorArray == VK_TRUE &&
+            descriptorIndexingFeatures.descriptorBindingPartiallyBound == VK_TRUE &&
+            descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE;
+    }
+    if (m_timelineSemaphoreSupported)
+        extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    if (m_synchronization2Supported)
+        extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    if (m_descriptorIndexingSupported)
+        extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
     VkPhysicalDeviceFeatures requiredFeatures = {};
     requiredFeatures.robustBufferAccess = enableValidationLayers;
+    requiredFeatures.shaderSampledImageArrayDynamicIndexing = m_descriptorIndexingSupported;
 
     VkDeviceCreateInfo deviceCreateInfo = {
         VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,           // VkStructureType                    sType
         nullptr,                                        // const void                        *pNext
         0,                                              // VkDeviceCreateFlags                flags
-        1,                                              // uint32_t                           queueCreateInfoCount
-        &queueCreateInfo,                               // const VkDeviceQueueCreateInfo     *pQueueCreateInfos
+        static_cast<uint32_t>(queueCreateInfos.size()), // uint32_t                           queueCreateInfoCount
+        queueCreateInfos.data(),                        // const VkDeviceQueueCreateInfo     *pQueueCreateInfos
         0,                                              // uint32_t                           enabledLayerCount
         nullptr,                                        // const char * const                *ppEnabledLayerNames
         static_cast<uint32_t>(extensions.size()),       // uint32_t                           enabledExtensionCount
@@ -70,6 +152,26 @@ bool Device::init(VkInstance instance, VkSurfaceKHR surface, bool enableValidati
         &requiredFeatures                               // const VkPhysicalDeviceFeatures    *pEnabledFeatures
     };
 
+    // the queried feature structs have their feature set, so they enable it as they are
+    const void** next = &deviceCreateInfo.pNext;
+    if (m_timelineSemaphoreSupported)
+    {
+        timelineSemaphoreFeatures.pNext = nullptr;
+        *next = &timelineSemaphoreFeatures;
+        next = const_cast<const void**>(&timelineSemaphoreFeatures.pNext);
+    }
+    if (m_synchronization2Supported)
+    {
+        synchronization2Features.pNext = nullptr;
+        *next = &synchronization2Features;
+        next = const_cast<const void**>(&synchronization2Features.pNext);
+    }
+    if (m_descriptorIndexingSupported)
+    {
+        descriptorIndexingFeatures.pNext = nullptr;
+        *next = &descriptorIndexingFeatures;
+    }
+
     if (enableValidationLayers)
     {
         deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(debug::validationLayerNames.size());
@@ -78,11 +180,40 @@ bool Device::init(VkInstance instance, VkSurfaceKHR surface, bool enableValidati
 
     VK_CHECK_RESULT(vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_device));
 
-    vkGetDeviceQueue(m_device, queueFamilyIds.present, 0, &m_presentQueue.m_queue);
-    vkGetDeviceQueue(m_device, queueFamilyIds.graphics, 0, &m_graphicsQueue.m_queue);
-    vkGetDeviceQueue(m_device, queueFamilyIds.compute, 0, &m_computeQueue.m_queue);
+    if (m_timelineSemaphoreSupported)
+    {
+        m_vkWaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR"));
+        m_vkGetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR"));
+    }
+    if (m_synchronization2Supported)
+        m_vkCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(m_device, "vkCmdPipelineBarrier2KHR"));
+
+    const auto getQueue = [&](uint32_t queueFamily, Queue& queue)
+    {
+        vkGetDeviceQueue(m_device, queueFamily, 0, &queue.m_queue);
+        queue.m_queueFamilyIndex = queueFamily;
+        queue.m_device = m_device;
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &queue.m_blockingFence));
+    };
+
+    getQueue(queueFamilyIds.present, m_presentQueue);
+    getQueue(queueFamilyIds.graphics, m_graphicsQueue);
+    getQueue(queueFamilyIds.compute, m_computeQueue);
+    getQueue(queueFamilyIds.transfer, m_transferQueue);
 
     createCommandPools();
+    m_commandBufferCache = std::make_unique<CommandBufferCache>(*this, m_graphicsCommandPool);
+    if (m_computeCommandPool != m_graphicsCommandPool)
+        m_computeCommandBufferCache = std::make_unique<CommandBufferCache>(*this, m_computeCommandPool);
+    if (m_transferCommandPool != m_graphicsCommandPool)
+        m_transferCommandBufferCache = std::make_unique<CommandBufferCache>(*this, m_transferCommandPool);
+
+    m_memoryAllocator = std::make_unique<MemoryAllocator>(*this);
+    m_uploadManager = std::make_unique<UploadManager>(*this);
+    m_pipelineCache = std::make_unique<PipelineCache>(*this, PipelineCacheFilename);
 
     return true;
 }
@@ -113,6 +244,16 @@ bool Device::checkPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkSu
 
     vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, &queueProps[0]);
 
+    // Transfer only families usually map to dma engines, which copy while the graphics queue keeps working
+    for (uint32_t i = 0; i < queueCount; i++)
+    {
+        if ((queueProps[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && (queueProps[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+        {
+            queueFamilyIds.transfer = i;
+            break;
+        }
+    }
+
     // Some devices have dedicated compute queues, so we first try to find a queue that supports compute and not graphics
     bool computeQueueFound = false;
     for (uint32_t i = 0; i < queueCount; i++)
@@ -178,30 +319,89 @@ bool Device::checkPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkSu
         return false;
     }
 
+    return true;
+}
+
+bool Device::isExtensionSupported(const char* extensionName) const
+{
+    uint32_t extensionCount = 0;
+    VK_CHECK_RESULT(vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr));
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    VK_CHECK_RESULT(vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, extensions.data()));
+
+    return std::any_of(extensions.begin(), extensions.end(), [=](const auto& extension) {
+        return std::strcmp(extension.extensionName, extensionName) == 0; });
+}
+
+MemoryStats Device::memoryStats() const
+{
+    MemoryStats stats = m_memoryAllocator->memoryStats();
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    if (!memoryBudget(budgetProperties))
+        return stats;
+
+    for (auto i = 0u; i < stats.heaps.size(); ++i)
+    {
+        stats.heaps[i].budget = budgetProperties.heapBudget[i];
+        stats.heaps[i].usage = budgetProperties.heapUsage[i];
+    }
+    stats.hasBudget = true;
+
+    return stats;
+}
+
+bool Device::memoryBudget(VkPhysicalDeviceMemoryBudgetPropertiesEXT& budgetProperties) const
+{
+    if (!m_memoryBudgetSupported)
+        return false;
+
+    budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties = {};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties);
     return true;
 }
 
 void Device::createCommandPools()
 {
-    VkCommandPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = m_graphicsQueue.familyId();
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    const VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-    VK_CHECK_RESULT(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_graphicsCommandPool));
+    m_graphicsCommandPool = createCommandPool(m_graphicsQueue.familyId(), flags);
 
     if (m_graphicsQueue.familyId() != m_computeQueue.familyId())
     {
-        VkCommandPoolCreateInfo cmdPoolInfo = {};
-        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        cmdPoolInfo.queueFamilyIndex = m_computeQueue.familyId();
-        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-        VK_CHECK_RESULT(vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &m_computeCommandPool));
+        m_computeCommandPool = createCommandPool(m_computeQueue.familyId(), flags);
     }
     else
     {
         m_computeCommandPool = m_graphicsCommandPool;
     }
+
+    if (m_graphicsQueue.familyId() != m_transferQueue.familyId())
+    {
+        m_transferCommandPool = createCommandPool(m_transferQueue.familyId(), flags);
+    }
+    else
+    {
+        m_transferCommandPool = m_graphicsCommandPool;
+    }
+}
+
+VkCommandPool Device::createCommandPool(uint32_t queueFamilyId, VkCommandPoolCreateFlags flags) const
+{
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamilyId;
+    poolInfo.flags = flags;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateCommandPool(m_device, &poolInfo, nullptr, &commandPool));
+    return commandPool;
 }
 
 bool isDepthAttachment(VkFormat format)
@@ -209,7 +409,7 @@ bool isDepthAttachment(VkFormat format)
     return format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-VkRenderPass Device::createRenderPass(const std::vector<RenderPassAttachmentDescription>& attachmentDescriptions) const
+VkRenderPass Device::createRenderPass(const std::vector<RenderPassAttachmentDescription>& attachmentDescriptions, bool externalDependencies) const
 {
     assert(!attachmentDescriptions.empty());
 
@@ -306,8 +506,8 @@ VkRenderPass Device::createRenderPass(const std::vector<RenderPassAttachmentDesc
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-    renderPassInfo.pDependencies = dependencies.data();
+    renderPassInfo.dependencyCount = externalDependencies ? static_cast<uint32_t>(dependencies.size()) : 0;
+    renderPassInfo.pDependencies = externalDependencies ? dependencies.data() : nullptr;
 
     VkRenderPass renderPass;
     VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass));
@@ -333,6 +533,16 @@ VkFramebuffer Device::createFramebuffer(VkRenderPass renderPass, const std::vect
 
 VkPipelineLayout Device::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& layouts, const std::vector<VkPushConstantRange>& pushConstants) const
 {
+    // set layouts are shared, so equal ones have the same handle, the pipeline layout keeps them alive
+    HandleCache<VkPipelineLayout>::Key key = { layouts.size() };
+    for (auto layout : layouts)
+        key.push_back(handleKey(layout));
+    for (const auto& range : pushConstants)
+        key.insert(key.end(), { range.stageFlags, range.offset, range.size });
+
+    if (const auto cachedLayout = m_pipelineLayoutCache.acquire(key))
+        return cachedLayout;
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.flags = 0;
@@ -343,6 +553,14 @@ VkPipelineLayout Device::createPipelineLayout(const std::vector<VkDescriptorSetL
 
     VkPipelineLayout pipelineLayout;
     VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+    m_pipelineLayoutCache.add(key, pipelineLayout);
+
+    auto& setLayouts = m_pipelineLayoutSetLayouts[pipelineLayout];
+    for (auto layout : layouts)
+    {
+        if (m_descriptorSetLayoutCache.addReference(layout))
+            setLayouts.push_back(layout);
+    }
 
     return pipelineLayout;
 }
@@ -379,29 +597,83 @@ VkPipeline Device::createPipeline(VkRenderPass renderPass, VkPipelineLayout layo
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
+    const auto startTime = Timer::getMicroseconds();
     VkPipeline pipeline;
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, *m_pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+    m_pipelineCache->addCreationTime(Timer::getMicroseconds() - startTime);
     return pipeline;
 }
 
-VkDescriptorSetLayout Device::createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) const
+VkPipeline Device::createComputePipeline(VkPipelineLayout layout, const VkPipelineShaderStageCreateInfo& shaderStage) const
 {
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStage;
+    pipelineInfo.layout = layout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    const auto startTime = Timer::getMicroseconds();
+    VkPipeline pipeline;
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_device, *m_pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+    m_pipelineCache->addCreationTime(Timer::getMicroseconds() - startTime);
+    return pipeline;
+}
+
+VkDescriptorSetLayout Device::createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    const std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags) const
+{
+    HandleCache<VkDescriptorSetLayout>::Key key = { bindings.size() };
+    for (size_t i = 0; i < bindings.size(); i++)
+    {
+        const auto& binding = bindings[i];
+        key.insert(key.end(), { binding.binding, static_cast<uint64_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags,
+            i < bindingFlags.size() ? bindingFlags[i] : 0, binding.pImmutableSamplers != nullptr });
+        if (binding.pImmutableSamplers)
+        {
+            for (uint32_t j = 0; j < binding.descriptorCount; j++)
+                key.push_back(handleKey(binding.pImmutableSamplers[j]));
+        }
+    }
+
+    if (const auto cachedLayout = m_descriptorSetLayoutCache.acquire(key))
+        return cachedLayout;
+
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
     layoutInfo.pBindings = bindings.data();
 
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+    if (!bindingFlags.empty())
+    {
+        assert(m_descriptorIndexingSupported);
+        assert(bindingFlags.size() == bindings.size());
+
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+        layoutInfo.pNext = &bindingFlagsInfo;
+
+        for (auto flags : bindingFlags)
+        {
+            if (flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT)
+                layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        }
+    }
+
     VkDescriptorSetLayout layout;
     VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout));
+    m_descriptorSetLayoutCache.add(key, layout);
 
     return layout;
 }
 
-VkDescriptorPool Device::createDescriptorPool(uint32_t count, const std::vector<VkDescriptorPoolSize>& sizes, bool allowIndividualFreeing) const
+VkDescriptorPool Device::createDescriptorPool(uint32_t count, const std::vector<VkDescriptorPoolSize>& sizes,
+    VkDescriptorPoolCreateFlags flags) const
 {
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.flags = allowIndividualFreeing ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+    poolInfo.flags = flags;
     poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
     poolInfo.pPoolSizes = sizes.data();
     poolInfo.maxSets = count;
@@ -439,24 +711,42 @@ VkSampler Device::createSampler(bool clampToEdge) const
 
 uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
 {
-    return findMemoryType(m_physicalDevice, typeFilter, properties);
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+
+    const auto memoryTypeIndex = findMemoryType(memProperties, typeFilter, properties);
+    assert(memoryTypeIndex != ~0u && "Could not find requested memory type");
+    return memoryTypeIndex;
 }
 
-uint32_t Device::findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+uint32_t Device::findMemoryType(const VkPhysicalDeviceMemoryProperties& memProperties, uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
 {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    // never hand out memory with side effects nobody asked for
+    const VkMemoryPropertyFlags excluded = (VK_MEMORY_PROPERTY_PROTECTED_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) & ~required;
+
+    uint32_t bestType = ~0u;
+    int bestScore = 0;
+    VkDeviceSize bestHeapSize = 0;
 
     for (auto i = 0u; i < memProperties.memoryTypeCount; i++)
     {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        const auto flags = memProperties.memoryTypes[i].propertyFlags;
+        if (!(typeFilter & (1 << i)) || (flags & required) != required || (flags & excluded))
+            continue;
+
+        // preferred properties outweigh any unrequested ones, e.g. staging memory should not end up in the small bar heap
+        const int score = 4 * countBits(flags & preferred) - countBits(flags & ~(required | preferred));
+        const VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex].size;
+
+        if (bestType == ~0u || score > bestScore || (score == bestScore && heapSize > bestHeapSize))
         {
-            return i;
+            bestType = i;
+            bestScore = score;
+            bestHeapSize = heapSize;
         }
     }
 
-    assert(!"Could not find requested memory type");
-    return ~0u;
+    return bestType;
 }
 
 VkFormat Device::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const
@@ -481,34 +771,180 @@ VkFormat Device::findSupportedFormat(const std::vector<VkFormat>& candidates, Vk
 
 void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) const
 {
-    auto commandBuffer = createCommandBuffer();
+    auto commandBuffer = m_commandBufferCache->acquire();
     commandBuffer->begin();
     commandBuffer->copyBuffer(srcBuffer, dstBuffer, size);
     commandBuffer->end();
-    Queue(m_graphicsQueue).submitBlocking(*commandBuffer);
+    m_graphicsQueue.submitBlocking(*commandBuffer);
+    m_commandBufferCache->recycle(std::move(commandBuffer));
 }
 
 void Device::copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent2D resolution) const
 {
-    auto commandBuffer = createCommandBuffer();
+    auto commandBuffer = m_commandBufferCache->acquire();
     commandBuffer->begin();
     commandBuffer->copyBufferToImage(buffer, image, resolution);
     commandBuffer->end();
-    Queue(m_graphicsQueue).submitBlocking(*commandBuffer);
+    m_graphicsQueue.submitBlocking(*commandBuffer);
+    m_commandBufferCache->recycle(std::move(commandBuffer));
+}
+
+VkSemaphore Device::createSemaphore() const
+{
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+    return semaphore;
+}
+
+VkSemaphore Device::createTimelineSemaphore(uint64_t initialValue) const
+{
+    assert(m_timelineSemaphoreSupported);
+
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = initialValue;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+    return semaphore;
+}
+
+bool Device::waitSemaphore(VkSemaphore timelineSemaphore, uint64_t value, uint64_t timeout) const
+{
+    assert(m_timelineSemaphoreSupported);
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timelineSemaphore;
+    waitInfo.pValues = &value;
+
+    const auto result = m_vkWaitSemaphores(m_device, &waitInfo, timeout);
+    if (result == VK_TIMEOUT)
+        return false;
+
+    VK_CHECK_RESULT(result);
+    return true;
+}
+
+uint64_t Device::semaphoreValue(VkSemaphore timelineSemaphore) const
+{
+    assert(m_timelineSemaphoreSupported);
+
+    uint64_t value = 0;
+    VK_CHECK_RESULT(m_vkGetSemaphoreCounterValue(m_device, timelineSemaphore, &value));
+    return value;
+}
+
+void Device::pipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfoKHR& dependencyInfo) const
+{
+    assert(m_synchronization2Supported);
+    m_vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
 }
 
 CommandBufferPtr Device::createCommandBuffer() const
 {
-    return CommandBufferPtr(new CommandBuffer(*this, m_graphicsCommandPool));
+    return createCommandBuffer(m_graphicsCommandPool);
 }
 
 CommandBufferPtr Device::createComputeCommandBuffer() const
 {
-    return CommandBufferPtr(new CommandBuffer(*this, m_computeCommandPool));
+    return createCommandBuffer(m_computeCommandPool);
+}
+
+CommandBufferPtr Device::createTransferCommandBuffer() const
+{
+    return createCommandBuffer(m_transferCommandPool);
+}
+
+CommandBufferPtr Device::createCommandBuffer(VkCommandPool commandPool, VkCommandBufferLevel level) const
+{
+    return CommandBufferPtr(new CommandBuffer(*this, commandPool, level));
+}
+
+void Device::createThreadCommandPools(uint32_t threadCount, uint32_t frameCount)
+{
+    assert(m_threadCommandPools.empty());
+
+    // no individual reset, all command buffers of a frame are reset together
+    m_threadCommandPools.resize(threadCount * frameCount);
+    for (auto& commandPool : m_threadCommandPools)
+        commandPool = createCommandPool(m_graphicsQueue.familyId());
+    m_threadCommandPoolFrameCount = frameCount;
+}
+
+CommandBufferPtr Device::createSecondaryCommandBuffer(uint32_t threadId, uint32_t frameId) const
+{
+    assert(frameId < m_threadCommandPoolFrameCount);
+    const auto poolId = threadId * m_threadCommandPoolFrameCount + frameId;
+    assert(poolId < m_threadCommandPools.size());
+
+    return createCommandBuffer(m_threadCommandPools[poolId], VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+}
+
+void Device::resetThreadCommandPools(uint32_t frameId) const
+{
+    assert(frameId < m_threadCommandPoolFrameCount);
+
+    for (auto poolId = frameId; poolId < m_threadCommandPools.size(); poolId += m_threadCommandPoolFrameCount)
+        VK_CHECK_RESULT(vkResetCommandPool(m_device, m_threadCommandPools[poolId], 0));
+}
+
+void Device::destroy(VkDescriptorSetLayout layout) const
+{
+    if (layout != VK_NULL_HANDLE && m_descriptorSetLayoutCache.release(layout))
+        detail::destroy(*this, layout);
+}
+
+void Device::destroy(VkPipelineLayout layout) const
+{
+    if (layout == VK_NULL_HANDLE || !m_pipelineLayoutCache.release(layout))
+        return;
+
+    detail::destroy(*this, layout);
+
+    const auto iter = m_pipelineLayoutSetLayouts.find(layout);
+    assert(iter != m_pipelineLayoutSetLayouts.end());
+    const auto setLayouts = std::move(iter->second);
+    m_pipelineLayoutSetLayouts.erase(iter);
+    for (auto setLayout : setLayouts)
+        destroy(setLayout);
 }
 
 void Device::destroy()
 {
+    // layouts still referenced were leaked by their owners
+    for (auto layout : m_pipelineLayoutCache.takeAll())
+        detail::destroy(*this, layout);
+    m_pipelineLayoutSetLayouts.clear();
+    for (auto layout : m_descriptorSetLayoutCache.takeAll())
+        detail::destroy(*this, layout);
+
+    m_pipelineCache.reset();
+    m_uploadManager.reset();
+    m_memoryAllocator.reset();
+    m_transferCommandBufferCache.reset();
+    m_computeCommandBufferCache.reset();
+    m_commandBufferCache.reset();
+
+    for (auto commandPool : m_threadCommandPools)
+        vkDestroyCommandPool(m_device, commandPool, nullptr);
+    m_threadCommandPools.clear();
+
+    if (m_transferCommandPool != m_graphicsCommandPool)
+    {
+        vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+        m_transferCommandPool = VK_NULL_HANDLE;
+    }
+
     if (m_computeCommandPool != m_graphicsCommandPool)
     {
         vkDestroyCommandPool(m_device, m_computeCommandPool, nullptr);
@@ -518,6 +954,12 @@ void Device::destroy()
     vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);
     m_graphicsCommandPool = VK_NULL_HANDLE;
 
+    for (auto queue : { &m_presentQueue, &m_graphicsQueue, &m_computeQueue, &m_transferQueue })
+    {
+        vkDestroyFence(m_device, queue->m_blockingFence, nullptr);
+        queue->m_blockingFence = VK_NULL_HANDLE;
+    }
+
     vkDestroyDevice(m_device, nullptr);
     m_device = VK_NULL_HANDLE;
 }
@@ -37,6 +37,11 @@ namespace detail
         vkDestroyPipeline(device, pipeline, nullptr);
     }
 
+    void destroy(const Device& device, VkPipelineCache pipelineCache)
+    {
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+    }
+
     void destroy(const Device& device, VkRenderPass renderpass)
     {
         vkDestroyRenderPass(device, renderpass, nullptr);
@@ -56,5 +61,30 @@ namespace detail
     {
         vkDestroyDescriptorPool(device, pool, nullptr);
     }
+
+    void destroy(const Device& device, VkDescriptorUpdateTemplate updateTemplate)
+    {
+        vkDestroyDescriptorUpdateTemplate(device, updateTemplate, nullptr);
+    }
+
+    void destroy(const Device& device, VkFence fence)
+    {
+        vkDestroyFence(device, fence, nullptr);
+    }
+
+    void destroy(const Device& device, VkSemaphore semaphore)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+
+    void destroy(const Device& device, VkCommandPool commandPool)
+    {
+        vkDestroyCommandPool(device, commandPool, nullptr);
+    }
+
+    void destroy(const Device& device, const MemoryAllocation& allocation)
+    {
+        device.memoryAllocator().free(allocation);
+    }
 }
 
@@ -0,0 +1,51 @@
+#include "framedescriptorset.h"
+#include "frameringbuffer.h"
+#include "device.h"
+#include "commandbuffer.h"
+
+#include <cassert>
+
+namespace
+{
+    const uint32_t BINDING_ID_FRAME = 0;
+}
+
+const VkPushConstantRange FrameDescriptorSet::PushConstantRange = { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, CommandBuffer::MaxPushConstantSize };
+
+FrameDescriptorSet::FrameDescriptorSet(const Device& device, const FrameRingBuffer& ringBuffer)
+    : DeviceRef(device)
+    , m_descriptorAllocator(device, 1, { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 } })
+{
+    m_layout = device.createDescriptorSetLayout({ { BINDING_ID_FRAME, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT } });
+    m_pipelineLayout = createPipelineLayout();
+
+    // the set always points to the ring buffer, the parameters of a frame are selected by the offset
+    m_descriptorSet.setDynamicUniformBuffer(BINDING_ID_FRAME, ringBuffer.buffer(), sizeof(Parameter));
+    m_descriptorSet.allocateAndUpdate(m_descriptorAllocator, m_layout);
+}
+
+FrameDescriptorSet::~FrameDescriptorSet()
+{
+    destroy(m_pipelineLayout);
+    destroy(m_layout);
+}
+
+void FrameDescriptorSet::update(FrameRingBuffer& ringBuffer, const Parameter& parameter)
+{
+    const auto allocation = ringBuffer.pushUniform(parameter);
+    assert(allocation.isValid());
+    m_offset = allocation.offset;
+}
+
+void FrameDescriptorSet::bind(VkCommandBuffer commandBuffer) const
+{
+    const VkDescriptorSet descriptorSet = m_descriptorSet;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, SetId, 1, &descriptorSet, 1, &m_offset);
+}
+
+VkPipelineLayout FrameDescriptorSet::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts) const
+{
+    std::vector<VkDescriptorSetLayout> layouts = { m_layout };
+    layouts.insert(layouts.end(), setLayouts.begin(), setLayouts.end());
+    return device().createPipelineLayout(layouts, { PushConstantRange });
+}
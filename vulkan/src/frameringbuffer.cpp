@@ -0,0 +1,91 @@
+#include "frameringbuffer.h"
+#include "device.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <iostream>
+
+namespace
+{
+    // upper bound of all the offset alignments the spec allows
+    constexpr VkDeviceSize MaxAlignment = 256;
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+FrameRingBuffer::FrameRingBuffer(const Device& device, VkDeviceSize size, uint32_t frameCount)
+    : DeviceRef(device)
+    , m_buffer(device, alignUp(size, MaxAlignment))
+    , m_frameEnds(frameCount, 0)
+{
+    m_data = static_cast<uint8_t*>(m_buffer.data());
+}
+
+FrameRingBuffer::FrameRingBuffer(FrameRingBuffer&& other)
+{
+    swap(other);
+}
+
+FrameRingBuffer& FrameRingBuffer::operator=(FrameRingBuffer&& other)
+{
+    swap(other);
+    return *this;
+}
+
+void FrameRingBuffer::beginFrame(uint32_t frameId)
+{
+    assert(frameId < m_frameEnds.size());
+
+    // everything written up to the end of the previous use of this frame resource is no longer in flight
+    m_tail = std::max(m_tail, m_frameEnds[frameId]);
+    m_frameEnds[frameId] = m_head;
+    m_currentFrame = frameId;
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    assert(alignment <= MaxAlignment && (alignment & (alignment - 1)) == 0);
+
+    const VkDeviceSize capacity = m_buffer.size();
+    VkDeviceSize begin = alignUp(m_head, alignment);
+
+    // allocations never wrap around the end of the buffer
+    if (begin % capacity + size > capacity)
+        begin = (begin / capacity + 1) * capacity;
+
+    if (begin + size - m_tail > capacity)
+    {
+        std::cout << "Frame ring buffer is out of memory, " << size << " bytes requested!" << std::endl;
+        return {};
+    }
+
+    m_head = begin + size;
+    m_frameEnds[m_currentFrame] = m_head;
+
+    const VkDeviceSize offset = begin % capacity;
+    return { m_data + offset, m_buffer.buffer(), static_cast<uint32_t>(offset), size };
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::allocateUniform(VkDeviceSize size)
+{
+    return allocate(size, std::max<VkDeviceSize>(device().properties().limits.minUniformBufferOffsetAlignment, 16));
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::allocateStorage(VkDeviceSize size)
+{
+    return allocate(size, std::max<VkDeviceSize>(device().properties().limits.minStorageBufferOffsetAlignment, 16));
+}
+
+void FrameRingBuffer::swap(FrameRingBuffer& other)
+{
+    DeviceRef::swap(other);
+    std::swap(m_buffer, other.m_buffer);
+    std::swap(m_data, other.m_data);
+    std::swap(m_head, other.m_head);
+    std::swap(m_tail, other.m_tail);
+    std::swap(m_frameEnds, other.m_frameEnds);
+    std::swap(m_currentFrame, other.m_currentFrame);
+}
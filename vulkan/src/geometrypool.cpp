@@ -0,0 +1,211 @@
+#include "geometrypool.h"
+#include "device.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+GeometryPageAllocator::GeometryPageAllocator(uint32_t verticesPerPage, uint32_t indicesPerPage)
+    : m_verticesPerPage(verticesPerPage)
+    , m_indicesPerPage(indicesPerPage)
+{
+}
+
+bool GeometryPageAllocator::tryAllocate(Page& page, uint32_t vertexCount, uint32_t indexCount, Range& range) const
+{
+    range.vertices = page.vertexAllocator.allocate(vertexCount, 1);
+    if (range.vertices.handle == TlsfAllocator::InvalidHandle)
+        return false;
+
+    range.indices = {};
+    if (indexCount > 0)
+    {
+        range.indices = page.indexAllocator.allocate(indexCount, 1);
+        if (range.indices.handle == TlsfAllocator::InvalidHandle)
+        {
+            page.vertexAllocator.free(range.vertices.handle);
+            return false;
+        }
+    }
+    return true;
+}
+
+GeometryPageAllocator::Range GeometryPageAllocator::allocate(uint32_t vertexCount, uint32_t indexCount)
+{
+    assert(vertexCount > 0);
+
+    Range range;
+    for (auto i = 0u; i < m_pages.size(); i++)
+    {
+        if (tryAllocate(m_pages[i], vertexCount, indexCount, range))
+        {
+            range.page = i;
+            return range;
+        }
+    }
+
+    // the allocators round every range up to their minimum alignment
+    Page page;
+    page.vertexAllocator = TlsfAllocator(alignUp(std::max(vertexCount, m_verticesPerPage), TlsfAllocator::MinAlignment));
+    page.indexAllocator = TlsfAllocator(alignUp(std::max(indexCount, m_indicesPerPage), TlsfAllocator::MinAlignment));
+    if (!tryAllocate(page, vertexCount, indexCount, range))
+        return {};
+
+    range.page = static_cast<uint32_t>(m_pages.size());
+    m_pages.push_back(std::move(page));
+    return range;
+}
+
+void GeometryPageAllocator::free(const Range& range)
+{
+    if (!range.isValid())
+        return;
+
+    auto& page = m_pages[range.page];
+    page.vertexAllocator.free(range.vertices.handle);
+    if (range.indices.handle != TlsfAllocator::InvalidHandle)
+        page.indexAllocator.free(range.indices.handle);
+}
+
+void GeometryPageAllocator::removeLastPage()
+{
+    assert(!m_pages.empty());
+    m_pages.pop_back();
+}
+
+GeometryPool::GeometryPool(const Device& device, uint32_t vertexSize, const std::vector<VertexBuffer::InterleavedAttributeDescription>& descriptions,
+    uint32_t verticesPerPage, uint32_t indicesPerPage)
+    : DeviceRef(device)
+    , m_vertexSize(vertexSize)
+    , m_descriptions(descriptions)
+    , m_pageAllocator(verticesPerPage, indicesPerPage)
+{
+    m_attributesDescriptions.resize(descriptions.size());
+    for (auto i = 0u; i < descriptions.size(); i++)
+    {
+        const auto& desc = descriptions[i];
+
+        VkVertexInputAttributeDescription& attribDesc = m_attributesDescriptions[i];
+        attribDesc.binding = 0;
+        attribDesc.location = desc.location;
+        attribDesc.format = VertexBuffer::attributeFormat(desc.componentCount);
+        attribDesc.offset = desc.interleavedOffset;
+    }
+
+    m_bindingDescriptions.assign(1, { 0, vertexSize, VK_VERTEX_INPUT_RATE_VERTEX });
+}
+
+GeometryPool::~GeometryPool()
+{
+    m_pages.clear();
+}
+
+bool GeometryPool::isCompatible(uint32_t vertexSize, const std::vector<VertexBuffer::InterleavedAttributeDescription>& descriptions) const
+{
+    auto isEqual = [](const VertexBuffer::InterleavedAttributeDescription& a, const VertexBuffer::InterleavedAttributeDescription& b)
+    {
+        return a.location == b.location && a.componentCount == b.componentCount && a.interleavedOffset == b.interleavedOffset;
+    };
+
+    return vertexSize == m_vertexSize && std::equal(descriptions.begin(), descriptions.end(), m_descriptions.begin(), m_descriptions.end(), isEqual);
+}
+
+GeometryPool::Allocation GeometryPool::allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+{
+    const auto bytes = static_cast<const uint8_t*>(vertices);
+    return allocate([bytes](void* destination, uint64_t offset, uint64_t size) { std::memcpy(destination, bytes + offset, size); },
+        vertexCount, indices, indexCount);
+}
+
+GeometryPool::Allocation GeometryPool::allocate(const BufferBase::WriteFunc& writeVertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+{
+    assert(vertexCount > 0);
+
+    // ranges are counted in vertices and indices, so offsets can be passed to vkCmdDrawIndexed as they are
+    const auto range = m_pageAllocator.allocate(vertexCount, indexCount);
+    if (range.isValid() && range.page == m_pages.size())
+    {
+        auto page = createPage(m_pageAllocator.vertexCapacity(range.page), m_pageAllocator.indexCapacity(range.page));
+        if (!page)
+            m_pageAllocator.removeLastPage();
+        else
+            m_pages.push_back(std::move(page));
+    }
+
+    if (!range.isValid() || range.page >= m_pages.size())
+    {
+        std::cout << "Geometry pool could not allocate " << vertexCount << " vertices and " << indexCount << " indices!" << std::endl;
+        return {};
+    }
+
+    Allocation allocation;
+    allocation.page = range.page;
+    auto& page = *m_pages[allocation.page];
+    allocation.vertexOffset = static_cast<int32_t>(range.vertices.offset);
+    allocation.vertexCount = vertexCount;
+    allocation.vertexHandle = range.vertices.handle;
+    page.buffer.upload(writeVertices, static_cast<VkDeviceSize>(vertexCount) * m_vertexSize, range.vertices.offset * m_vertexSize);
+
+    if (indexCount > 0)
+    {
+        allocation.firstIndex = static_cast<uint32_t>(range.indices.offset);
+        allocation.indexCount = indexCount;
+        allocation.indexHandle = range.indices.handle;
+        page.buffer.upload(indices, static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t), page.indexOffset + range.indices.offset * sizeof(uint32_t));
+    }
+
+    return allocation;
+}
+
+void GeometryPool::free(Allocation& allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    GeometryPageAllocator::Range range;
+    range.page = allocation.page;
+    range.vertices.handle = allocation.vertexHandle;
+    range.indices.handle = allocation.indexHandle;
+    m_pageAllocator.free(range);
+
+    allocation = {};
+}
+
+void GeometryPool::bind(VkCommandBuffer commandBuffer, uint32_t page) const
+{
+    const auto& pageData = *m_pages[page];
+    const VkBuffer buffer = pageData.buffer.buffer();
+    const VkDeviceSize offset = 0;
+
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, buffer, pageData.indexOffset, VK_INDEX_TYPE_UINT32);
+}
+
+void GeometryPool::drawIndexed(VkCommandBuffer commandBuffer, const Allocation& allocation, uint32_t firstIndex, uint32_t indexCount, uint32_t instanceCount) const
+{
+    assert(allocation.isValid() && allocation.indexCount > 0);
+    assert(firstIndex + indexCount <= allocation.indexCount);
+
+    vkCmdDrawIndexed(commandBuffer, indexCount == 0 ? allocation.indexCount - firstIndex : indexCount, instanceCount,
+        allocation.firstIndex + firstIndex, allocation.vertexOffset, 0);
+}
+
+std::unique_ptr<GeometryPool::Page> GeometryPool::createPage(uint64_t vertexCapacity, uint64_t indexCapacity) const
+{
+    auto page = std::make_unique<Page>();
+    page->indexOffset = alignUp(vertexCapacity * m_vertexSize, sizeof(uint32_t));
+    page->buffer = GPUGeometryBuffer(device(), page->indexOffset + indexCapacity * sizeof(uint32_t), BufferSource::Cpu);
+    if (!page->buffer.isValid())
+        return nullptr;
+
+    return page;
+}
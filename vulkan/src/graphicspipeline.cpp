@@ -6,8 +6,16 @@
 namespace std
 {
     template<>
-    struct hash<GraphicsPipelineSettings> : public BitwiseHash<GraphicsPipelineSettings>
-    {};
+    struct hash<GraphicsPipelineSettings>
+    {
+        std::size_t operator()(const GraphicsPipelineSettings& settings) const
+        {
+            // pAttachments points into the settings object itself, equal settings of different objects only hash equal without it
+            auto values = settings;
+            values.colorBlending.pAttachments = nullptr;
+            return BitwiseHash<GraphicsPipelineSettings>()(values);
+        }
+    };
 
     template<>
     struct hash<VkPipelineShaderStageCreateInfo> : public BitwiseHash<VkPipelineShaderStageCreateInfo>
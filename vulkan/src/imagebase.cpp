@@ -30,7 +30,7 @@ namespace
         return (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
 
-    std::pair<VkImage, VkDeviceMemory> createImage(const Device& device, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage)
+    std::pair<VkImage, MemoryAllocation> createImage(const Device& device, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage)
     {
         VkImageCreateInfo imageInfo = {};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -53,16 +53,11 @@ namespace
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = device.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        const auto category = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) ? MemoryCategory::RenderTarget : MemoryCategory::Texture;
+        const auto allocation = device.memoryAllocator().allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, category, false);
+        VK_CHECK_RESULT(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
 
-        VkDeviceMemory imageMemory;
-        VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device, image, imageMemory, 0));
-
-        return { image, imageMemory };
+        return { image, allocation };
     }
 
     VkImageView createImageView(const Device& device, VkImage image, VkFormat format)
@@ -93,21 +88,24 @@ namespace
 }
 
 ImageBase::ImageBase(const Device& device, uint8_t* pixelData, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage)
+    : ImageBase(device, [pixelData](void* destination, uint64_t offset, uint64_t size) { std::memcpy(destination, pixelData + offset, size); },
+        resolution, format, usage)
+{
+}
+
+ImageBase::ImageBase(const Device& device, const WriteFunc& writeFunc, VkExtent2D resolution, VkFormat format, VkImageUsageFlags usage)
     : DeviceRef(device)
     , m_format(format)
     , m_resolution(resolution)
 {
     assert(format == VK_FORMAT_R8G8B8A8_UNORM);
 
-    std::tie(m_image, m_memory) = createImage(device, resolution, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
-    setLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    std::tie(m_image, m_allocation) = createImage(device, resolution, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
     
-    const uint64_t imageSize = resolution.width * resolution.height * 4;
-    StagingBuffer stagingBuffer(device, imageSize);
-    stagingBuffer.assign(pixelData, imageSize);
+    // the upload manager does the layout transitions around the copy
+    m_layout = getNewImageLayout(usage);
+    device.uploadManager().uploadImage(writeFunc, m_image, format, resolution, m_layout);
 
-    device.copyBufferToImage(stagingBuffer, m_image, resolution);
-    setLayout(getNewImageLayout(usage));
     m_imageView = createImageView(device, m_image, format);
 }
 
@@ -116,7 +114,7 @@ ImageBase::ImageBase(const Device& device, VkExtent2D resolution, VkFormat forma
     , m_format(format)
     , m_resolution(resolution)
 {
-    std::tie(m_image, m_memory) = createImage(device, resolution, format, usage);
+    std::tie(m_image, m_allocation) = createImage(device, resolution, format, usage);
     setLayout(getNewImageLayout(usage));
     m_imageView = createImageView(device, m_image, format);
 }
@@ -125,7 +123,7 @@ ImageBase::~ImageBase()
 {
     destroy(m_imageView);
     destroy(m_image);
-    destroy(m_memory);
+    destroy(m_allocation);
 }
 
 ImageBase::operator bool() const
@@ -160,7 +158,7 @@ VkImage ImageBase::image() const
 
 VkDeviceMemory ImageBase::memory() const
 {
-    return m_memory;
+    return m_allocation.memory;
 }
 
 VkFormat ImageBase::format() const
@@ -173,12 +171,17 @@ VkExtent2D ImageBase::resolution() const
     return m_resolution;
 }
 
+MemoryCategory ImageBase::memoryCategory() const
+{
+    return m_allocation.category;
+}
+
 void ImageBase::swap(ImageBase& other)
 {
     DeviceRef::swap(other);
     std::swap(m_image, other.m_image);
     std::swap(m_imageView, other.m_imageView);
-    std::swap(m_memory, other.m_memory);
+    std::swap(m_allocation, other.m_allocation);
     std::swap(m_layout, other.m_layout);
     std::swap(m_format, other.m_format);
     std::swap(m_resolution, other.m_resolution);    
@@ -187,15 +190,13 @@ void ImageBase::swap(ImageBase& other)
 
 void ImageBase::setLayout(VkImageLayout newLayout)
 {
-    const auto barrier = createImageMemoryBarrier(m_image, m_format, m_layout, newLayout);
-    const auto sourceStage = getPipelineStageFlags(barrier.srcAccessMask);
-    const auto destinationStage = getPipelineStageFlags(barrier.dstAccessMask);
-
-    auto commandBuffer = device().createCommandBuffer();
-    commandBuffer->begin();
-    commandBuffer->pipelineBarrier(sourceStage, destinationStage, barrier);
-    commandBuffer->end();
-    device().graphicsQueue().submitBlocking(*commandBuffer);
+    device().uploadManager().transitionImageLayout(m_image, m_format, m_layout, newLayout);
+    m_layout = newLayout;
+}
 
+void ImageBase::setLayout(VkImageLayout newLayout, CommandBuffer& commandBuffer)
+{
+    // batched with the other pending barriers of the command buffer
+    commandBuffer.imageAccess(m_image, createImageSubresourceRange(m_format), m_layout, getLayoutAccess(newLayout));
     m_layout = newLayout;
 }
@@ -0,0 +1,355 @@
+#include "memoryallocator.h"
+#include "device.h"
+#include "vulkanhelper.h"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr VkDeviceSize PreferredBlockSize = 64ull * 1024 * 1024;
+
+    // share of a heap that may be filled because of preferred (not required) properties, when the budget is unknown
+    constexpr VkDeviceSize PreferredHeapBudgetDivisor = 2;
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+struct MemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mappedData = nullptr;
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    bool linear = true;
+    TlsfAllocator allocator;
+};
+
+MemoryAllocator::MemoryAllocator(const Device& device)
+    : DeviceRef(device)
+{
+    vkGetPhysicalDeviceMemoryProperties(device.vkPysicalDevice(), &m_memoryProperties);
+    m_nonCoherentAtomSize = std::max<VkDeviceSize>(device.properties().limits.nonCoherentAtomSize, 1);
+
+    // small heaps (e.g. the 256MB device local + host visible heap) get smaller blocks
+    for (auto i = 0u; i < m_memoryProperties.memoryHeapCount; ++i)
+        m_blockSizes[i] = std::min(PreferredBlockSize, m_memoryProperties.memoryHeaps[i].size / 8);
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    for (auto& blocks : m_blocks)
+    {
+        for (auto& block : blocks)
+        {
+            if (!block->allocator.empty())
+                std::cout << "Memory block of type " << block->memoryTypeIndex << " still has " << block->allocator.allocationCount() << " live allocations!" << std::endl;
+            destroyBlock(*block);
+        }
+        blocks.clear();
+    }
+
+    if (m_dedicatedAllocationCount != 0)
+        std::cout << m_dedicatedAllocationCount << " dedicated memory allocations were not freed!" << std::endl;
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags properties, MemoryCategory category, bool linearResource, VkMemoryPropertyFlags preferredProperties)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint32_t memoryTypeIndex = findMemoryType(memoryRequirements, properties, preferredProperties);
+
+    // non coherent allocations cover whole atoms, so flushing or invalidating never touches a neighbour
+    VkMemoryRequirements requirements = memoryRequirements;
+    if (isNonCoherent(memoryTypeIndex))
+    {
+        requirements.size = alignUp(requirements.size, m_nonCoherentAtomSize);
+        requirements.alignment = std::max(requirements.alignment, m_nonCoherentAtomSize);
+    }
+
+    const VkDeviceSize blockSize = m_blockSizes[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+
+    MemoryAllocation allocation = requirements.size > blockSize / 2 ?
+        allocateDedicated(requirements, memoryTypeIndex) :
+        allocateFromBlocks(requirements, memoryTypeIndex, linearResource);
+
+    allocation.category = category;
+    auto& categoryStats = m_categoryStats[static_cast<size_t>(category)];
+    categoryStats.bytes += allocation.size;
+    ++categoryStats.allocationCount;
+
+    return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateFromBlocks(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linearResource)
+{
+    auto tryAllocate = [&](MemoryBlock& block) -> MemoryAllocation
+    {
+        const auto range = block.allocator.allocate(requirements.size, requirements.alignment);
+        if (range.handle == TlsfAllocator::InvalidHandle)
+            return {};
+
+        MemoryAllocation allocation;
+        allocation.memory = block.memory;
+        allocation.offset = range.offset;
+        allocation.size = range.size;
+        allocation.mappedData = block.mappedData ? static_cast<uint8_t*>(block.mappedData) + range.offset : nullptr;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.isCoherent = !isNonCoherent(memoryTypeIndex);
+        allocation.block = &block;
+        allocation.handle = range.handle;
+        return allocation;
+    };
+
+    for (auto& block : m_blocks[memoryTypeIndex])
+    {
+        if (block->linear != linearResource)
+            continue;
+
+        const auto allocation = tryAllocate(*block);
+        if (allocation.isValid())
+            return allocation;
+    }
+
+    MemoryBlock* block = createBlock(memoryTypeIndex, linearResource);
+    const auto allocation = tryAllocate(*block);
+    assert(allocation.isValid());
+    return allocation;
+}
+
+void MemoryAllocator::free(const MemoryAllocation& allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto& categoryStats = m_categoryStats[static_cast<size_t>(allocation.category)];
+    categoryStats.bytes -= allocation.size;
+    --categoryStats.allocationCount;
+
+    if (allocation.block == nullptr)
+    {
+        --m_dedicatedAllocationCount;
+        m_dedicatedAllocationBytes -= allocation.size;
+        m_heapUsage[m_memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex] -= allocation.size;
+        destroy(allocation.memory);
+        return;
+    }
+
+    MemoryBlock& block = *allocation.block;
+    block.allocator.free(allocation.handle);
+
+    // keep one empty block per memory type around to avoid allocation ping pong
+    if (block.allocator.empty())
+    {
+        auto& blocks = m_blocks[block.memoryTypeIndex];
+        const auto emptyBlocks = std::count_if(blocks.begin(), blocks.end(), [](const auto& b) { return b->allocator.empty(); });
+        if (emptyBlocks > 1)
+        {
+            destroyBlock(block);
+            blocks.erase(std::find_if(blocks.begin(), blocks.end(), [&](const auto& b) { return b.get() == &block; }));
+        }
+    }
+}
+
+void MemoryAllocator::recordUpload(VkDeviceSize size, bool direct)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    (direct ? m_directUploadBytes : m_stagedUploadBytes) += size;
+}
+
+void MemoryAllocator::flush(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    if (allocation.isCoherent || !allocation.isValid())
+        return;
+
+    const auto range = mappedMemoryRange(allocation, offset, size);
+    VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device(), 1, &range));
+}
+
+void MemoryAllocator::invalidate(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    if (allocation.isCoherent || !allocation.isValid())
+        return;
+
+    const auto range = mappedMemoryRange(allocation, offset, size);
+    VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(device(), 1, &range));
+}
+
+MemoryAllocatorStats MemoryAllocator::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryAllocatorStats stats;
+    stats.dedicatedAllocationCount = m_dedicatedAllocationCount;
+    stats.allocationCount = m_dedicatedAllocationCount;
+    stats.reservedBytes = m_dedicatedAllocationBytes;
+    stats.usedBytes = m_dedicatedAllocationBytes;
+    stats.directUploadBytes = m_directUploadBytes;
+    stats.stagedUploadBytes = m_stagedUploadBytes;
+
+    VkDeviceSize freeBytes = 0;
+    for (const auto& blocks : m_blocks)
+    {
+        for (const auto& block : blocks)
+        {
+            const auto blockStats = block->allocator.stats();
+            stats.blockCount++;
+            stats.allocationCount += blockStats.allocationCount;
+            stats.reservedBytes += block->allocator.size();
+            stats.usedBytes += blockStats.usedBytes;
+            stats.largestFreeRange = std::max(stats.largestFreeRange, blockStats.largestFreeRange);
+            freeBytes += blockStats.freeBytes;
+        }
+    }
+
+    if (freeBytes > 0)
+        stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes);
+
+    return stats;
+}
+
+MemoryStats MemoryAllocator::memoryStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryStats stats;
+    stats.heaps.resize(m_memoryProperties.memoryHeapCount);
+    for (auto i = 0u; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        auto& heap = stats.heaps[i];
+        heap.size = m_memoryProperties.memoryHeaps[i].size;
+        heap.budget = heap.size;
+        heap.usage = m_heapUsage[i];
+        heap.allocatedBytes = m_heapUsage[i];
+        heap.deviceLocal = (m_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+    stats.categories = m_categoryStats;
+
+    return stats;
+}
+
+uint32_t MemoryAllocator::findMemoryType(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties) const
+{
+    const uint32_t requiredType = Device::findMemoryType(m_memoryProperties, requirements.memoryTypeBits, properties);
+    assert(requiredType != ~0u && "Could not find requested memory type");
+    if (preferredProperties == 0)
+        return requiredType;
+
+    const uint32_t preferredType = Device::findMemoryType(m_memoryProperties, requirements.memoryTypeBits, properties, preferredProperties);
+    const uint32_t heapIndex = m_memoryProperties.memoryTypes[preferredType].heapIndex;
+    if (preferredType == requiredType || heapIndex == m_memoryProperties.memoryTypes[requiredType].heapIndex)
+        return preferredType;
+
+    // a different heap (e.g. the bar window of a discrete gpu) is only used while it is not too crowded,
+    // with VK_EXT_memory_budget the memory other processes use in it counts as well
+    const VkDeviceSize newBytes = std::max(requirements.size, m_blockSizes[heapIndex]);
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties;
+    if (device().memoryBudget(budgetProperties))
+        return budgetProperties.heapUsage[heapIndex] + newBytes <= budgetProperties.heapBudget[heapIndex] ? preferredType : requiredType;
+
+    const VkDeviceSize budget = m_memoryProperties.memoryHeaps[heapIndex].size / PreferredHeapBudgetDivisor;
+    return m_heapUsage[heapIndex] + newBytes <= budget ? preferredType : requiredType;
+}
+
+const char* memoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+    case MemoryCategory::Geometry: return "Geometry";
+    case MemoryCategory::Texture: return "Texture";
+    case MemoryCategory::RenderTarget: return "Render target";
+    case MemoryCategory::Staging: return "Staging";
+    case MemoryCategory::Uniform: return "Uniform";
+    default:
+        assert(!"Unknown memory category");
+        return "";
+    }
+}
+
+MemoryAllocation MemoryAllocator::allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex)
+{
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    MemoryAllocation allocation;
+    VK_CHECK_RESULT(vkAllocateMemory(device(), &allocInfo, nullptr, &allocation.memory));
+    allocation.size = requirements.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.isCoherent = !isNonCoherent(memoryTypeIndex);
+    allocation.mappedData = mapMemory(allocation.memory, memoryTypeIndex);
+
+    ++m_dedicatedAllocationCount;
+    m_dedicatedAllocationBytes += requirements.size;
+    m_heapUsage[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += requirements.size;
+
+    return allocation;
+}
+
+MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, bool linearResource)
+{
+    const VkDeviceSize blockSize = m_blockSizes[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = blockSize;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    auto block = std::make_unique<MemoryBlock>();
+    VK_CHECK_RESULT(vkAllocateMemory(device(), &allocInfo, nullptr, &block->memory));
+    block->mappedData = mapMemory(block->memory, memoryTypeIndex);
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->linear = linearResource;
+    block->allocator = TlsfAllocator(blockSize);
+    m_heapUsage[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += blockSize;
+
+    m_blocks[memoryTypeIndex].push_back(std::move(block));
+    return m_blocks[memoryTypeIndex].back().get();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock& block)
+{
+    m_heapUsage[m_memoryProperties.memoryTypes[block.memoryTypeIndex].heapIndex] -= block.allocator.size();
+    destroy(block.memory);
+    block.memory = VK_NULL_HANDLE;
+    block.mappedData = nullptr;
+}
+
+void* MemoryAllocator::mapMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) const
+{
+    // host visible memory stays mapped for its whole lifetime, so sub-allocations never map the same memory twice
+    if ((m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0)
+        return nullptr;
+
+    void* data;
+    VK_CHECK_RESULT(vkMapMemory(device(), memory, 0, VK_WHOLE_SIZE, 0, &data));
+    return data;
+}
+
+bool MemoryAllocator::isNonCoherent(uint32_t memoryTypeIndex) const
+{
+    const auto flags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+VkMappedMemoryRange MemoryAllocator::mappedMemoryRange(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    assert(offset <= allocation.size);
+    if (size == VK_WHOLE_SIZE)
+        size = allocation.size - offset;
+
+    // allocation offset and size are multiples of the atom size, so the aligned range stays inside the allocation
+    const VkDeviceSize begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    const VkDeviceSize end = std::min(alignUp(allocation.offset + offset + size, m_nonCoherentAtomSize), allocation.offset + allocation.size);
+
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+    return range;
+}
@@ -0,0 +1,154 @@
+#include "parallelrecorder.h"
+#include "commandbuffer.h"
+#include "device.h"
+
+#include <algorithm>
+#include <assert.h>
+
+ParallelRecorder::ParallelRecorder(const Device& device, uint32_t threadCount, uint32_t frameCount)
+    : DeviceRef(device)
+    , m_threadData(std::max(threadCount, 1u))
+{
+    for (auto& threadData : m_threadData)
+        threadData.commandBuffers.resize(frameCount);
+
+    // the calling thread records the first range
+    for (auto threadId = 1u; threadId < m_threadData.size(); threadId++)
+        m_workers.emplace_back(&ParallelRecorder::workerLoop, this, threadId);
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_jobCondition.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void ParallelRecorder::beginFrame(uint32_t frameId)
+{
+    assert(!isRecording());
+    assert(frameId < m_threadData.front().commandBuffers.size());
+
+    m_frameId = frameId;
+    device().resetThreadCommandPools(frameId);
+    for (auto& threadData : m_threadData)
+        threadData.usedCount = 0;
+}
+
+void ParallelRecorder::beginRenderPass(CommandBuffer& commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+    const VkClearColorValue* clearColor)
+{
+    assert(!isRecording());
+
+    commandBuffer.beginRenderPass(renderPass, framebuffer, extent, clearColor, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    m_commandBuffer = &commandBuffer;
+    m_renderPass = renderPass;
+    m_framebuffer = framebuffer;
+    m_extent = extent;
+}
+
+void ParallelRecorder::endRenderPass()
+{
+    assert(isRecording());
+
+    m_commandBuffer->endRenderPass();
+    m_commandBuffer = nullptr;
+}
+
+void ParallelRecorder::record(uint32_t drawCount, const RecordFunc& recordFunc)
+{
+    assert(isRecording());
+
+    m_recordedCommandBuffers.assign(m_threadData.size(), VK_NULL_HANDLE);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_recordFunc = &recordFunc;
+        m_drawCount = drawCount;
+        m_pendingWorkers = static_cast<uint32_t>(m_workers.size());
+        ++m_generation;
+    }
+    m_jobCondition.notify_all();
+
+    recordRange(0);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCondition.wait(lock, [this]() { return m_pendingWorkers == 0; });
+        m_recordFunc = nullptr;
+    }
+
+    // threads without draws did not record anything
+    m_recordedCommandBuffers.erase(std::remove(m_recordedCommandBuffers.begin(), m_recordedCommandBuffers.end(), VK_NULL_HANDLE), m_recordedCommandBuffers.end());
+    m_commandBuffer->executeCommands(m_recordedCommandBuffers);
+}
+
+void ParallelRecorder::recordOnCallingThread(const std::function<void(CommandBuffer&)>& recordFunc)
+{
+    assert(isRecording());
+
+    auto& commandBuffer = nextCommandBuffer(0);
+    commandBuffer.beginSecondary(m_renderPass, m_framebuffer, m_extent);
+    recordFunc(commandBuffer);
+    commandBuffer.end();
+
+    m_commandBuffer->executeCommands({ commandBuffer });
+}
+
+CommandBuffer& ParallelRecorder::nextCommandBuffer(uint32_t threadId)
+{
+    auto& threadData = m_threadData[threadId];
+    auto& commandBuffers = threadData.commandBuffers[m_frameId];
+
+    // allocated on the recording thread, its command pool is never touched by another thread
+    if (threadData.usedCount == commandBuffers.size())
+        commandBuffers.push_back(device().createSecondaryCommandBuffer(threadId, m_frameId));
+
+    return *commandBuffers[threadData.usedCount++];
+}
+
+void ParallelRecorder::recordRange(uint32_t threadId)
+{
+    const uint64_t threadCount = m_threadData.size();
+    const auto begin = static_cast<uint32_t>(m_drawCount * threadId / threadCount);
+    const auto end = static_cast<uint32_t>(m_drawCount * (threadId + 1) / threadCount);
+    if (begin == end)
+        return;
+
+    auto& commandBuffer = nextCommandBuffer(threadId);
+    commandBuffer.beginSecondary(m_renderPass, m_framebuffer, m_extent);
+    (*m_recordFunc)(commandBuffer, begin, end);
+    commandBuffer.end();
+
+    m_recordedCommandBuffers[threadId] = commandBuffer;
+}
+
+void ParallelRecorder::workerLoop(uint32_t threadId)
+{
+    uint64_t generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobCondition.wait(lock, [&]() { return m_shutdown || m_generation != generation; });
+            if (m_shutdown)
+                return;
+            generation = m_generation;
+        }
+
+        recordRange(threadId);
+
+        bool isLast = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            isLast = --m_pendingWorkers == 0;
+        }
+        if (isLast)
+            m_doneCondition.notify_one();
+    }
+}
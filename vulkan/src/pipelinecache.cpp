@@ -0,0 +1,112 @@
+#include "pipelinecache.h"
+#include "device.h"
+#include "vulkanhelper.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    // VkPipelineCacheHeaderVersionOne
+    struct CacheHeader
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    std::vector<char> readFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open())
+            return {};
+
+        std::vector<char> data(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        return file ? data : std::vector<char>{};
+    }
+}
+
+PipelineCache::PipelineCache(const Device& device, const std::string& filename)
+    : DeviceRef(device)
+    , m_filename(filename)
+{
+    auto data = readFile(m_filename);
+    if (!data.empty() && !isCompatible(data, device.properties()))
+    {
+        std::cout << "Pipeline cache " << m_filename << " was written for another device or driver, it is rebuilt" << std::endl;
+        data.clear();
+    }
+    m_warm = !data.empty();
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = m_warm ? data.data() : nullptr;
+    VK_CHECK_RESULT(vkCreatePipelineCache(device, &createInfo, nullptr, &m_pipelineCache));
+}
+
+PipelineCache::~PipelineCache()
+{
+    save();
+    destroy(m_pipelineCache);
+}
+
+bool PipelineCache::save() const
+{
+    size_t size = 0;
+    VK_CHECK_RESULT(vkGetPipelineCacheData(device(), m_pipelineCache, &size, nullptr));
+    std::vector<char> data(size);
+    VK_CHECK_RESULT(vkGetPipelineCacheData(device(), m_pipelineCache, &size, data.data()));
+    data.resize(size);
+
+    const auto tempFilename = m_filename + ".tmp";
+    std::error_code error;
+
+    // closing flushes the data, so the stream is only checked afterwards
+    std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    file.close();
+    if (!file)
+    {
+        std::cout << "Failed to write pipeline cache " << tempFilename << std::endl;
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+
+    // replaces the previous file in one step
+    std::filesystem::rename(tempFilename, m_filename, error);
+    if (error)
+    {
+        std::cout << "Failed to replace pipeline cache " << m_filename << ": " << error.message() << std::endl;
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+
+    return true;
+}
+
+void PipelineCache::addCreationTime(uint64_t microseconds)
+{
+    m_createdPipelineCount++;
+    m_creationTimeInMicroseconds += microseconds;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties)
+{
+    CacheHeader header;
+    if (data.size() < sizeof(header))
+        return false;
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size()
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -48,3 +48,16 @@ std::chrono::microseconds QueryPool::duration() const
     const auto nanoseconds = diff * device().properties().limits.timestampPeriod;
     return std::chrono::microseconds(static_cast<uint64_t>(nanoseconds / 1000));
 }
+
+bool QueryPool::timestamps(uint64_t& begin, uint64_t& end) const
+{
+    assert(m_queryPool);
+
+    uint64_t timeStamps[2];
+    if (vkGetQueryPoolResults(device(), m_queryPool, 0, 2, sizeof(uint64_t) * 2, timeStamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return false;
+
+    begin = timeStamps[0];
+    end = timeStamps[1];
+    return true;
+}
@@ -2,6 +2,51 @@
 #include "commandbuffer.h"
 #include "vulkanhelper.h"
 
+QueueSubmission& QueueSubmission::addWait(VkSemaphore semaphore, VkPipelineStageFlags waitStages, uint64_t value)
+{
+    if (semaphore == VK_NULL_HANDLE)
+        return *this;
+
+    auto& submit = currentSubmit();
+    submit.waitSemaphores.push_back(semaphore);
+    submit.waitStages.push_back(waitStages);
+    submit.waitValues.push_back(value);
+    submit.hasTimelineValues |= value != 0;
+    return *this;
+}
+
+QueueSubmission& QueueSubmission::addCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    currentSubmit().commandBuffers.push_back(commandBuffer);
+    return *this;
+}
+
+QueueSubmission& QueueSubmission::addSignal(VkSemaphore semaphore, uint64_t value)
+{
+    if (semaphore == VK_NULL_HANDLE)
+        return *this;
+
+    auto& submit = currentSubmit();
+    submit.signalSemaphores.push_back(semaphore);
+    submit.signalValues.push_back(value);
+    submit.hasTimelineValues |= value != 0;
+    return *this;
+}
+
+QueueSubmission& QueueSubmission::nextSubmit()
+{
+    m_submits.emplace_back();
+    return *this;
+}
+
+QueueSubmission::Submit& QueueSubmission::currentSubmit()
+{
+    if (m_submits.empty())
+        m_submits.emplace_back();
+
+    return m_submits.back();
+}
+
 Queue::Queue()
 {
 }
@@ -23,15 +68,52 @@ void Queue::submitAsync(CommandBuffer& commandBuffer, VkSemaphore waitSemaphore,
     VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, submitFence));
 }
 
-void Queue::submitBlocking(CommandBuffer& commandBuffer) const
+void Queue::submit(const QueueSubmission& submission, VkFence submitFence) const
 {
-    const VkCommandBuffer cmdBuf = commandBuffer;
+    const auto submitCount = submission.m_submits.size();
+    std::vector<VkSubmitInfo> submitInfos(submitCount);
+    std::vector<VkTimelineSemaphoreSubmitInfo> timelineInfos(submitCount);
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cmdBuf;
+    for (size_t i = 0; i < submitCount; i++)
+    {
+        const auto& submit = submission.m_submits[i];
+
+        auto& submitInfo = submitInfos[i];
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(submit.waitSemaphores.size());
+        submitInfo.pWaitSemaphores = submit.waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = submit.waitStages.data();
+        submitInfo.commandBufferCount = static_cast<uint32_t>(submit.commandBuffers.size());
+        submitInfo.pCommandBuffers = submit.commandBuffers.data();
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(submit.signalSemaphores.size());
+        submitInfo.pSignalSemaphores = submit.signalSemaphores.data();
 
-    VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
-    VK_CHECK_RESULT(vkQueueWaitIdle(m_queue));
+        // values of binary semaphores in the same submit are ignored
+        if (submit.hasTimelineValues)
+        {
+            auto& timelineInfo = timelineInfos[i];
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(submit.waitValues.size());
+            timelineInfo.pWaitSemaphoreValues = submit.waitValues.data();
+            timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(submit.signalValues.size());
+            timelineInfo.pSignalSemaphoreValues = submit.signalValues.data();
+            submitInfo.pNext = &timelineInfo;
+        }
+    }
+
+    VK_CHECK_RESULT(vkQueueSubmit(m_queue, static_cast<uint32_t>(submitCount), submitInfos.data(), submitFence));
+}
+
+void Queue::submitBlocking(CommandBuffer& commandBuffer) const
+{
+    QueueSubmission submission;
+    submission.addCommandBuffer(commandBuffer);
+    submitBlocking(submission);
+}
+
+void Queue::submitBlocking(const QueueSubmission& submission) const
+{
+    submit(submission, m_blockingFence);
+    VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_blockingFence, VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(m_device, 1, &m_blockingFence));
 }
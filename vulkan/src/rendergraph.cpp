@@ -0,0 +1,492 @@
+#include "rendergraph.h"
+#include "device.h"
+#include "barrier.h"
+#include "commandbuffer.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <iostream>
+#include <numeric>
+
+namespace
+{
+    struct ImageAccess
+    {
+        VkImageLayout layout;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+    };
+
+    const ImageAccess SampledAccess = { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+
+    ImageAccess attachmentAccess(VkFormat format)
+    {
+        if (isDepthAttachment(format))
+        {
+            return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+        }
+        return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+    }
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    std::vector<uint64_t> renderPassKey(const std::vector<RenderPassAttachmentDescription>& attachments)
+    {
+        std::vector<uint64_t> key;
+        for (const auto& attachment : attachments)
+            key.push_back(uint64_t(attachment.format) | uint64_t(attachment.loadOp) << 32 | uint64_t(attachment.storeOp) << 40);
+        return key;
+    }
+}
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& graph, uint32_t passId)
+    : m_graph(graph)
+    , m_passId(passId)
+{
+}
+
+RenderGraph::ResourceId RenderGraph::PassBuilder::write(const std::string& name, const ImageDescription& description)
+{
+    auto& pass = m_graph.m_passes[m_passId];
+    assert(pass.writes.empty() || (m_graph.m_resources[pass.writes.front()].description.extent.width == description.extent.width &&
+        m_graph.m_resources[pass.writes.front()].description.extent.height == description.extent.height));
+    // the depth attachment is the last one of a render pass
+    assert(pass.writes.empty() || !isDepthAttachment(m_graph.m_resources[pass.writes.back()].description.format));
+
+    Resource resource;
+    resource.name = name;
+    resource.description = description;
+    resource.writer = m_passId;
+
+    const auto resourceId = static_cast<ResourceId>(m_graph.m_resources.size());
+    m_graph.m_resources.push_back(std::move(resource));
+    pass.writes.push_back(resourceId);
+    return resourceId;
+}
+
+void RenderGraph::PassBuilder::read(ResourceId resource)
+{
+    // images are written once by the pass declaring them, so every pass only reads what earlier passes wrote
+    assert(resource < m_graph.m_resources.size() && m_graph.m_resources[resource].writer != m_passId);
+    m_graph.m_passes[m_passId].reads.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::setClearColor(const VkClearColorValue& clearColor)
+{
+    auto& pass = m_graph.m_passes[m_passId];
+    pass.clear = true;
+    pass.clearColor = clearColor;
+}
+
+void RenderGraph::Barriers::add(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+{
+    imageBarriers.push_back(barrier);
+    srcStages |= srcStage;
+    dstStages |= dstStage;
+}
+
+void RenderGraph::Barriers::record(CommandBuffer& commandBuffer) const
+{
+    if (!imageBarriers.empty())
+        commandBuffer.pipelineBarrier(srcStages, dstStages, imageBarriers);
+}
+
+RenderGraph::RenderGraph(const Device& device)
+    : DeviceRef(device)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    reset();
+    for (const auto& renderPass : m_renderPasses)
+        destroy(renderPass.second);
+}
+
+void RenderGraph::reset()
+{
+    destroyCompiledResources();
+    m_passes.clear();
+    m_resources.clear();
+    m_stats = {};
+}
+
+void RenderGraph::addPass(const std::string& name, const SetupFunc& setup, const ExecuteFunc& execute)
+{
+    assert(!m_compiled);
+
+    const auto passId = static_cast<uint32_t>(m_passes.size());
+    m_passes.emplace_back();
+    m_passes.back().name = name;
+    m_passes.back().execute = execute;
+
+    PassBuilder builder(*this, passId);
+    setup(builder);
+    assert(!m_passes.back().writes.empty());
+}
+
+void RenderGraph::addOutput(ResourceId resource)
+{
+    assert(!m_compiled && resource < m_resources.size());
+    m_resources[resource].isOutput = true;
+}
+
+bool RenderGraph::compile()
+{
+    destroyCompiledResources();
+
+    const auto livePasses = findLivePasses();
+
+    // lifetimes in compiled passes, outputs are alive until the end of the frame
+    std::vector<uint32_t> firstUse(m_resources.size(), UINT32_MAX);
+    std::vector<uint32_t> lastUse(m_resources.size(), 0);
+    for (auto passId = 0u; passId < m_passes.size(); passId++)
+    {
+        if (!livePasses[passId])
+            continue;
+
+        const auto& pass = m_passes[passId];
+        const auto compiledPassId = static_cast<uint32_t>(m_compiledPasses.size());
+        for (auto resource : pass.writes)
+            firstUse[resource] = lastUse[resource] = compiledPassId;
+        for (auto resource : pass.reads)
+        {
+            lastUse[resource] = compiledPassId;
+            m_resources[resource].isSampled = true;
+        }
+
+        CompiledPass compiledPass;
+        compiledPass.passId = passId;
+        compiledPass.extent = m_resources[pass.writes.front()].description.extent;
+        m_compiledPasses.push_back(compiledPass);
+    }
+
+    for (auto i = 0u; i < m_resources.size(); i++)
+    {
+        if (m_resources[i].isOutput && firstUse[i] != UINT32_MAX)
+        {
+            m_resources[i].isSampled = true;
+            lastUse[i] = static_cast<uint32_t>(m_compiledPasses.size());
+        }
+    }
+
+    if (!createImages(firstUse, lastUse))
+    {
+        destroyCompiledResources();
+        return false;
+    }
+
+    // images nobody samples are not stored, e.g. the depth buffer of a scene pass
+    for (auto& compiledPass : m_compiledPasses)
+    {
+        const auto& pass = m_passes[compiledPass.passId];
+
+        std::vector<RenderPassAttachmentDescription> attachments;
+        std::vector<VkImageView> imageViews;
+        for (auto resourceId : pass.writes)
+        {
+            const auto& resource = m_resources[resourceId];
+            const auto layout = attachmentAccess(resource.description.format).layout;
+            attachments.push_back({ resource.description.format,
+                pass.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                resource.isSampled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                layout, layout });
+            imageViews.push_back(resource.imageView.imageView());
+        }
+
+        compiledPass.renderPass = acquireRenderPass(attachments);
+        compiledPass.framebuffer = device().createFramebuffer(compiledPass.renderPass, imageViews, compiledPass.extent);
+    }
+
+    createBarriers();
+
+    m_stats.passCount = static_cast<uint32_t>(m_passes.size());
+    m_stats.culledPassCount = static_cast<uint32_t>(m_passes.size() - m_compiledPasses.size());
+    m_stats.barrierCount = static_cast<uint32_t>(m_outputBarriers.imageBarriers.size());
+    for (const auto& compiledPass : m_compiledPasses)
+        m_stats.barrierCount += static_cast<uint32_t>(compiledPass.barriers.imageBarriers.size());
+
+    m_compiled = true;
+    return true;
+}
+
+void RenderGraph::execute(CommandBuffer& commandBuffer) const
+{
+    assert(m_compiled);
+
+    for (const auto& compiledPass : m_compiledPasses)
+    {
+        const auto& pass = m_passes[compiledPass.passId];
+        compiledPass.barriers.record(commandBuffer);
+        commandBuffer.beginRenderPass(compiledPass.renderPass, compiledPass.framebuffer, compiledPass.extent, pass.clear ? &pass.clearColor : nullptr);
+        pass.execute(commandBuffer, *this);
+        commandBuffer.endRenderPass();
+    }
+
+    m_outputBarriers.record(commandBuffer);
+}
+
+VkImageView RenderGraph::imageView(ResourceId resource) const
+{
+    assert(resource < m_resources.size());
+    return m_resources[resource].imageView.imageView();
+}
+
+VkRenderPass RenderGraph::renderPass(const std::vector<VkFormat>& formats)
+{
+    std::vector<RenderPassAttachmentDescription> attachments;
+    for (auto format : formats)
+    {
+        const auto layout = attachmentAccess(format).layout;
+        attachments.push_back({ format, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, layout, layout });
+    }
+    return acquireRenderPass(attachments);
+}
+
+VkDeviceSize RenderGraph::placeTransientResources(const std::vector<TransientLifetime>& lifetimes, std::vector<VkDeviceSize>& offsets)
+{
+    // the biggest resources are placed first, every resource goes to the lowest offset not used by the resources alive with it
+    std::vector<uint32_t> order(lifetimes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return lifetimes[a].size > lifetimes[b].size; });
+
+    offsets.assign(lifetimes.size(), 0);
+    VkDeviceSize totalSize = 0;
+    std::vector<uint32_t> placed;
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> occupied;
+    for (auto i : order)
+    {
+        const auto& lifetime = lifetimes[i];
+
+        occupied.clear();
+        for (auto j : placed)
+        {
+            const auto& other = lifetimes[j];
+            if (other.firstPass <= lifetime.lastPass && lifetime.firstPass <= other.lastPass)
+                occupied.push_back({ offsets[j], offsets[j] + other.size });
+        }
+        std::sort(occupied.begin(), occupied.end());
+
+        VkDeviceSize offset = 0;
+        for (const auto& range : occupied)
+        {
+            if (alignUp(offset, lifetime.alignment) + lifetime.size <= range.first)
+                break;
+            offset = std::max(offset, range.second);
+        }
+
+        offsets[i] = alignUp(offset, lifetime.alignment);
+        totalSize = std::max(totalSize, offsets[i] + lifetime.size);
+        placed.push_back(i);
+    }
+
+    return totalSize;
+}
+
+std::vector<bool> RenderGraph::findLivePasses() const
+{
+    // passes only read images of earlier passes, so walking backwards from the outputs finds every contributing pass
+    std::vector<bool> needed(m_resources.size(), false);
+    for (auto i = 0u; i < m_resources.size(); i++)
+        needed[i] = m_resources[i].isOutput;
+
+    std::vector<bool> livePasses(m_passes.size(), false);
+    for (auto passId = m_passes.size(); passId-- > 0;)
+    {
+        const auto& pass = m_passes[passId];
+        livePasses[passId] = std::any_of(pass.writes.begin(), pass.writes.end(), [&](ResourceId resource) { return needed[resource]; });
+        if (livePasses[passId])
+        {
+            for (auto resource : pass.reads)
+                needed[resource] = true;
+        }
+    }
+
+    return livePasses;
+}
+
+bool RenderGraph::createImages(const std::vector<uint32_t>& firstUse, const std::vector<uint32_t>& lastUse)
+{
+    std::vector<ResourceId> liveResources;
+    std::vector<TransientLifetime> lifetimes;
+    uint32_t memoryTypeBits = ~0u;
+    VkDeviceSize alignment = 1;
+
+    for (auto resourceId = 0u; resourceId < m_resources.size(); resourceId++)
+    {
+        if (firstUse[resourceId] == UINT32_MAX)
+            continue;
+
+        auto& resource = m_resources[resourceId];
+        const auto& description = resource.description;
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { description.extent.width, description.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = description.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = isDepthAttachment(description.format) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (resource.isSampled)
+            imageInfo.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VK_CHECK_RESULT(vkCreateImage(device(), &imageInfo, nullptr, &resource.image));
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device(), resource.image, &requirements);
+        memoryTypeBits &= requirements.memoryTypeBits;
+        alignment = std::max(alignment, requirements.alignment);
+        resource.memorySize = requirements.size;
+
+        liveResources.push_back(resourceId);
+        lifetimes.push_back({ requirements.size, requirements.alignment, firstUse[resourceId], lastUse[resourceId] });
+        m_stats.unaliasedMemorySize += alignUp(requirements.size, requirements.alignment);
+    }
+
+    if (liveResources.empty())
+        return true;
+
+    if (memoryTypeBits == 0)
+    {
+        std::cout << "Render graph images have no common memory type!" << std::endl;
+        return false;
+    }
+
+    std::vector<VkDeviceSize> offsets;
+    const VkMemoryRequirements requirements = { placeTransientResources(lifetimes, offsets), alignment, memoryTypeBits };
+    m_allocation = device().memoryAllocator().allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, false);
+    if (!m_allocation.isValid())
+    {
+        std::cout << "Render graph could not allocate " << requirements.size << " bytes!" << std::endl;
+        return false;
+    }
+
+    for (auto i = 0u; i < liveResources.size(); i++)
+    {
+        auto& resource = m_resources[liveResources[i]];
+        resource.memoryOffset = offsets[i];
+        VK_CHECK_RESULT(vkBindImageMemory(device(), resource.image, m_allocation.memory, m_allocation.offset + offsets[i]));
+        resource.imageView = ImageView(device(), resource.description.format, resource.image);
+    }
+
+    m_stats.imageCount = static_cast<uint32_t>(liveResources.size());
+    m_stats.memorySize = requirements.size;
+    return true;
+}
+
+void RenderGraph::createBarriers()
+{
+    auto finalAccess = [&](const Resource& resource)
+    {
+        return resource.isSampled ? SampledAccess : attachmentAccess(resource.description.format);
+    };
+
+    auto overlaps = [](const Resource& a, const Resource& b)
+    {
+        return a.memoryOffset < b.memoryOffset + b.memorySize && b.memoryOffset < a.memoryOffset + a.memorySize;
+    };
+
+    std::vector<bool> isSampledLayout(m_resources.size(), false);
+    for (auto& compiledPass : m_compiledPasses)
+    {
+        const auto& pass = m_passes[compiledPass.passId];
+
+        // The contents are discarded, the barrier orders the first write after the last accesses of all images sharing
+        // the memory. Those are either done by earlier passes or by the previous frame, which also covers the image itself.
+        for (auto resourceId : pass.writes)
+        {
+            const auto& resource = m_resources[resourceId];
+            const auto access = attachmentAccess(resource.description.format);
+
+            VkPipelineStageFlags srcStages = 0;
+            VkAccessFlags srcAccess = 0;
+            for (const auto& other : m_resources)
+            {
+                if (other.image == VK_NULL_HANDLE || !overlaps(resource, other))
+                    continue;
+
+                const auto otherAccess = finalAccess(other);
+                srcStages |= otherAccess.stages;
+                // write after read only needs an execution dependency
+                if (!other.isSampled)
+                    srcAccess |= otherAccess.access;
+            }
+
+            auto barrier = createImageMemoryBarrier(resource.image, resource.description.format, VK_IMAGE_LAYOUT_UNDEFINED, access.layout);
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = access.access;
+            compiledPass.barriers.add(barrier, srcStages, access.stages);
+        }
+
+        // images are sampled by several passes after a single transition
+        for (auto resourceId : pass.reads)
+        {
+            if (isSampledLayout[resourceId])
+                continue;
+
+            const auto& resource = m_resources[resourceId];
+            const auto access = attachmentAccess(resource.description.format);
+
+            auto barrier = createImageMemoryBarrier(resource.image, resource.description.format, access.layout, SampledAccess.layout);
+            barrier.srcAccessMask = access.access;
+            barrier.dstAccessMask = SampledAccess.access;
+            compiledPass.barriers.add(barrier, access.stages, SampledAccess.stages);
+            isSampledLayout[resourceId] = true;
+        }
+    }
+
+    for (auto resourceId = 0u; resourceId < m_resources.size(); resourceId++)
+    {
+        const auto& resource = m_resources[resourceId];
+        if (!resource.isOutput || resource.image == VK_NULL_HANDLE || isSampledLayout[resourceId])
+            continue;
+
+        const auto access = attachmentAccess(resource.description.format);
+        auto barrier = createImageMemoryBarrier(resource.image, resource.description.format, access.layout, SampledAccess.layout);
+        barrier.srcAccessMask = access.access;
+        barrier.dstAccessMask = SampledAccess.access;
+        m_outputBarriers.add(barrier, access.stages, SampledAccess.stages);
+    }
+}
+
+VkRenderPass RenderGraph::acquireRenderPass(const std::vector<RenderPassAttachmentDescription>& attachments)
+{
+    auto& renderPass = m_renderPasses[renderPassKey(attachments)];
+    if (!renderPass)
+    {
+        // the layout transitions and dependencies are done with the barriers of the graph
+        renderPass = device().createRenderPass(attachments, false);
+    }
+    return renderPass;
+}
+
+void RenderGraph::destroyCompiledResources()
+{
+    for (const auto& compiledPass : m_compiledPasses)
+        destroy(compiledPass.framebuffer);
+    m_compiledPasses.clear();
+    m_outputBarriers = {};
+
+    for (auto& resource : m_resources)
+    {
+        resource.imageView = ImageView();
+        destroy(resource.image);
+        resource.image = VK_NULL_HANDLE;
+        resource.isSampled = false;
+    }
+
+    if (m_allocation.isValid())
+        destroy(m_allocation);
+    m_allocation = {};
+
+    m_stats = {};
+    m_compiled = false;
+}
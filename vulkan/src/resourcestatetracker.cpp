@@ -0,0 +1,183 @@
+#include "resourcestatetracker.h"
+
+#include <assert.h>
+
+namespace
+{
+    constexpr VkAccessFlags WriteAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    bool isSameTransition(const ResourceStateTracker::Barrier& a, const ResourceStateTracker::Barrier& b)
+    {
+        return a.srcStages == b.srcStages && a.dstStages == b.dstStages && a.srcAccess == b.srcAccess && a.dstAccess == b.dstAccess &&
+            a.oldLayout == b.oldLayout && a.newLayout == b.newLayout && a.range.aspectMask == b.range.aspectMask;
+    }
+}
+
+void ResourceStateTracker::bufferAccess(VkBuffer buffer, const ResourceAccess& access)
+{
+    Barrier barrier;
+    barrier.buffer = buffer;
+    if (!updateState(m_bufferStates[buffer], access, false, barrier))
+        return;
+
+    const auto pending = m_pendingBufferBarriers.emplace(buffer, barrier);
+    if (!pending.second)
+        mergePending(pending.first->second, barrier);
+}
+
+void ResourceStateTracker::imageAccess(VkImage image, const VkImageSubresourceRange& range, VkImageLayout currentLayout, const ResourceAccess& access)
+{
+    assert(range.levelCount != VK_REMAINING_MIP_LEVELS && range.layerCount != VK_REMAINING_ARRAY_LAYERS);
+
+    for (auto mip = range.baseMipLevel; mip < range.baseMipLevel + range.levelCount; mip++)
+    {
+        for (auto layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++)
+        {
+            const SubresourceKey key = { image, mip, layer };
+
+            auto state = m_imageStates.find(key);
+            if (state == m_imageStates.end())
+            {
+                // whatever used the image before in its current layout is ordered by the first barrier
+                const auto initialAccess = getLayoutAccess(currentLayout);
+                State initialState;
+                initialState.layout = currentLayout;
+                if (initialAccess.access & WriteAccessMask)
+                {
+                    initialState.writeStages = initialAccess.stages;
+                    initialState.writeAccess = initialAccess.access & WriteAccessMask;
+                }
+                else
+                {
+                    initialState.readStages = initialAccess.stages;
+                    initialState.readAccess = initialAccess.access;
+                }
+                state = m_imageStates.emplace(key, initialState).first;
+            }
+
+            Barrier barrier;
+            barrier.image = image;
+            barrier.range = { range.aspectMask, mip, 1, layer, 1 };
+            if (!updateState(state->second, access, true, barrier))
+                continue;
+
+            const auto pending = m_pendingImageBarriers.emplace(key, barrier);
+            if (!pending.second)
+                mergePending(pending.first->second, barrier);
+        }
+    }
+}
+
+std::vector<ResourceStateTracker::Barrier> ResourceStateTracker::takePendingBarriers()
+{
+    std::vector<Barrier> barriers;
+    barriers.reserve(m_pendingBufferBarriers.size() + m_pendingImageBarriers.size());
+    for (const auto& pending : m_pendingBufferBarriers)
+        barriers.push_back(pending.second);
+
+    // the keys are sorted by image, mip and layer, so adjacent layers of a mip follow each other
+    std::vector<Barrier> layerRanges;
+    for (const auto& pending : m_pendingImageBarriers)
+    {
+        const auto& barrier = pending.second;
+        if (!layerRanges.empty())
+        {
+            auto& last = layerRanges.back();
+            if (last.image == barrier.image && last.range.baseMipLevel == barrier.range.baseMipLevel &&
+                last.range.baseArrayLayer + last.range.layerCount == barrier.range.baseArrayLayer && isSameTransition(last, barrier))
+            {
+                last.range.layerCount++;
+                continue;
+            }
+        }
+        layerRanges.push_back(barrier);
+    }
+
+    const auto firstImageBarrier = barriers.size();
+    for (const auto& barrier : layerRanges)
+    {
+        bool merged = false;
+        for (auto i = firstImageBarrier; i < barriers.size() && !merged; i++)
+        {
+            auto& mipRange = barriers[i];
+            if (mipRange.image == barrier.image && mipRange.range.baseArrayLayer == barrier.range.baseArrayLayer &&
+                mipRange.range.layerCount == barrier.range.layerCount && mipRange.range.baseMipLevel + mipRange.range.levelCount == barrier.range.baseMipLevel &&
+                isSameTransition(mipRange, barrier))
+            {
+                mipRange.range.levelCount++;
+                merged = true;
+            }
+        }
+
+        if (!merged)
+            barriers.push_back(barrier);
+    }
+
+    m_pendingBufferBarriers.clear();
+    m_pendingImageBarriers.clear();
+    return barriers;
+}
+
+void ResourceStateTracker::reset()
+{
+    m_bufferStates.clear();
+    m_imageStates.clear();
+    m_pendingBufferBarriers.clear();
+    m_pendingImageBarriers.clear();
+}
+
+bool ResourceStateTracker::updateState(State& state, const ResourceAccess& access, bool isImage, Barrier& barrier)
+{
+    const bool isLayoutChange = isImage && access.layout != state.layout;
+    const bool isWrite = (access.access & WriteAccessMask) != 0;
+
+    barrier.dstStages = access.stages;
+    barrier.dstAccess = access.access;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = isImage ? access.layout : state.layout;
+
+    if (!isWrite && !isLayoutChange)
+    {
+        // a read only waits on the last write, and only once per stage and access
+        const bool isVisible = state.writeStages == 0 ||
+            ((state.readStages & access.stages) == access.stages && (state.readAccess & access.access) == access.access);
+
+        barrier.srcStages = state.writeStages;
+        barrier.srcAccess = state.writeAccess;
+        state.readStages |= access.stages;
+        state.readAccess |= access.access;
+        return !isVisible;
+    }
+
+    // writes and layout transitions wait on all previous accesses, only writes have to be made available
+    barrier.srcStages = state.writeStages | state.readStages;
+    barrier.srcAccess = state.writeAccess;
+
+    if (isWrite)
+    {
+        state.writeStages = access.stages;
+        state.writeAccess = access.access & WriteAccessMask;
+        state.readStages = 0;
+        state.readAccess = 0;
+    }
+    else
+    {
+        // the transition writes the image, later reads in other stages need an execution dependency on it
+        state.writeStages = access.stages;
+        state.writeAccess = 0;
+        state.readStages = access.stages;
+        state.readAccess = access.access;
+    }
+    state.layout = barrier.newLayout;
+
+    return isLayoutChange || barrier.srcStages != 0;
+}
+
+void ResourceStateTracker::mergePending(Barrier& pending, const Barrier& barrier)
+{
+    // nothing was recorded in between, so the pending barrier keeps its source and also covers the new access
+    pending.dstStages |= barrier.dstStages;
+    pending.dstAccess |= barrier.dstAccess;
+    pending.newLayout = barrier.newLayout;
+}
@@ -0,0 +1,257 @@
+#include "tlsfallocator.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace
+{
+    uint32_t findLastSet(uint64_t value)
+    {
+        uint32_t bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+    }
+
+    uint32_t findFirstSet(uint64_t value)
+    {
+        assert(value != 0);
+        uint32_t bit = 0;
+        while ((value & 1) == 0)
+        {
+            value >>= 1;
+            ++bit;
+        }
+        return bit;
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size)
+    : m_size(size)
+{
+    for (auto& secondLevel : m_freeLists)
+        secondLevel.fill(InvalidHandle);
+
+    if (size > 0)
+        insertFreeNode(createNode(0, size));
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    assert((alignment & (alignment - 1)) == 0);
+
+    alignment = std::max(alignment, MinAlignment);
+    size = alignUp(std::max<uint64_t>(size, 1), MinAlignment);
+    if (size > m_size)
+        return {};
+
+    // offsets are always multiples of MinAlignment, so this is the worst case padding
+    Handle handle = findFreeNode(size + alignment - MinAlignment);
+    if (handle == InvalidHandle)
+        return {};
+
+    removeFreeNode(handle);
+
+    const uint64_t alignedOffset = alignUp(m_nodes[handle].offset, alignment);
+    if (alignedOffset != m_nodes[handle].offset)
+    {
+        const Handle padding = handle;
+        handle = split(padding, alignedOffset - m_nodes[padding].offset);
+        insertFreeNode(padding);
+    }
+
+    if (m_nodes[handle].size > size)
+        insertFreeNode(split(handle, size));
+
+    ++m_allocationCount;
+    return { handle, m_nodes[handle].offset, m_nodes[handle].size };
+}
+
+void TlsfAllocator::free(Handle handle)
+{
+    assert(handle < m_nodes.size() && !m_nodes[handle].isFree);
+    --m_allocationCount;
+
+    const Handle next = m_nodes[handle].nextPhysical;
+    if (next != InvalidHandle && m_nodes[next].isFree)
+    {
+        removeFreeNode(next);
+        m_nodes[handle].size += m_nodes[next].size;
+        m_nodes[handle].nextPhysical = m_nodes[next].nextPhysical;
+        if (m_nodes[handle].nextPhysical != InvalidHandle)
+            m_nodes[m_nodes[handle].nextPhysical].prevPhysical = handle;
+        releaseNode(next);
+    }
+
+    const Handle prev = m_nodes[handle].prevPhysical;
+    if (prev != InvalidHandle && m_nodes[prev].isFree)
+    {
+        removeFreeNode(prev);
+        m_nodes[prev].size += m_nodes[handle].size;
+        m_nodes[prev].nextPhysical = m_nodes[handle].nextPhysical;
+        if (m_nodes[prev].nextPhysical != InvalidHandle)
+            m_nodes[m_nodes[prev].nextPhysical].prevPhysical = prev;
+        releaseNode(handle);
+        handle = prev;
+    }
+
+    insertFreeNode(handle);
+}
+
+TlsfAllocator::Stats TlsfAllocator::stats() const
+{
+    Stats stats;
+    stats.allocationCount = m_allocationCount;
+
+    // the node at offset 0 is created first and is never merged away
+    for (Handle handle = m_nodes.empty() ? InvalidHandle : 0; handle != InvalidHandle; handle = m_nodes[handle].nextPhysical)
+    {
+        const Node& node = m_nodes[handle];
+        if (node.isFree)
+        {
+            stats.freeBytes += node.size;
+            stats.largestFreeRange = std::max(stats.largestFreeRange, node.size);
+            ++stats.freeRangeCount;
+        }
+        else
+        {
+            stats.usedBytes += node.size;
+        }
+    }
+
+    return stats;
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    if (size < SecondLevelCount)
+    {
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(size);
+    }
+    else
+    {
+        const uint32_t lastSet = findLastSet(size);
+        firstLevel = lastSet - SecondLevelLog2 + 1;
+        secondLevel = static_cast<uint32_t>(size >> (lastSet - SecondLevelLog2)) ^ SecondLevelCount;
+    }
+}
+
+TlsfAllocator::Handle TlsfAllocator::createNode(uint64_t offset, uint64_t size)
+{
+    Handle handle;
+    if (!m_unusedNodes.empty())
+    {
+        handle = m_unusedNodes.back();
+        m_unusedNodes.pop_back();
+        m_nodes[handle] = Node();
+    }
+    else
+    {
+        handle = static_cast<Handle>(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+
+    m_nodes[handle].offset = offset;
+    m_nodes[handle].size = size;
+    return handle;
+}
+
+void TlsfAllocator::releaseNode(Handle handle)
+{
+    m_nodes[handle].isFree = false;
+    m_unusedNodes.push_back(handle);
+}
+
+TlsfAllocator::Handle TlsfAllocator::findFreeNode(uint64_t size) const
+{
+    // round up to the next list, so any node in it is large enough
+    if (size >= SecondLevelCount)
+        size += (uint64_t(1) << (findLastSet(size) - SecondLevelLog2)) - 1;
+
+    uint32_t firstLevel, secondLevel;
+    mapping(size, firstLevel, secondLevel);
+    if (firstLevel >= FirstLevelCount)
+        return InvalidHandle;
+
+    uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0)
+    {
+        if (firstLevel + 1 >= FirstLevelCount)
+            return InvalidHandle;
+
+        const uint64_t firstLevelMap = m_firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1));
+        if (firstLevelMap == 0)
+            return InvalidHandle;
+
+        firstLevel = findFirstSet(firstLevelMap);
+        secondLevelMap = m_secondLevelBitmaps[firstLevel];
+    }
+
+    return m_freeLists[firstLevel][findFirstSet(secondLevelMap)];
+}
+
+TlsfAllocator::Handle TlsfAllocator::split(Handle handle, uint64_t size)
+{
+    assert(m_nodes[handle].size > size);
+
+    const Handle remainder = createNode(m_nodes[handle].offset + size, m_nodes[handle].size - size);
+    m_nodes[remainder].prevPhysical = handle;
+    m_nodes[remainder].nextPhysical = m_nodes[handle].nextPhysical;
+    if (m_nodes[remainder].nextPhysical != InvalidHandle)
+        m_nodes[m_nodes[remainder].nextPhysical].prevPhysical = remainder;
+
+    m_nodes[handle].nextPhysical = remainder;
+    m_nodes[handle].size = size;
+    return remainder;
+}
+
+void TlsfAllocator::insertFreeNode(Handle handle)
+{
+    uint32_t firstLevel, secondLevel;
+    mapping(m_nodes[handle].size, firstLevel, secondLevel);
+
+    Handle& head = m_freeLists[firstLevel][secondLevel];
+    m_nodes[handle].isFree = true;
+    m_nodes[handle].prevFree = InvalidHandle;
+    m_nodes[handle].nextFree = head;
+    if (head != InvalidHandle)
+        m_nodes[head].prevFree = handle;
+    head = handle;
+
+    m_firstLevelBitmap |= uint64_t(1) << firstLevel;
+    m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfAllocator::removeFreeNode(Handle handle)
+{
+    uint32_t firstLevel, secondLevel;
+    mapping(m_nodes[handle].size, firstLevel, secondLevel);
+
+    Node& node = m_nodes[handle];
+    if (node.prevFree != InvalidHandle)
+        m_nodes[node.prevFree].nextFree = node.nextFree;
+    if (node.nextFree != InvalidHandle)
+        m_nodes[node.nextFree].prevFree = node.prevFree;
+
+    Handle& head = m_freeLists[firstLevel][secondLevel];
+    if (head == handle)
+    {
+        head = node.nextFree;
+        if (head == InvalidHandle)
+        {
+            m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (m_secondLevelBitmaps[firstLevel] == 0)
+                m_firstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+        }
+    }
+
+    node.isFree = false;
+    node.prevFree = InvalidHandle;
+    node.nextFree = InvalidHandle;
+}
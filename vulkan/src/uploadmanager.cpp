@@ -0,0 +1,466 @@
+#include "uploadmanager.h"
+#include "barrier.h"
+#include "commandbuffer.h"
+#include "device.h"
+#include "vulkanhelper.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // multiple of the texel size, which is what vkCmdCopyBufferToImage requires for the buffer offset
+    constexpr VkDeviceSize StagingAlignment = 16;
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // uploads may be consumed by any later command on the queue they are acquired on
+    constexpr VkPipelineStageFlags ConsumerStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+}
+
+UploadManager::UploadManager(const Device& device, VkDeviceSize stagingBufferSize)
+    : DeviceRef(device)
+    , m_stagingBuffer(device, alignUp(stagingBufferSize, StagingAlignment))
+    , m_hasDedicatedTransferQueue(device.transferQueue().familyId() != device.graphicsQueue().familyId())
+    , m_renderThread(std::this_thread::get_id())
+{
+    m_stagingData = static_cast<uint8_t*>(m_stagingBuffer.data());
+
+    if (device.timelineSemaphoreSupported())
+    {
+        m_transferTimeline = device.createTimelineSemaphore();
+        m_completionTimeline = device.createTimelineSemaphore();
+    }
+}
+
+UploadManager::~UploadManager()
+{
+    waitIdle();
+
+    destroy(m_transferTimeline);
+    destroy(m_completionTimeline);
+}
+
+UploadManager::Handle UploadManager::uploadBuffer(const void* data, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset, uint32_t dstQueueFamilyId)
+{
+    const auto bytes = static_cast<const uint8_t*>(data);
+    return uploadBuffer([bytes](void* destination, VkDeviceSize chunkOffset, VkDeviceSize chunkSize) { std::memcpy(destination, bytes + chunkOffset, chunkSize); },
+        buffer, size, offset, dstQueueFamilyId);
+}
+
+UploadManager::Handle UploadManager::uploadImage(const void* pixelData, VkImage image, VkFormat format, VkExtent2D resolution, VkImageLayout finalLayout,
+    uint32_t dstQueueFamilyId)
+{
+    const auto bytes = static_cast<const uint8_t*>(pixelData);
+    return uploadImage([bytes](void* destination, VkDeviceSize chunkOffset, VkDeviceSize chunkSize) { std::memcpy(destination, bytes + chunkOffset, chunkSize); },
+        image, format, resolution, finalLayout, dstQueueFamilyId);
+}
+
+UploadManager::Handle UploadManager::uploadBuffer(const WriteFunc& writeFunc, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset, uint32_t dstQueueFamilyId)
+{
+    assert(isRenderThread());
+
+    for (VkDeviceSize copied = 0; copied < size;)
+    {
+        const auto chunkSize = std::min(size - copied, maxChunkSize());
+        const auto stagingOffset = allocateStaging(writeFunc, copied, chunkSize);
+        recordingBatch().bufferCopies.push_back({ stagingOffset, buffer, offset + copied, chunkSize });
+        copied += chunkSize;
+    }
+
+    // earlier chunks may be in already submitted batches, the barrier goes into the one with the last chunk
+    auto& batch = recordingBatch();
+    const auto hasBarrier = std::any_of(batch.bufferBarriers.begin(), batch.bufferBarriers.end(), [&](const auto& barrier) { return barrier.buffer == buffer; });
+    if (!hasBarrier)
+    {
+        batch.bufferBarriers.push_back(createBufferMemoryBarrier(buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
+            copyQueueFamilyId(), consumerQueueFamilyId(dstQueueFamilyId)));
+    }
+
+    device().memoryAllocator().recordUpload(size, false);
+    return batch.id;
+}
+
+UploadManager::Handle UploadManager::uploadImage(const WriteFunc& writeFunc, VkImage image, VkFormat format, VkExtent2D resolution, VkImageLayout finalLayout,
+    uint32_t dstQueueFamilyId)
+{
+    assert(format == VK_FORMAT_R8G8B8A8_UNORM);
+
+    assert(isRenderThread());
+
+    // big images are streamed in bands of whole rows
+    const VkDeviceSize rowSize = resolution.width * 4;
+    assert(rowSize <= maxChunkSize());
+    const auto rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(maxChunkSize() / rowSize, 1));
+
+    for (uint32_t row = 0; row < resolution.height;)
+    {
+        const auto rowCount = std::min(rowsPerChunk, resolution.height - row);
+        const auto stagingOffset = allocateStaging(writeFunc, row * rowSize, rowCount * rowSize);
+
+        auto& batch = recordingBatch();
+        if (row == 0)
+            batch.copyBarriers.push_back(createImageMemoryBarrier(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+        batch.imageCopies.push_back({ stagingOffset, image, { 0, static_cast<int32_t>(row) }, { resolution.width, rowCount } });
+        row += rowCount;
+    }
+
+    auto barrier = createImageMemoryBarrier(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout);
+    barrier.srcQueueFamilyIndex = copyQueueFamilyId();
+    barrier.dstQueueFamilyIndex = consumerQueueFamilyId(dstQueueFamilyId);
+
+    auto& batch = recordingBatch();
+    batch.imageBarriers.push_back(barrier);
+
+    device().memoryAllocator().recordUpload(rowSize * resolution.height, false);
+    return batch.id;
+}
+
+UploadManager::Handle UploadManager::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    assert(isRenderThread());
+
+    auto& batch = recordingBatch();
+    const auto newBarrier = createImageMemoryBarrier(image, format, oldLayout, newLayout);
+
+    // barriers of one vkCmdPipelineBarrier are unordered, so a second transition of the same image is merged into the first
+    auto merge = [&](std::vector<VkImageMemoryBarrier>& barriers)
+    {
+        for (auto& barrier : barriers)
+        {
+            if (barrier.image != image)
+                continue;
+            barrier.newLayout = newBarrier.newLayout;
+            barrier.dstAccessMask = newBarrier.dstAccessMask;
+            return true;
+        }
+        return false;
+    };
+
+    if (!merge(batch.imageBarriers) && !merge(batch.layoutTransitions))
+        batch.layoutTransitions.push_back(newBarrier);
+
+    return batch.id;
+}
+
+UploadManager::Handle UploadManager::flush()
+{
+    assert(isRenderThread());
+
+    retireCompletedBatches();
+    if (!m_recordingBatch)
+        return m_nextBatchId - 1;
+
+    return finishRecording(*m_recordingBatch);
+}
+
+bool UploadManager::isComplete(Handle handle)
+{
+    assert(isRenderThread());
+
+    retireCompletedBatches();
+    return handle <= m_completedBatchId;
+}
+
+void UploadManager::wait(Handle handle)
+{
+    assert(isRenderThread());
+
+    if (m_recordingBatch && m_recordingBatch->id <= handle)
+        finishRecording(*m_recordingBatch);
+
+    for (const auto& batch : m_submittedBatches)
+    {
+        if (batch->id > handle)
+            break;
+        waitForBatch(*batch);
+    }
+
+    retireCompletedBatches();
+}
+
+void UploadManager::waitIdle()
+{
+    wait(m_nextBatchId - 1);
+}
+
+void UploadManager::setStagingBufferSize(VkDeviceSize size)
+{
+    waitIdle();
+
+    m_stagingBuffer = StagingBuffer(device(), alignUp(size, StagingAlignment));
+    m_stagingData = static_cast<uint8_t*>(m_stagingBuffer.data());
+    m_stagingHead = m_stagingTail = 0;
+}
+
+VkDeviceSize UploadManager::allocateStaging(const WriteFunc& writeFunc, VkDeviceSize uploadOffset, VkDeviceSize size)
+{
+    const VkDeviceSize capacity = m_stagingBuffer.size();
+    assert(size <= maxChunkSize());
+
+    // a batch uses at most half of the ring, so the next one can be filled while it is copied
+    if (m_recordingBatch && m_recordingBatch->stagedBytes + size > capacity / 2)
+        finishRecording(*m_recordingBatch);
+
+    VkDeviceSize begin = alignUp(m_stagingHead, StagingAlignment);
+
+    // chunks never wrap around the end of the ring
+    if (begin % capacity + size > capacity)
+        begin = (begin / capacity + 1) * capacity;
+
+    while (begin + size - m_stagingTail > capacity)
+    {
+        if (m_submittedBatches.empty())
+            finishRecording(*m_recordingBatch);
+
+        waitForBatch(*m_submittedBatches.front());
+        retireCompletedBatches();
+    }
+
+    m_stagingHead = begin + size;
+
+    const VkDeviceSize offset = begin % capacity;
+    writeFunc(m_stagingData + offset, uploadOffset, size);
+    m_stagingBuffer.flush(offset, size);
+
+    recordingBatch().stagedBytes += size;
+    return offset;
+}
+
+UploadManager::Batch& UploadManager::recordingBatch()
+{
+    if (!m_recordingBatch)
+    {
+        m_recordingBatch = std::make_unique<Batch>();
+        m_recordingBatch->id = m_nextBatchId++;
+    }
+
+    return *m_recordingBatch;
+}
+
+UploadManager::Handle UploadManager::finishRecording(Batch& batch)
+{
+    assert(&batch == m_recordingBatch.get());
+
+    batch.stagingEnd = m_stagingHead;
+    submit(batch);
+
+    const auto id = batch.id;
+    m_submittedBatches.push_back(std::move(m_recordingBatch));
+    return id;
+}
+
+void UploadManager::recordCopies(Batch& batch)
+{
+    auto& commandBuffer = *batch.transferCommandBuffer;
+
+    // recorded in front of the first image copy, the buffer copies do not wait on them
+    for (const auto& barrier : batch.copyBarriers)
+        commandBuffer.imageAccess(barrier.image, barrier.subresourceRange, barrier.oldLayout, getLayoutAccess(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+
+    // consecutive copies into the same buffer (streams of a vertex buffer, chunks) share one command
+    std::vector<VkBufferCopy> regions;
+    for (auto i = 0u; i < batch.bufferCopies.size(); i++)
+    {
+        const auto& copy = batch.bufferCopies[i];
+        regions.push_back({ copy.stagingOffset, copy.destinationOffset, copy.size });
+
+        if (i + 1 == batch.bufferCopies.size() || batch.bufferCopies[i + 1].destination != copy.destination)
+        {
+            vkCmdCopyBuffer(commandBuffer, m_stagingBuffer, copy.destination, static_cast<uint32_t>(regions.size()), regions.data());
+            regions.clear();
+        }
+    }
+    for (const auto& copy : batch.imageCopies)
+        commandBuffer.copyBufferToImage(m_stagingBuffer, copy.stagingOffset, copy.destination, copy.offset, copy.extent);
+}
+
+void UploadManager::submit(Batch& batch)
+{
+    if (!m_completionTimeline)
+    {
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK_RESULT(vkCreateFence(device(), &fenceInfo, nullptr, &batch.fence));
+    }
+
+    const auto graphicsFamilyId = device().graphicsQueue().familyId();
+    const auto copyFamilyId = copyQueueFamilyId();
+    const auto& copyQueue = m_hasDedicatedTransferQueue ? device().transferQueue() : device().graphicsQueue();
+    const bool hasCopies = !batch.bufferCopies.empty() || !batch.imageCopies.empty();
+
+    // layout transitions may follow any earlier use of the image on the graphics queue
+    VkPipelineStageFlags transitionStages = 0;
+    for (const auto& barrier : batch.layoutTransitions)
+        transitionStages |= getLayoutAccess(barrier.oldLayout).stages;
+
+    // destinations used by the family of the copying queue only need a plain barrier, the others are released
+    // on the copying queue and acquired on the graphics or compute queue
+    std::vector<VkBufferMemoryBarrier> copyBufferBarriers, graphicsBufferBarriers, computeBufferBarriers;
+    std::vector<VkImageMemoryBarrier> copyImageBarriers, graphicsImageBarriers, computeImageBarriers;
+    auto distribute = [&](auto barrier, auto& copyBarriers, auto& graphicsBarriers, auto& computeBarriers)
+    {
+        if (barrier.dstQueueFamilyIndex == copyFamilyId)
+        {
+            barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            copyBarriers.push_back(barrier);
+            return;
+        }
+
+        // the release does the source access, the acquire the destination access
+        auto release = barrier;
+        release.dstAccessMask = 0;
+        copyBarriers.push_back(release);
+
+        barrier.srcAccessMask = 0;
+        if (barrier.dstQueueFamilyIndex == graphicsFamilyId)
+        {
+            graphicsBarriers.push_back(barrier);
+        }
+        else
+        {
+            assert(barrier.dstQueueFamilyIndex == device().computeQueue().familyId());
+            computeBarriers.push_back(barrier);
+        }
+    };
+    for (const auto& barrier : batch.bufferBarriers)
+        distribute(barrier, copyBufferBarriers, graphicsBufferBarriers, computeBufferBarriers);
+    for (const auto& barrier : batch.imageBarriers)
+        distribute(barrier, copyImageBarriers, graphicsImageBarriers, computeImageBarriers);
+
+    auto& transitionBarriers = m_hasDedicatedTransferQueue ? graphicsImageBarriers : copyImageBarriers;
+    transitionBarriers.insert(transitionBarriers.end(), batch.layoutTransitions.begin(), batch.layoutTransitions.end());
+
+    // completion is always signaled on the graphics queue, so the timeline values and fences of the batches are
+    // signaled in submission order. A compute acquire is followed by a graphics submission waiting for it.
+    const bool submitsCopies = hasCopies || !m_hasDedicatedTransferQueue;
+    const bool needsComputeAcquire = !computeBufferBarriers.empty() || !computeImageBarriers.empty();
+    const bool needsGraphicsSubmit = m_hasDedicatedTransferQueue || needsComputeAcquire;
+
+    if (submitsCopies)
+    {
+        batch.transferCommandBuffer = device().transferCommandBufferCache().acquire();
+        auto& transferCommandBuffer = *batch.transferCommandBuffer;
+        transferCommandBuffer.begin();
+        recordCopies(batch);
+        vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | (m_hasDedicatedTransferQueue ? 0 : transitionStages), ConsumerStages,
+            0, 0, nullptr,
+            static_cast<uint32_t>(copyBufferBarriers.size()), copyBufferBarriers.data(),
+            static_cast<uint32_t>(copyImageBarriers.size()), copyImageBarriers.data());
+        transferCommandBuffer.end();
+
+        QueueSubmission submission;
+        submission.addCommandBuffer(transferCommandBuffer);
+        if (!needsGraphicsSubmit)
+        {
+            submission.addSignal(m_completionTimeline, batch.id);
+            copyQueue.submit(submission, batch.fence);
+            return;
+        }
+
+        if (!m_transferTimeline)
+            batch.semaphore = device().createSemaphore();
+        submission.addSignal(m_transferTimeline, batch.id)
+            .addSignal(batch.semaphore);
+        copyQueue.submit(submission);
+    }
+
+    if (needsComputeAcquire)
+    {
+        batch.computeAcquireCommandBuffer = device().computeCommandBufferCache().acquire();
+        batch.computeAcquireCommandBuffer->begin();
+        vkCmdPipelineBarrier(*batch.computeAcquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ConsumerStages, 0, 0, nullptr,
+            static_cast<uint32_t>(computeBufferBarriers.size()), computeBufferBarriers.data(),
+            static_cast<uint32_t>(computeImageBarriers.size()), computeImageBarriers.data());
+        batch.computeAcquireCommandBuffer->end();
+
+        QueueSubmission submission;
+        submission.addWait(m_transferTimeline, ConsumerStages, batch.id)
+            .addWait(batch.semaphore, ConsumerStages)
+            .addCommandBuffer(*batch.computeAcquireCommandBuffer);
+
+        // the graphics submission waits for the compute acquire, which already waited for the copies
+        batch.computeSemaphore = device().createSemaphore();
+        submission.addSignal(batch.computeSemaphore);
+        device().computeQueue().submit(submission);
+    }
+
+    // without graphics barriers or layout transitions the submission only waits and signals
+    const bool needsGraphicsAcquire = !graphicsBufferBarriers.empty() || !graphicsImageBarriers.empty();
+    if (needsGraphicsAcquire)
+    {
+        batch.acquireCommandBuffer = device().commandBufferCache().acquire();
+        batch.acquireCommandBuffer->begin();
+        vkCmdPipelineBarrier(*batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | transitionStages, ConsumerStages, 0, 0, nullptr,
+            static_cast<uint32_t>(graphicsBufferBarriers.size()), graphicsBufferBarriers.data(),
+            static_cast<uint32_t>(graphicsImageBarriers.size()), graphicsImageBarriers.data());
+        batch.acquireCommandBuffer->end();
+    }
+
+    QueueSubmission submission;
+    if (needsComputeAcquire)
+    {
+        submission.addWait(batch.computeSemaphore, ConsumerStages);
+    }
+    else if (hasCopies)
+    {
+        submission.addWait(m_transferTimeline, ConsumerStages, batch.id)
+            .addWait(batch.semaphore, ConsumerStages);
+    }
+    if (needsGraphicsAcquire)
+        submission.addCommandBuffer(*batch.acquireCommandBuffer);
+    submission.addSignal(m_completionTimeline, batch.id);
+    device().graphicsQueue().submit(submission, batch.fence);
+}
+
+void UploadManager::retireCompletedBatches()
+{
+    // batches complete in submission order
+    while (!m_submittedBatches.empty() && isBatchComplete(*m_submittedBatches.front()))
+    {
+        m_completedBatchId = m_submittedBatches.front()->id;
+        m_stagingTail = m_submittedBatches.front()->stagingEnd;
+        destroyBatch(*m_submittedBatches.front());
+        m_submittedBatches.pop_front();
+    }
+}
+
+uint32_t UploadManager::copyQueueFamilyId() const
+{
+    return m_hasDedicatedTransferQueue ? device().transferQueue().familyId() : device().graphicsQueue().familyId();
+}
+
+uint32_t UploadManager::consumerQueueFamilyId(uint32_t dstQueueFamilyId) const
+{
+    return dstQueueFamilyId == VK_QUEUE_FAMILY_IGNORED ? device().graphicsQueue().familyId() : dstQueueFamilyId;
+}
+
+bool UploadManager::isBatchComplete(const Batch& batch) const
+{
+    if (m_completionTimeline)
+        return device().semaphoreValue(m_completionTimeline) >= batch.id;
+
+    return vkGetFenceStatus(device(), batch.fence) == VK_SUCCESS;
+}
+
+void UploadManager::waitForBatch(const Batch& batch) const
+{
+    if (m_completionTimeline)
+        device().waitSemaphore(m_completionTimeline, batch.id);
+    else
+        VK_CHECK_RESULT(vkWaitForFences(device(), 1, &batch.fence, VK_TRUE, UINT64_MAX));
+}
+
+void UploadManager::destroyBatch(Batch& batch)
+{
+    destroy(batch.fence);
+    destroy(batch.semaphore);
+    // the fence has signaled, so the command buffers can be recorded again
+    device().transferCommandBufferCache().recycle(std::move(batch.transferCommandBuffer));
+    device().commandBufferCache().recycle(std::move(batch.acquireCommandBuffer));
+    destroy(batch.computeSemaphore);
+    device().computeCommandBufferCache().recycle(std::move(batch.computeAcquireCommandBuffer));
+}
@@ -2,29 +2,31 @@
 #include "vulkanhelper.h"
 #include "device.h"
 
-#include <cstring>
-
-const static bool useStaging = true;
-
 namespace
 {
-    VkFormat getAttributeFormat(uint32_t numVertices)
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+VkFormat VertexBuffer::attributeFormat(uint32_t componentCount)
+{
+    switch (componentCount)
     {
-        switch (numVertices)
-        {
-        case 1: return VK_FORMAT_R32_SFLOAT;
-        case 2: return VK_FORMAT_R32G32_SFLOAT;
-        case 3: return VK_FORMAT_R32G32B32_SFLOAT;
-        case 4: return VK_FORMAT_R32G32B32A32_SFLOAT;
-        default:
-            assert(!"Unknown vertex attribute format");
-            return VK_FORMAT_UNDEFINED;
-        }
+    case 1: return VK_FORMAT_R32_SFLOAT;
+    case 2: return VK_FORMAT_R32G32_SFLOAT;
+    case 3: return VK_FORMAT_R32G32B32_SFLOAT;
+    case 4: return VK_FORMAT_R32G32B32A32_SFLOAT;
+    default:
+        assert(!"Unknown vertex attribute format");
+        return VK_FORMAT_UNDEFINED;
     }
 }
 
-VertexBuffer::VertexBuffer(Device& device)
+VertexBuffer::VertexBuffer(Device& device, BufferSource source)
     : DeviceRef(device)
+    , m_source(source)
 {
 }
 
@@ -33,18 +35,19 @@ VertexBuffer::~VertexBuffer()
     m_bindingDescriptions.clear();
     m_attributesDescriptions.clear();
     m_bindingOffsets.clear();
+    m_bindingBuffers.clear();
     m_numVertices = 0;
     m_numIndices = 0;
 }
 
-void VertexBuffer::createFromSeparateAttributes(const std::vector<AttributeDescription>& descriptions)
+void VertexBuffer::createFromSeparateAttributes(const std::vector<AttributeDescription>& descriptions, const uint32_t* indices, uint32_t numIndices)
 {
     if (descriptions.empty())
         return;
 
     m_numVertices = descriptions[0].attributeCount;
 
-    auto totalSize = 0;
+    VkDeviceSize totalSize = 0;
     m_attributesDescriptions.resize(descriptions.size());
     m_bindingDescriptions.resize(descriptions.size());
     m_bindingOffsets.resize(descriptions.size());
@@ -56,7 +59,7 @@ void VertexBuffer::createFromSeparateAttributes(const std::vector<AttributeDescr
         VkVertexInputAttributeDescription& attribDesc = m_attributesDescriptions[i];
         attribDesc.binding = i;
         attribDesc.location = desc.location;
-        attribDesc.format = getAttributeFormat(desc.componentCount);
+        attribDesc.format = attributeFormat(desc.componentCount);
         attribDesc.offset = 0;
 
         const auto attributeSize = desc.componentCount * 4;
@@ -71,24 +74,29 @@ void VertexBuffer::createFromSeparateAttributes(const std::vector<AttributeDescr
         totalSize += desc.attributeCount * attributeSize;
     }
 
-    auto memcpyFunc = [&](void *mappedMemory)
+    const auto vertexSize = totalSize;
+    createBuffer(vertexSize, indices, numIndices);
+
+    for (auto i = 0u; i < descriptions.size(); i++)
     {
-        auto data = reinterpret_cast<float*>(mappedMemory);
-        for (auto& desc : descriptions)
-        {
-            const auto attributeSize = desc.componentCount * desc.attributeCount;
-            std::memcpy(data, desc.attributeData, attributeSize * 4);
-            data += attributeSize;
-        }
-    };
-
-    m_vertexBuffer = GPUAttributeStorageBuffer(device(), totalSize);
-    fillBuffer(m_vertexBuffer, memcpyFunc);
+        const auto& desc = descriptions[i];
+        m_buffer.upload(desc.attributeData, desc.componentCount * desc.attributeCount * 4, m_bindingOffsets[i]);
+    }
 }
 
-void VertexBuffer::createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, float* attributeData, const std::vector<InterleavedAttributeDescription>& descriptions)
+void VertexBuffer::createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, float* attributeData, const std::vector<InterleavedAttributeDescription>& descriptions, const uint32_t* indices, uint32_t numIndices)
 {
-    if (vertexCount == 0 || descriptions.empty() || attributeData == nullptr)
+    if (attributeData == nullptr)
+        return;
+
+    const auto bytes = reinterpret_cast<const uint8_t*>(attributeData);
+    createFromInterleavedAttributes(vertexCount, vertexSize, [bytes](void* destination, uint64_t offset, uint64_t size) { std::memcpy(destination, bytes + offset, size); },
+        descriptions, indices, numIndices);
+}
+
+void VertexBuffer::createFromInterleavedAttributes(uint32_t vertexCount, uint32_t vertexSize, const BufferBase::WriteFunc& writeVertices, const std::vector<InterleavedAttributeDescription>& descriptions, const uint32_t* indices, uint32_t numIndices)
+{
+    if (vertexCount == 0 || descriptions.empty() || !writeVertices)
         return;
 
      m_numVertices = vertexCount;
@@ -102,71 +110,49 @@ void VertexBuffer::createFromInterleavedAttributes(uint32_t vertexCount, uint32_
         VkVertexInputAttributeDescription& attribDesc = m_attributesDescriptions[i];
         attribDesc.binding = 0;
         attribDesc.location = desc.location;
-        attribDesc.format = getAttributeFormat(desc.componentCount);
+        attribDesc.format = attributeFormat(desc.componentCount);
         attribDesc.offset = desc.interleavedOffset;
     }
 
     m_bindingDescriptions.assign(1, { 0, vertexSize, VK_VERTEX_INPUT_RATE_VERTEX });
     m_bindingOffsets.assign(1, 0);
     
-    auto memcpyFunc = [&](void *mappedMemory)
-    {
-        auto data = reinterpret_cast<float*>(mappedMemory);
-        std::memcpy(data, attributeData, totalSize);
-    };
-
-    m_vertexBuffer = GPUAttributeStorageBuffer(device(), totalSize);
-    fillBuffer(m_vertexBuffer, memcpyFunc);
-}
-
-void VertexBuffer::setIndices(const uint16_t *indices, uint32_t numIndices)
-{
-     createIndexBuffer(indices, numIndices, VK_INDEX_TYPE_UINT16);
+    createBuffer(totalSize, indices, numIndices);
+    m_buffer.upload(writeVertices, totalSize);
 }
 
-void VertexBuffer::setIndices(const uint32_t *indices, uint32_t numIndices)
-{
-     createIndexBuffer(indices, numIndices, VK_INDEX_TYPE_UINT32);
-}
-
-void VertexBuffer::createIndexBuffer(const void *indices, uint32_t numIndices, VkIndexType indexType)
+void VertexBuffer::createBuffer(VkDeviceSize vertexSize, const uint32_t* indices, uint32_t numIndices)
 {
     m_numIndices = numIndices;
-    m_indexType = indexType;
+    m_indexOffset = alignUp(vertexSize, sizeof(uint32_t));
 
-    const uint32_t size = numIndices * (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    const VkDeviceSize indexSize = numIndices * sizeof(uint32_t);
+    m_buffer = GPUGeometryBuffer(device(), m_indexOffset + indexSize, m_source);
+    m_bindingBuffers.assign(m_bindingDescriptions.size(), m_buffer.buffer());
 
-    auto memcpyFunc = [=](void *mappedMemory) {
-        std::memcpy(mappedMemory, indices, size);
-    };
-
-    m_indexBuffer = GPUIndexBuffer(device(), size);
-    fillBuffer(m_indexBuffer, memcpyFunc);
+    if (numIndices > 0)
+        m_buffer.upload(indices, indexSize, m_indexOffset);
 }
 
 void VertexBuffer::bind(VkCommandBuffer commandBuffer) const
 {
-    for (auto i = 0u; i < m_bindingDescriptions.size(); i++)
-    {
-        VkBuffer buffer{ m_vertexBuffer };
-        vkCmdBindVertexBuffers(commandBuffer, i, 1, &buffer, &m_bindingOffsets[i]);
-    }
+    vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(m_bindingBuffers.size()), m_bindingBuffers.data(), m_bindingOffsets.data());
 
-    if (m_indexBuffer.isValid())
+    if (m_numIndices > 0)
     {
-        vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, m_indexType);
+        vkCmdBindIndexBuffer(commandBuffer, m_buffer.buffer(), m_indexOffset, VK_INDEX_TYPE_UINT32);
     }
 }
 
 void VertexBuffer::drawIndexed(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstIndex, uint32_t indexCount) const
 {
-    assert(m_indexBuffer.isValid());
+    assert(m_numIndices > 0);
     vkCmdDrawIndexed(commandBuffer, indexCount == 0 ? m_numIndices : indexCount, instanceCount, firstIndex, 0, 0);
 }
 
 void VertexBuffer::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount) const
 {
-    assert(!m_indexBuffer.isValid());
+    assert(m_numIndices == 0);
     vkCmdDraw(commandBuffer, m_numVertices, instanceCount, 0, 0);
 }
 
@@ -1,7 +1,15 @@
 #include "basicrenderer.h"
 #include "window.h"
+#include "tlsfallocator.h"
+#include "rendergraph.h"
+#include "resourcestatetracker.h"
+#include "handlecache.h"
+#include "geometrypool.h"
+#include "objfileloader.h"
 
 #include <gtest/gtest.h>
+#include <cstring>
+#include <fstream>
 
 class TestRenderer : public BasicRenderer
 {
@@ -36,3 +44,280 @@ TEST(VulkanBase, DISABLED_createBasicRenderer)
 	renderer.destroy();
 	window.destroy();
 }
+
+TEST(VulkanBase, tlsfAllocatorAlignmentAndCoalescing)
+{
+	TlsfAllocator allocator(1024);
+
+	const auto a = allocator.allocate(100, 16);
+	const auto b = allocator.allocate(200, 256);
+	const auto c = allocator.allocate(100, 16);
+	ASSERT_NE(TlsfAllocator::InvalidHandle, a.handle);
+	ASSERT_NE(TlsfAllocator::InvalidHandle, b.handle);
+	ASSERT_NE(TlsfAllocator::InvalidHandle, c.handle);
+
+	EXPECT_EQ(0u, b.offset % 256);
+	EXPECT_LE(a.offset + a.size, b.offset);
+	EXPECT_EQ(3u, allocator.allocationCount());
+	EXPECT_EQ(TlsfAllocator::InvalidHandle, allocator.allocate(2048, 16).handle);
+
+	allocator.free(a.handle);
+	EXPECT_GT(allocator.stats().freeRangeCount, 1u);
+
+	allocator.free(b.handle);
+	allocator.free(c.handle);
+
+	const auto stats = allocator.stats();
+	EXPECT_TRUE(allocator.empty());
+	EXPECT_EQ(1u, stats.freeRangeCount);
+	EXPECT_EQ(1024u, stats.largestFreeRange);
+}
+
+TEST(VulkanBase, geometryPageAllocatorReusesRanges)
+{
+	GeometryPageAllocator allocator(1024, 3072);
+
+	const auto a = allocator.allocate(600, 1800);
+	const auto b = allocator.allocate(400, 1200);
+	ASSERT_TRUE(a.isValid());
+	ASSERT_TRUE(b.isValid());
+	EXPECT_EQ(0u, b.page);
+	EXPECT_EQ(1u, allocator.pageCount());
+
+	// the first page is full, only then a second one is added
+	const auto c = allocator.allocate(600, 1800);
+	ASSERT_TRUE(c.isValid());
+	EXPECT_EQ(1u, c.page);
+	EXPECT_EQ(2u, allocator.pageCount());
+
+	// freed ranges are reused before another page is added
+	allocator.free(a);
+	const auto d = allocator.allocate(300, 900);
+	ASSERT_TRUE(d.isValid());
+	EXPECT_EQ(0u, d.page);
+	EXPECT_EQ(a.vertices.offset, d.vertices.offset);
+	EXPECT_EQ(a.indices.offset, d.indices.offset);
+	EXPECT_EQ(2u, allocator.pageCount());
+
+	// requests bigger than a page get a page of their own
+	const auto e = allocator.allocate(4096, 100);
+	ASSERT_TRUE(e.isValid());
+	EXPECT_EQ(2u, e.page);
+	EXPECT_GE(allocator.vertexCapacity(e.page), 4096u);
+}
+
+TEST(VulkanBase, memoryTypeRanking)
+{
+	// discrete gpu with a small bar window
+	VkPhysicalDeviceMemoryProperties properties = {};
+	properties.memoryHeapCount = 3;
+	properties.memoryHeaps[0] = { 8ull << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+	properties.memoryHeaps[1] = { 16ull << 30, 0 };
+	properties.memoryHeaps[2] = { 256ull << 20, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+	properties.memoryTypeCount = 4;
+	properties.memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 2 };
+	properties.memoryTypes[1] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+	properties.memoryTypes[2] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+	properties.memoryTypes[3] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+
+	const uint32_t allTypes = 0xf;
+	const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	EXPECT_EQ(2u, Device::findMemoryType(properties, allTypes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+	EXPECT_EQ(1u, Device::findMemoryType(properties, allTypes, hostVisible));
+	EXPECT_EQ(3u, Device::findMemoryType(properties, allTypes, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT));
+	EXPECT_EQ(0u, Device::findMemoryType(properties, allTypes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hostVisible));
+	EXPECT_EQ(2u, Device::findMemoryType(properties, 0x4, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hostVisible));
+	EXPECT_EQ(~0u, Device::findMemoryType(properties, 0x2, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+}
+
+TEST(VulkanBase, renderGraphAliasesDisjointLifetimes)
+{
+	// a chain of passes in which every image is written by one pass and read by the next, plus one image used by all
+	const std::vector<RenderGraph::TransientLifetime> lifetimes = {
+		{ 1024, 256, 0, 1 },
+		{ 512, 256, 1, 2 },
+		{ 1024, 256, 2, 3 },
+		{ 200, 256, 0, 3 } };
+
+	std::vector<VkDeviceSize> offsets;
+	const auto size = RenderGraph::placeTransientResources(lifetimes, offsets);
+	ASSERT_EQ(lifetimes.size(), offsets.size());
+
+	EXPECT_EQ(offsets[0], offsets[2]);
+	EXPECT_EQ(1736u, size);
+
+	for (auto i = 0u; i < lifetimes.size(); i++)
+	{
+		EXPECT_EQ(0u, offsets[i] % lifetimes[i].alignment);
+		EXPECT_LE(offsets[i] + lifetimes[i].size, size);
+
+		for (auto j = i + 1; j < lifetimes.size(); j++)
+		{
+			const bool aliveTogether = lifetimes[i].firstPass <= lifetimes[j].lastPass && lifetimes[j].firstPass <= lifetimes[i].lastPass;
+			const bool sharesMemory = offsets[i] < offsets[j] + lifetimes[j].size && offsets[j] < offsets[i] + lifetimes[i].size;
+			EXPECT_FALSE(aliveTogether && sharesMemory);
+		}
+	}
+}
+
+TEST(VulkanBase, resourceStateTrackerBatchesMinimalBarriers)
+{
+	ResourceStateTracker tracker;
+	const auto buffer = reinterpret_cast<VkBuffer>(uintptr_t(1));
+	const auto image = reinterpret_cast<VkImage>(uintptr_t(2));
+
+	// reads after reads and the first write of a buffer need no barrier
+	const ResourceAccess vertexRead = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT };
+	tracker.bufferAccess(buffer, vertexRead);
+	tracker.bufferAccess(buffer, vertexRead);
+	EXPECT_FALSE(tracker.hasPendingBarriers());
+
+	// a write after the read only waits on the vertex input
+	tracker.bufferAccess(buffer, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT });
+	auto barriers = tracker.takePendingBarriers();
+	ASSERT_EQ(1u, barriers.size());
+	EXPECT_EQ(VkPipelineStageFlags(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT), barriers[0].srcStages);
+	EXPECT_EQ(VkPipelineStageFlags(VK_PIPELINE_STAGE_TRANSFER_BIT), barriers[0].dstStages);
+	EXPECT_EQ(VkAccessFlags(0), barriers[0].srcAccess);
+
+	// the read after the write makes it visible once
+	tracker.bufferAccess(buffer, vertexRead);
+	barriers = tracker.takePendingBarriers();
+	ASSERT_EQ(1u, barriers.size());
+	EXPECT_EQ(VkAccessFlags(VK_ACCESS_TRANSFER_WRITE_BIT), barriers[0].srcAccess);
+	tracker.bufferAccess(buffer, vertexRead);
+	EXPECT_FALSE(tracker.hasPendingBarriers());
+
+	// four layers transitioned together end up in one barrier
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 4 };
+	tracker.imageAccess(image, range, VK_IMAGE_LAYOUT_UNDEFINED, getLayoutAccess(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+	barriers = tracker.takePendingBarriers();
+	ASSERT_EQ(1u, barriers.size());
+	EXPECT_EQ(VK_IMAGE_LAYOUT_UNDEFINED, barriers[0].oldLayout);
+	EXPECT_EQ(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, barriers[0].newLayout);
+	EXPECT_EQ(4u, barriers[0].range.layerCount);
+
+	// only the second layer is sampled afterwards, the fragment shader waits on the copy
+	range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 1, 1 };
+	tracker.imageAccess(image, range, VK_IMAGE_LAYOUT_UNDEFINED, getLayoutAccess(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	tracker.imageAccess(image, range, VK_IMAGE_LAYOUT_UNDEFINED, getLayoutAccess(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	barriers = tracker.takePendingBarriers();
+	ASSERT_EQ(1u, barriers.size());
+	EXPECT_EQ(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, barriers[0].oldLayout);
+	EXPECT_EQ(1u, barriers[0].range.baseArrayLayer);
+	EXPECT_EQ(1u, barriers[0].range.layerCount);
+	EXPECT_EQ(VkPipelineStageFlags(VK_PIPELINE_STAGE_TRANSFER_BIT), barriers[0].srcStages);
+	EXPECT_EQ(VkPipelineStageFlags(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT), barriers[0].dstStages);
+}
+
+TEST(VulkanBase, handleCacheSharesByKey)
+{
+	HandleCache<VkPipelineLayout> cache;
+	const auto layout = reinterpret_cast<VkPipelineLayout>(uintptr_t(1));
+	const HandleCache<VkPipelineLayout>::Key key = { 1, 42 };
+
+	EXPECT_EQ(VK_NULL_HANDLE, cache.acquire(key));
+	cache.add(key, layout);
+
+	// the same content is shared and destroyed with its last reference
+	EXPECT_EQ(layout, cache.acquire(key));
+	EXPECT_EQ(1u, cache.size());
+	EXPECT_FALSE(cache.release(layout));
+	EXPECT_TRUE(cache.release(layout));
+	EXPECT_EQ(0u, cache.size());
+	EXPECT_EQ(VK_NULL_HANDLE, cache.acquire(key));
+
+	// keys are compared as a whole, a prefix or another value is a different create info
+	cache.add(key, layout);
+	EXPECT_EQ(VK_NULL_HANDLE, cache.acquire({ 1 }));
+	EXPECT_EQ(VK_NULL_HANDLE, cache.acquire({ 1, 43 }));
+
+	// references of other cached handles keep it alive
+	EXPECT_TRUE(cache.addReference(layout));
+	EXPECT_FALSE(cache.addReference(reinterpret_cast<VkPipelineLayout>(uintptr_t(2))));
+	EXPECT_FALSE(cache.release(layout));
+
+	const auto leaked = cache.takeAll();
+	ASSERT_EQ(1u, leaked.size());
+	EXPECT_EQ(layout, leaked[0]);
+	EXPECT_EQ(0u, cache.size());
+}
+
+TEST(VulkanBase, pushConstantRangeOfBlock)
+{
+	struct Block
+	{
+		float values[5];
+	};
+
+	const auto range = CommandBuffer::pushConstantRange<Block>(VK_SHADER_STAGE_FRAGMENT_BIT, 8);
+	EXPECT_EQ(VkShaderStageFlags(VK_SHADER_STAGE_FRAGMENT_BIT), range.stageFlags);
+	EXPECT_EQ(8u, range.offset);
+	EXPECT_EQ(20u, range.size);
+}
+
+TEST(VulkanBase, pipelineCacheHeaderValidation)
+{
+	VkPhysicalDeviceProperties properties = {};
+	properties.vendorID = 0x10de;
+	properties.deviceID = 0x2204;
+	for (uint8_t i = 0; i < VK_UUID_SIZE; i++)
+		properties.pipelineCacheUUID[i] = i;
+
+	const uint32_t header[4] = { 16 + VK_UUID_SIZE, VK_PIPELINE_CACHE_HEADER_VERSION_ONE, properties.vendorID, properties.deviceID };
+	std::vector<char> data(sizeof(header) + VK_UUID_SIZE + 64);
+	std::memcpy(data.data(), header, sizeof(header));
+	std::memcpy(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE);
+	EXPECT_TRUE(PipelineCache::isCompatible(data, properties));
+
+	// another driver version changes the uuid
+	auto otherDriver = properties;
+	otherDriver.pipelineCacheUUID[0] = 0xff;
+	EXPECT_FALSE(PipelineCache::isCompatible(data, otherDriver));
+
+	auto otherDevice = properties;
+	otherDevice.deviceID++;
+	EXPECT_FALSE(PipelineCache::isCompatible(data, otherDevice));
+
+	data.resize(sizeof(header));
+	EXPECT_FALSE(PipelineCache::isCompatible(data, properties));
+}
+
+TEST(VulkanBase, objInterleavedVerticesWrittenInChunks)
+{
+	// no normals, so face normals are generated and the vertices are interleaved
+	const auto filename = ::testing::TempDir() + "quad.obj";
+	{
+		std::ofstream file(filename);
+		file << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+		file << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n";
+		file << "f 1/1 2/2 3/3\nf 1/1 3/3 4/4\n";
+	}
+
+	MeshDescription meshDesc;
+	ASSERT_TRUE(ObjFileLoader::read(filename, meshDesc));
+	std::remove(filename.c_str());
+
+	ASSERT_TRUE(meshDesc.geometry.writeVertices);
+	EXPECT_EQ(4u, meshDesc.geometry.vertexCount);
+	EXPECT_EQ(8u, meshDesc.geometry.vertexSize);
+	ASSERT_EQ(6u, meshDesc.geometry.indices.size());
+
+	const uint64_t size = meshDesc.geometry.vertexCount * meshDesc.geometry.vertexSize * sizeof(float);
+	std::vector<float> whole(size / sizeof(float));
+	meshDesc.geometry.writeVertices(whole.data(), 0, size);
+
+	// the staging memory is handed out in chunks which do not respect vertex boundaries
+	std::vector<float> chunked(whole.size());
+	const uint64_t chunkSize = 7;
+	for (uint64_t offset = 0; offset < size; offset += chunkSize)
+		meshDesc.geometry.writeVertices(reinterpret_cast<uint8_t*>(chunked.data()) + offset, offset, std::min(chunkSize, size - offset));
+	EXPECT_EQ(0, std::memcmp(whole.data(), chunked.data(), size));
+
+	const float* third = &whole[meshDesc.geometry.indices[2] * meshDesc.geometry.vertexSize];
+	EXPECT_FLOAT_EQ(1.0f, third[0]);
+	EXPECT_FLOAT_EQ(1.0f, third[1]);
+	EXPECT_FLOAT_EQ(1.0f, third[5]);
+	EXPECT_FLOAT_EQ(0.0f, third[7]);
+}
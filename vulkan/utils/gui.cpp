@@ -5,6 +5,7 @@
 #include "mouseinputhandler.h"
 #include "vulkanhelper.h"
 #include "commandbuffer.h"
+#include "frameringbuffer.h"
 
 #include <imgui.h>
 #include <array>
@@ -14,6 +15,7 @@ const static uint32_t GUI_PARAMETER_BINDING_ID = 0;
 
 GUI::GUI(Device &device)
     : DeviceRef(device)
+    , m_descriptorAllocator(device, 1, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } })
 {
 }
 
@@ -24,7 +26,6 @@ GUI::~GUI()
 
     destroy(m_resources.sampler);
     destroy(m_resources.pipelineLayout);
-    destroy(m_resources.descriptorPool);
     destroy(m_resources.descriptorSetLayout);
 
     if (m_resources.pipeline)
@@ -33,7 +34,7 @@ GUI::~GUI()
         ShaderManager::Release(device(), m_resources.shader);
 }
 
-void GUI::setup(size_t resource_count, uint32_t width, uint32_t height, VkRenderPass renderPass)
+void GUI::setup(uint32_t width, uint32_t height, VkRenderPass renderPass)
 {
     IMGUI_CHECKVERSION();
 
@@ -48,8 +49,6 @@ void GUI::setup(size_t resource_count, uint32_t width, uint32_t height, VkRender
 
     onResize(width, height);
 
-    m_resources.frameResources.resize(resource_count);
-
     createTexture();
     createDescriptorResources();
     createGraphicsPipeline(renderPass);
@@ -102,21 +101,54 @@ void GUI::startFrame(const Statistics& stats, const MouseInputState& mouseState)
     }
 
     ImGui::End();
+
+    drawMemoryStats();
 }
 
-void GUI::draw(uint32_t resource_index, CommandBuffer& commandBuffer)
+void GUI::drawMemoryStats() const
 {
-    m_resources.descriptorSet.bind(commandBuffer, m_resources.pipelineLayout, GUI_PARAMETER_SET_ID);
+    const auto toMB = [](VkDeviceSize bytes) { return static_cast<float>(bytes) / (1024.0f * 1024.0f); };
+    const auto stats = device().memoryStats();
 
-    commandBuffer.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipeline);
+    ImGui::SetNextWindowPos( ImVec2( ImGui::GetIO().DisplaySize.x - 300.0f, 130.0f ), ImGuiCond_FirstUseEver );
+    ImGui::Begin( "Memory", nullptr, ImGuiWindowFlags_AlwaysAutoResize );
+
+    ImGui::TextUnformatted( stats.hasBudget ? "Heaps (usage / budget)" : "Heaps (allocated / size)" );
+    for (size_t i = 0; i < stats.heaps.size(); i++)
+    {
+        const auto& heap = stats.heaps[i];
+        ImGui::Text( "%zu %s %8.1f / %8.1f MB", i, heap.deviceLocal ? "vram" : "ram ", toMB(heap.usage), toMB(heap.budget) );
+        ImGui::ProgressBar( heap.budget > 0 ? static_cast<float>(heap.usage) / static_cast<float>(heap.budget) : 0.0f, ImVec2( 250.0f, 0.0f ) );
+    }
+
+    ImGui::Separator();
+    for (size_t i = 0; i < stats.categories.size(); i++)
+    {
+        const auto& category = stats.categories[i];
+        ImGui::Text( "%-14s %8.1f MB %6u", memoryCategoryName(static_cast<MemoryCategory>(i)), toMB(category.bytes), category.allocationCount );
+    }
+
+    ImGui::End();
+}
 
-    drawFrameData(commandBuffer, m_resources.frameResources[resource_index]);
+void GUI::draw(FrameRingBuffer& frameRingBuffer, CommandBuffer& commandBuffer)
+{
+    record(frameRingBuffer, commandBuffer);
 
     commandBuffer.endRenderPass();    
     commandBuffer.end();
 }
 
-void GUI::drawFrameData(VkCommandBuffer commandBuffer, GUIResources::FrameResources& frameResources)
+void GUI::record(FrameRingBuffer& frameRingBuffer, CommandBuffer& commandBuffer)
+{
+    m_resources.descriptorSet.bind(commandBuffer, m_resources.pipelineLayout, GUI_PARAMETER_SET_ID);
+
+    commandBuffer.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipeline);
+
+    drawFrameData(commandBuffer, frameRingBuffer);
+}
+
+void GUI::drawFrameData(VkCommandBuffer commandBuffer, FrameRingBuffer& frameRingBuffer)
 {
     ImGui::Render();
 
@@ -124,11 +156,14 @@ void GUI::drawFrameData(VkCommandBuffer commandBuffer, GUIResources::FrameResour
     if( drawData->TotalVtxCount == 0 )
         return;
 
-    resizeBufferIfNecessary(frameResources.vertices, drawData->TotalVtxCount, sizeof(ImDrawVert));
-    resizeBufferIfNecessary(frameResources.indices, drawData->TotalIdxCount, sizeof(ImDrawIdx));
+    // the geometry only lives for this frame, so it is written straight into the frame ring buffer
+    const auto vertices = frameRingBuffer.allocate(sizeof(ImDrawVert) * drawData->TotalVtxCount, alignof(ImDrawVert));
+    const auto indices = frameRingBuffer.allocate(sizeof(ImDrawIdx) * drawData->TotalIdxCount, 4);
+    if (!vertices.isValid() || !indices.isValid())
+        return;
 
-    auto vertexPointer = reinterpret_cast<ImDrawVert*>(frameResources.vertices.map());
-    auto indexPointer = reinterpret_cast<ImDrawIdx*>(frameResources.indices.map());
+    auto vertexPointer = reinterpret_cast<ImDrawVert*>(vertices.data);
+    auto indexPointer = reinterpret_cast<ImDrawIdx*>(indices.data);
 
     for( int i = 0; i < drawData->CmdListsCount; i++ )
     {
@@ -141,14 +176,11 @@ void GUI::drawFrameData(VkCommandBuffer commandBuffer, GUIResources::FrameResour
         indexPointer += cmdList->IdxBuffer.Size;
     }
 
-    frameResources.vertices.unmap();
-    frameResources.indices.unmap();
-
     // Bind vertex and index buffers
-    VkBuffer buffer{ frameResources.vertices.buffer() };
-    VkDeviceSize offset{ 0 };
+    VkBuffer buffer{ vertices.buffer };
+    VkDeviceSize offset{ vertices.offset };
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
-    vkCmdBindIndexBuffer(commandBuffer, frameResources.indices.buffer(), 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindIndexBuffer(commandBuffer, indices.buffer, indices.offset, VK_INDEX_TYPE_UINT16);
 
     // Setup scale and translation: xy scale, xy translation
     const std::vector<float> scale_and_translation{ 2.0f / ImGui::GetIO().DisplaySize.x, 2.0f / ImGui::GetIO().DisplaySize.y, -1.0f, -1.0f };
@@ -190,12 +222,10 @@ void GUI::createTexture()
 
 void GUI::createDescriptorResources()
 {
-    m_resources.descriptorPool = device().createDescriptorPool(1, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } });
-
     m_resources.descriptorSetLayout = device().createDescriptorSetLayout({ { GUI_PARAMETER_BINDING_ID, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } });
 
     m_resources.descriptorSet.setImageSampler(GUI_PARAMETER_BINDING_ID, m_resources.image.imageView(), m_resources.sampler);
-    m_resources.descriptorSet.allocateAndUpdate(device(), m_resources.descriptorSetLayout, m_resources.descriptorPool);
+    m_resources.descriptorSet.allocateAndUpdate(m_descriptorAllocator, m_resources.descriptorSetLayout);
 }
 
 bool GUI::createGraphicsPipeline(VkRenderPass renderPass)
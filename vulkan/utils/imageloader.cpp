@@ -1,18 +1,51 @@
-#include "imageloader.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-Texture ImageLoader::load(const Device& device, const std::string& filename)
-{
-    int texWidth, texHeight, numChannels;
-    stbi_uc* pixels = stbi_load(filename.c_str(), &texWidth, &texHeight, &numChannels, STBI_rgb_alpha);
-    if (!pixels)
-    {
-        printf("Error: could not load texture %s, reason: %s\n", filename.c_str(), stbi_failure_reason());
-        return Texture();
-    }
-
-    Texture texture(device, pixels, { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) }, VK_FORMAT_R8G8B8A8_UNORM);
-    texture.setTranspareny(numChannels == 4);
-    return texture;
-}
+#include "imageloader.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <cstring>
+
+Texture ImageLoader::load(const Device& device, const std::string& filename)
+{
+    int texWidth, texHeight, numChannels;
+    // the image is decoded with its own channels, expanding it to RGBA happens while writing into the staging memory
+    stbi_uc* pixels = stbi_load(filename.c_str(), &texWidth, &texHeight, &numChannels, 0);
+    if (!pixels)
+    {
+        printf("Error: could not load texture %s, reason: %s\n", filename.c_str(), stbi_failure_reason());
+        return Texture();
+    }
+
+    ImageBase::WriteFunc writePixels;
+    if (numChannels == STBI_rgb_alpha)
+    {
+        writePixels = [pixels](void* destination, uint64_t offset, uint64_t size) { std::memcpy(destination, pixels + offset, size); };
+    }
+    else
+    {
+        // same expansion as stb_image: grey is replicated, missing alpha is opaque
+        writePixels = [pixels, numChannels](void* destination, uint64_t offset, uint64_t size)
+        {
+            auto target = static_cast<uint8_t*>(destination);
+            for (uint64_t byte = offset; byte < offset + size; byte++)
+            {
+                const stbi_uc* pixel = pixels + (byte / 4) * numChannels;
+                const auto channel = byte % 4;
+                if (channel == 3)
+                {
+                    *target++ = numChannels == STBI_grey_alpha ? pixel[1] : 255;
+                }
+                else
+                {
+                    *target++ = numChannels < STBI_rgb ? pixel[0] : pixel[channel];
+                }
+            }
+        };
+    }
+
+    Texture texture(device, writePixels, { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) }, VK_FORMAT_R8G8B8A8_UNORM);
+    // the pixels are written into staging memory right away, so the decoded image can be released before the next one is loaded
+    texture.setTranspareny(numChannels == STBI_rgb_alpha);
+    stbi_image_free(pixels);
+    return texture;
+}
@@ -1,23 +1,49 @@
 #include "mesh.h"
 #include "device.h"
+#include "commandbuffer.h"
 #include "shader.h"
 #include "image.h"
 #include "imageloader.h"
 #include "../utils/scopedtimelog.h"
 
 #include <algorithm>
+#include <array>
 #include <iostream>
+#include <map>
 
-const uint32_t SET_ID_CAMERA = 0;
-const uint32_t BINDING_ID_CAMERA = 0;
 const uint32_t SET_ID_MATERIAL = 1;
 const uint32_t BINDING_ID_MATERIAL = 0;
-const uint32_t BINDING_ID_TEXTURE_DIFFUSE = 1;
+const uint32_t SET_ID_TEXTURE = 2;
+const uint32_t BINDING_ID_TEXTURE_DIFFUSE = 0;
+
+namespace
+{
+    // matches the Material struct of the shaders, the index is into the bindless textures
+    struct MaterialConstants
+    {
+        glm::vec4 ambient;
+        glm::vec4 diffuse;
+        glm::vec4 emission;
+        uint32_t textureIndex;
+        uint32_t padding[3] = {};
+    };
+
+    using MaterialKey = std::pair<std::array<float, 9>, std::string>;
+
+    MaterialKey materialKey(const MaterialDescription& material)
+    {
+        return { { material.ambient.x, material.ambient.y, material.ambient.z,
+                   material.diffuse.x, material.diffuse.y, material.diffuse.z,
+                   material.emission.x, material.emission.y, material.emission.z },
+                 material.textureFilename };
+    }
+}
 
 
 Mesh::Mesh(Device& device)
     : DeviceRef(device)
     , m_vertexBuffer(device)
+    , m_descriptorAllocator(device)
 {
 }
 
@@ -25,6 +51,9 @@ Mesh::~Mesh()
 {
     m_shapes.clear();
 
+    if (m_geometryPool)
+        m_geometryPool->free(m_geometry);
+
     for (auto& desc : m_materials)
     {
         GraphicsPipeline::Release(device(), desc.pipeline);
@@ -32,25 +61,32 @@ Mesh::~Mesh()
     }
     m_materials.clear();
 
-    destroy(m_cameraDescriptorSetLayout);
+    if (m_bindlessTextures)
+    {
+        for (const auto& texture : m_textures)
+            m_bindlessTextures->remove(texture.bindlessIndex);
+    }
+
     destroy(m_materialDescriptorSetLayout);
+    destroy(m_textureDescriptorSetLayout);
     destroy(m_pipelineLayout);
-    destroy(m_materialDescriptorPool);
-    destroy(m_cameraDescriptorPool);
     destroy(m_sampler);  
 }
 
-bool Mesh::init(const MeshDescription& meshDesc, VkBuffer cameraUniformBuffer, VkRenderPass renderPass)
+bool Mesh::init(const MeshDescription& meshDesc, const FrameDescriptorSet& frameDescriptorSet, VkRenderPass renderPass, GeometryPool* geometryPool,
+    BindlessTextures* bindlessTextures)
 {
     m_shapes = meshDesc.shapes;
-    m_sampler = device().createSampler();
+    m_bindlessTextures = bindlessTextures;
+    if (!m_bindlessTextures)
+        m_sampler = device().createSampler();
 
     if (!loadMaterials(meshDesc.materials))
         return false;
 
-    createVertexBuffer(meshDesc.geometry);
-    createDescriptors(cameraUniformBuffer);
-    if (!createPipelines(renderPass))
+    createVertexBuffer(meshDesc.geometry, geometryPool);
+    createDescriptors();
+    if (!createPipelines(renderPass, frameDescriptorSet))
         return false;
 
     return true;
@@ -61,47 +97,83 @@ bool Mesh::loadMaterials(const std::vector<MaterialDescription>& materials)
     if (m_shapes.empty())
         return false;
 
-    std::cout << "Found " << materials.size() << " materials" << std::endl;
-
     ScopedTimeLog log("Loading materials");
 
-    // TODO: only load used materials
-    m_materials.resize(materials.size());
-    auto materialDescIter = m_materials.begin();
+    // only materials used by a shape are loaded, identical ones share the same packed id
+    std::vector<uint32_t> packedIds(materials.size(), UINT32_MAX);
+    std::map<MaterialKey, uint32_t> uniqueMaterials;
+    std::vector<MaterialConstants> constants;
 
-    for (auto& material : materials)
+    for (auto& shape : m_shapes)
     {
-        auto& desc = *materialDescIter++;
+        assert(shape.materialId < materials.size());
+        auto& packedId = packedIds[shape.materialId];
+        if (packedId == UINT32_MAX)
+        {
+            const auto& material = materials[shape.materialId];
+            const auto inserted = uniqueMaterials.emplace(materialKey(material), static_cast<uint32_t>(m_materials.size()));
+            packedId = inserted.first->second;
 
-        const uint32_t uboSize = sizeof(glm::vec4) + sizeof(glm::vec4) + sizeof(glm::vec4);
+            if (inserted.second)
+            {
+                MaterialDesc desc;
+                if (!material.textureFilename.empty())
+                    desc.textureId = loadTexture(material.textureFilename);
 
-        desc.material = UniformBuffer(device(), uboSize);
-        desc.material.fill([&](auto data) {
-            std::memcpy(data, &material.ambient, 3 * sizeof(float));
-            std::memcpy(static_cast<char*>(data) + 4 * sizeof(float), &material.diffuse, 3 * sizeof(float));
-            std::memcpy(static_cast<char*>(data) + 8 * sizeof(float), &material.emission, 3 * sizeof(float));
-        });
+                desc.shader = selectShaderFromAttributes(desc.textureId != NoTexture);
+                if (!desc.shader)
+                    return false;
 
-        desc.descriptorSet.setUniformBuffer(BINDING_ID_MATERIAL, desc.material);
+                m_materials.push_back(desc);
 
-        if (!material.textureFilename.empty())
-        {
-            desc.diffuseTexture = ImageLoader::load(device(), material.textureFilename);
-            if (desc.diffuseTexture)
-            {
-                desc.descriptorSet.setImageSampler(BINDING_ID_TEXTURE_DIFFUSE, desc.diffuseTexture.imageView(), m_sampler);
+                const auto textureIndex = desc.textureId != NoTexture ? m_textures[desc.textureId].bindlessIndex : BindlessTextures::InvalidIndex;
+                constants.push_back({ glm::vec4(material.ambient, 0.0f), glm::vec4(material.diffuse, 0.0f), glm::vec4(material.emission, 0.0f), textureIndex });
             }
         }
-
-        desc.shader = selectShaderFromAttributes(desc.diffuseTexture);
-        if (!desc.shader)
-            return false;
+        shape.materialId = packedId;
     }
 
+    // keeps shapes with the same material next to each other after merging duplicates
+    std::stable_sort(m_shapes.begin(), m_shapes.end(), [](const ShapeDescription& a, const ShapeDescription& b) { return a.materialId < b.materialId; });
+
+    std::cout << "Found " << materials.size() << " materials, " << m_materials.size() << " unique ones are used" << std::endl;
+
+    const auto bufferSize = constants.size() * sizeof(MaterialConstants);
+    m_materialBuffer = GPUStorageBuffer(device(), bufferSize, BufferSource::Cpu);
+    m_materialBuffer.upload(constants.data(), bufferSize);
+
     return true;
 }
 
-Shader Mesh::selectShaderFromAttributes(bool useTexture)
+uint32_t Mesh::loadTexture(const std::string& filename)
+{
+    const auto textureIter = std::find_if(m_textures.begin(), m_textures.end(), [&](const auto& texture) { return texture.filename == filename; });
+    if (textureIter != m_textures.end())
+        return static_cast<uint32_t>(std::distance(m_textures.begin(), textureIter));
+
+    auto texture = ImageLoader::load(device(), filename);
+    if (!texture)
+        return NoTexture;
+
+    auto bindlessIndex = BindlessTextures::InvalidIndex;
+    if (m_bindlessTextures)
+    {
+        bindlessIndex = m_bindlessTextures->add(texture.imageView());
+        if (bindlessIndex == BindlessTextures::InvalidIndex)
+        {
+            std::cout << "Bindless texture array is full, skipping " << filename << std::endl;
+            return NoTexture;
+        }
+    }
+
+    m_textures.emplace_back();
+    m_textures.back().bindlessIndex = bindlessIndex;
+    m_textures.back().image = std::move(texture);
+    m_textures.back().filename = filename;
+    return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+Shader Mesh::selectShaderFromAttributes(bool useTexture) const
 {
     const static std::string shaderPath = "data/shaders/";
     std::string vertexShaderName = "color_normal";
@@ -111,6 +183,11 @@ Shader Mesh::selectShaderFromAttributes(bool useTexture)
     {
         vertexShaderName += "_texture";
         fragmemtShaderName += "_texture";
+        if (m_bindlessTextures)
+        {
+            vertexShaderName += "_bindless";
+            fragmemtShaderName += "_bindless";
+        }
     }
     
     const auto vertexShaderFilename = shaderPath + vertexShaderName + ".vert.spv";
@@ -121,52 +198,66 @@ Shader Mesh::selectShaderFromAttributes(bool useTexture)
           { VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShaderFilename} });
 }
 
-void Mesh::createVertexBuffer(const MeshDescription::Geometry& geometry)
+void Mesh::createVertexBuffer(const MeshDescription::Geometry& geometry, GeometryPool* geometryPool)
 {
     assert(!geometry.vertexAttribs.empty() || !geometry.interleavedVertexAttribs.empty());
 
+    const auto vertexSize = geometry.vertexSize * static_cast<uint32_t>(sizeof(float));
+    if (geometryPool && geometry.vertexAttribs.empty() && !geometry.indices.empty() && geometryPool->isCompatible(vertexSize, geometry.interleavedVertexAttribs))
+    {
+        m_geometry = geometryPool->allocate(geometry.writeVertices, geometry.vertexCount, geometry.indices.data(), static_cast<uint32_t>(geometry.indices.size()));
+        if (m_geometry.isValid())
+        {
+            m_geometryPool = geometryPool;
+            return;
+        }
+    }
+
+    const auto indexCount = static_cast<uint32_t>(geometry.indices.size());
     if (!geometry.vertexAttribs.empty())
     {
-        m_vertexBuffer.createFromSeparateAttributes(geometry.vertexAttribs);
+        m_vertexBuffer.createFromSeparateAttributes(geometry.vertexAttribs, geometry.indices.data(), indexCount);
     }
     else
     {
-        m_vertexBuffer.createFromInterleavedAttributes(geometry.vertexCount, geometry.vertexSize * sizeof(float), const_cast<float*>(geometry.vertices.data()), geometry.interleavedVertexAttribs);
+        m_vertexBuffer.createFromInterleavedAttributes(geometry.vertexCount, geometry.vertexSize * sizeof(float), geometry.writeVertices, geometry.interleavedVertexAttribs, geometry.indices.data(), indexCount);
     }
-
-    m_vertexBuffer.setIndices(geometry.indices.data(), static_cast<uint32_t>(geometry.indices.size()));
 }
 
-void Mesh::createDescriptors(VkBuffer cameraUniformBuffer)
+void Mesh::createDescriptors()
 {
-    m_cameraUniformDescriptorSet.setUniformBuffer(BINDING_ID_CAMERA, cameraUniformBuffer);
-
-    m_cameraDescriptorPool = device().createDescriptorPool(1, { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 } });
-
-    m_cameraDescriptorSetLayout = device().createDescriptorSetLayout({ { BINDING_ID_CAMERA, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT } });
+    m_materialDescriptorSetLayout = device().createDescriptorSetLayout({ { BINDING_ID_MATERIAL, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT } });
 
-    m_cameraUniformDescriptorSet.allocateAndUpdate(device(), m_cameraDescriptorSetLayout, m_cameraDescriptorPool);
+    m_materialDescriptorSet.setStorageBuffer(BINDING_ID_MATERIAL, m_materialBuffer);
+    m_materialDescriptorSet.allocate(m_descriptorAllocator, m_materialDescriptorSetLayout);
 
-    const auto materialDescriptorCount = static_cast<uint32_t>(m_materials.size());
+    // all sets of the mesh are written with a single vkUpdateDescriptorSets
+    DescriptorUpdateBatch updateBatch;
+    updateBatch.add(m_materialDescriptorSet);
 
-    m_materialDescriptorPool = device().createDescriptorPool(materialDescriptorCount,
-        { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, materialDescriptorCount },
-          { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, materialDescriptorCount } });
+    // bindless textures were written into the shared array when they were loaded
+    if (!m_bindlessTextures)
+    {
+        m_textureDescriptorSetLayout = device().createDescriptorSetLayout({ { BINDING_ID_TEXTURE_DIFFUSE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } });
 
-    m_materialDescriptorSetLayout = device().createDescriptorSetLayout( 
-        { { BINDING_ID_MATERIAL, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT },
-          { BINDING_ID_TEXTURE_DIFFUSE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT } });
+        for (auto& texture : m_textures)
+        {
+            texture.descriptorSet.setImageSampler(BINDING_ID_TEXTURE_DIFFUSE, texture.image.imageView(), m_sampler);
+            texture.descriptorSet.allocate(m_descriptorAllocator, m_textureDescriptorSetLayout);
+            updateBatch.add(texture.descriptorSet);
+        }
+    }
+    updateBatch.submit(device());
 }
 
-bool Mesh::createPipelines(VkRenderPass renderPass)
+bool Mesh::createPipelines(VkRenderPass renderPass, const FrameDescriptorSet& frameDescriptorSet)
 {
-    m_pipelineLayout = device().createPipelineLayout({ m_cameraDescriptorSetLayout, m_materialDescriptorSetLayout });
+    const auto textureDescriptorSetLayout = m_bindlessTextures ? m_bindlessTextures->layout() : m_textureDescriptorSetLayout;
+    m_pipelineLayout = frameDescriptorSet.createPipelineLayout({ m_materialDescriptorSetLayout, textureDescriptorSetLayout });
 
     for (auto& desc : m_materials)
     {
-        desc.descriptorSet.allocateAndUpdate(device(), m_materialDescriptorSetLayout, m_materialDescriptorPool);
-
-        auto isTransparent = desc.diffuseTexture && desc.diffuseTexture.transpareny();
+        auto isTransparent = desc.textureId != NoTexture && m_textures[desc.textureId].image.transpareny();
 
         GraphicsPipelineSettings settings;
         settings.setCullMode(isTransparent ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT);
@@ -180,8 +271,8 @@ bool Mesh::createPipelines(VkRenderPass renderPass)
             m_pipelineLayout,
             settings,
             desc.shader.shaderStageCreateInfos,
-            m_vertexBuffer.getAttributeDescriptions(),
-            m_vertexBuffer.getBindingDescriptions());
+            m_geometryPool ? m_geometryPool->getAttributeDescriptions() : m_vertexBuffer.getAttributeDescriptions(),
+            m_geometryPool ? m_geometryPool->getBindingDescriptions() : m_vertexBuffer.getBindingDescriptions());
 
         if (!desc.pipeline)
         {
@@ -192,17 +283,32 @@ bool Mesh::createPipelines(VkRenderPass renderPass)
     return true;
 }
 
-void Mesh::render(VkCommandBuffer commandBuffer) const
+void Mesh::render(CommandBuffer& commandBuffer) const
 {
+    render(commandBuffer, 0, numShapes());
+}
+
+void Mesh::render(CommandBuffer& commandBuffer, uint32_t firstShape, uint32_t shapeCount) const
+{
+    assert(firstShape + shapeCount <= m_shapes.size());
+
     VkPipeline currentPipeline = VK_NULL_HANDLE;
+    uint32_t currentTextureId = NoTexture;
 
-    m_vertexBuffer.bind(commandBuffer);
+    if (m_geometryPool)
+        m_geometryPool->bind(commandBuffer, m_geometry.page);
+    else
+        m_vertexBuffer.bind(commandBuffer);
 
-    m_cameraUniformDescriptorSet.bind(commandBuffer, m_pipelineLayout, SET_ID_CAMERA);
+    m_materialDescriptorSet.bind(commandBuffer, m_pipelineLayout, SET_ID_MATERIAL);
+    // the shaders find the texture through the material, so only the pipeline and the material id change per shape
+    if (m_bindlessTextures)
+        m_bindlessTextures->bind(commandBuffer, m_pipelineLayout, SET_ID_TEXTURE);
 
-    for (const auto& shape : m_shapes)
+    for (auto i = firstShape; i < firstShape + shapeCount; i++)
     {
-        assert(shape.materialId <= m_materials.size());
+        const auto& shape = m_shapes[i];
+        assert(shape.materialId < m_materials.size());
         const auto& materialDesc = m_materials[shape.materialId];
 
         if (currentPipeline != materialDesc.pipeline)
@@ -211,20 +317,30 @@ void Mesh::render(VkCommandBuffer commandBuffer) const
             currentPipeline = materialDesc.pipeline;
         }
 
-        materialDesc.descriptorSet.bind(commandBuffer, m_pipelineLayout, SET_ID_MATERIAL);
+        if (!m_bindlessTextures && materialDesc.textureId != NoTexture && currentTextureId != materialDesc.textureId)
+        {
+            m_textures[materialDesc.textureId].descriptorSet.bind(commandBuffer, m_pipelineLayout, SET_ID_TEXTURE);
+            currentTextureId = materialDesc.textureId;
+        }
+
+        const DrawParameters drawParameters = { shape.materialId };
+        commandBuffer.pushConstants(m_pipelineLayout, FrameDescriptorSet::PushConstantRange.stageFlags, drawParameters);
 
-        m_vertexBuffer.drawIndexed(commandBuffer, 1, shape.startIndex, shape.indexCount);
+        if (m_geometryPool)
+            m_geometryPool->drawIndexed(commandBuffer, m_geometry, shape.startIndex, shape.indexCount);
+        else
+            m_vertexBuffer.drawIndexed(commandBuffer, 1, shape.startIndex, shape.indexCount);
     }
 }
 
 uint32_t Mesh::numVertices() const
 {
-    return m_vertexBuffer.numVertices();
+    return m_geometryPool ? m_geometry.vertexCount : m_vertexBuffer.numVertices();
 }
 
 uint32_t Mesh::numTriangles() const
 {
-    return m_vertexBuffer.numIndices() / 3;
+    return (m_geometryPool ? m_geometry.indexCount : m_vertexBuffer.numIndices()) / 3;
 }
 
 uint32_t Mesh::numShapes() const
@@ -1,11 +1,16 @@
 #include "vertexbuffer.h"
+#include "geometrypool.h"
 #include "graphicspipeline.h"
 #include "descriptorset.h"
+#include "descriptorallocator.h"
+#include "bindlesstextures.h"
+#include "framedescriptorset.h"
 #include "shader.h"
 #include "image.h"
 #include "meshdescription.h"
 
 class Device;
+class CommandBuffer;
 
 class Mesh : public DeviceRef
 {
@@ -13,38 +18,66 @@ public:
     Mesh(Device& device);
     ~Mesh();
 
-    bool init(const MeshDescription& meshDesc, VkBuffer cameraUniformBuffer, VkRenderPass renderPass);
-    void render(VkCommandBuffer commandBuffer) const;
+    // interleaved geometry matching the layout of the pool is placed into it instead of an own vertex buffer,
+    // with bindless textures all textures are added to the shared array and no set is bound per shape
+    bool init(const MeshDescription& meshDesc, const FrameDescriptorSet& frameDescriptorSet, VkRenderPass renderPass, GeometryPool* geometryPool = nullptr,
+        BindlessTextures* bindlessTextures = nullptr);
+    // the frame descriptor set has to be bound to the command buffer
+    void render(CommandBuffer& commandBuffer) const;
+    // binds all other state itself, so ranges of shapes can be recorded into separate command buffers
+    void render(CommandBuffer& commandBuffer, uint32_t firstShape, uint32_t shapeCount) const;
 
     uint32_t numVertices() const;
     uint32_t numTriangles() const;
     uint32_t numShapes() const;
+    bool isBindless() const { return m_bindlessTextures != nullptr; }
 
 protected:
-    void createVertexBuffer(const MeshDescription::Geometry& geometry);
+    void createVertexBuffer(const MeshDescription::Geometry& geometry, GeometryPool* geometryPool);
 
-    Shader selectShaderFromAttributes(bool useTexture);
+    Shader selectShaderFromAttributes(bool useTexture) const;
     bool loadMaterials(const std::vector<MaterialDescription>& materials);
-    void createDescriptors(VkBuffer cameraUniformBuffer);
-    bool createPipelines(VkRenderPass renderPass);
+    uint32_t loadTexture(const std::string& filename);
+    void createDescriptors();
+    bool createPipelines(VkRenderPass renderPass, const FrameDescriptorSet& frameDescriptorSet);
 
     VkSampler m_sampler = VK_NULL_HANDLE;
     VertexBuffer m_vertexBuffer;
+    GeometryPool* m_geometryPool = nullptr;
+    GeometryPool::Allocation m_geometry;
+    BindlessTextures* m_bindlessTextures = nullptr;
 
-    VkDescriptorSetLayout m_cameraDescriptorSetLayout = VK_NULL_HANDLE;
-    VkDescriptorPool m_cameraDescriptorPool = VK_NULL_HANDLE;
-    DescriptorSet m_cameraUniformDescriptorSet;
+    DescriptorAllocator m_descriptorAllocator;
     VkDescriptorSetLayout m_materialDescriptorSetLayout = VK_NULL_HANDLE;
-    VkDescriptorPool m_materialDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_textureDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
 
+    // constants of all used materials, the shader picks its entry by the pushed material id
+    GPUStorageBuffer m_materialBuffer;
+    DescriptorSet m_materialDescriptorSet;
+
+    // matches the DrawParameters push constant block of the shaders
+    struct DrawParameters
+    {
+        uint32_t materialId;
+    };
+
+    struct TextureDesc
+    {
+        std::string filename;
+        Texture image;
+        DescriptorSet descriptorSet;
+        uint32_t bindlessIndex = BindlessTextures::InvalidIndex;
+    };
+    std::vector<TextureDesc> m_textures;
+
+    static const uint32_t NoTexture = UINT32_MAX;
+
     struct MaterialDesc
     {
-        UniformBuffer material;
         Shader shader;
-        Texture diffuseTexture;
-        VkPipeline pipeline;
-        DescriptorSet descriptorSet;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        uint32_t textureId = NoTexture;
     };
     std::vector<MaterialDesc> m_materials;
     std::vector<ShapeDescription> m_shapes;
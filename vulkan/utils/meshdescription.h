@@ -39,7 +39,10 @@ struct MeshDescription
         uint32_t vertexCount = 0;
         std::vector<VertexBuffer::AttributeDescription> vertexAttribs;
         std::vector<VertexBuffer::InterleavedAttributeDescription> interleavedVertexAttribs;
-        std::vector<float> vertices;
+        // writes the bytes [offset, offset + size) of the interleaved vertices, so they are produced straight into
+        // the staging memory and never held as a whole. Separate attributes point into attributeStreams.
+        BufferBase::WriteFunc writeVertices;
+        std::vector<std::vector<float>> attributeStreams;
         std::vector<uint32_t> indices;
     } geometry;
  
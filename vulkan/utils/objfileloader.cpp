@@ -6,6 +6,7 @@
 #include <tiny_obj_loader.h>
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <unordered_map>
 #include <memory>
@@ -40,7 +41,8 @@ namespace
                  (!attrib.texcoords.empty() && (attrib.texcoords.size() / 2)  != (attrib.vertices.size() / 3))));
     }
 
-    void createSeparateVertexAttributes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, MeshDescription& meshDesc)
+    // the attribute arrays and shape indices of tinyobj are consumed, so the mesh is never held twice in memory
+    void createSeparateVertexAttributes(tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, MeshDescription& meshDesc)
     {
         ScopedTimeLog log("Creating separate vertex data");
 
@@ -50,39 +52,40 @@ namespace
 
         meshDesc.shapes.push_back({ 0u, numIndices, 0u });
 
-        for (const auto& shape : shapes)
+        for (auto& shape : shapes)
         {
             for (const auto& index : shape.mesh.indices)
             {
                 assert(index.vertex_index >= 0);
                 meshDesc.geometry.indices.push_back(static_cast<uint32_t>(index.vertex_index));
             }
+            std::vector<tinyobj::index_t>().swap(shape.mesh.indices);
         }
 
         const auto vertexCount = static_cast<uint32_t>(attrib.vertices.size() / 3);
 
-        meshDesc.geometry.vertices.resize(attrib.vertices.size() + attrib.normals.size() + attrib.texcoords.size());
-        std::copy(attrib.vertices.begin(), attrib.vertices.end(), meshDesc.geometry.vertices.begin());
-        meshDesc.geometry.vertexAttribs.emplace_back(0, 3, vertexCount, meshDesc.geometry.vertices.data());
-        auto offset = attrib.vertices.size();
+        // moving keeps the data pointers of the streams valid
+        auto& streams = meshDesc.geometry.attributeStreams;
+        streams.reserve(3);
+        streams.push_back(std::move(attrib.vertices));
+        meshDesc.geometry.vertexAttribs.emplace_back(0, 3, vertexCount, streams.back().data());
         if (!attrib.normals.empty())
         {
-            std::copy(attrib.normals.begin(), attrib.normals.end(), meshDesc.geometry.vertices.begin() + offset);
-            meshDesc.geometry.vertexAttribs.emplace_back(1, 3, vertexCount, meshDesc.geometry.vertices.data() + offset);
-            offset += attrib.normals.size();
+            streams.push_back(std::move(attrib.normals));
+            meshDesc.geometry.vertexAttribs.emplace_back(1, 3, vertexCount, streams.back().data());
         }
         if (!attrib.texcoords.empty())
         {
-            std::copy(attrib.texcoords.begin(), attrib.texcoords.end(), meshDesc.geometry.vertices.begin() + offset);
-            meshDesc.geometry.vertexAttribs.emplace_back(2, 2, vertexCount, meshDesc.geometry.vertices.data() + offset);
-            std::for_each(meshDesc.geometry.vertices.begin() + offset, meshDesc.geometry.vertices.end(), [isTCoord = false](float& texcoords) mutable { if (isTCoord) texcoords  = -texcoords; isTCoord = !isTCoord; });
+            streams.push_back(std::move(attrib.texcoords));
+            meshDesc.geometry.vertexAttribs.emplace_back(2, 2, vertexCount, streams.back().data());
+            std::for_each(streams.back().begin(), streams.back().end(), [isTCoord = false](float& texcoords) mutable { if (isTCoord) texcoords  = -texcoords; isTCoord = !isTCoord; });
 
         }
         meshDesc.geometry.vertexSize = 0;
         meshDesc.geometry.vertexCount = vertexCount;
 
         std::cout << "Triangle count:\t " << meshDesc.geometry.indices.size() / 3 << std::endl;
-        std::cout << "Vertex count:\t " << attrib.vertices.size() / 3 << std::endl;
+        std::cout << "Vertex count:\t " << vertexCount << std::endl;
     }
 
     uint32_t addShape(uint32_t startIndex, int materialId, MeshDescription& meshDesc)
@@ -93,43 +96,87 @@ namespace
         return stopIndex;
     }
 
-    glm::vec3 calculateFaceNormal(const tinyobj::attrib_t& attrib, const tinyobj::index_t idx0, const tinyobj::index_t idx1, const tinyobj::index_t idx2)
+    // the unique vertices only reference their attributes, the interleaved vertices are built while they are written
+    struct InterleavedVertexSource
     {
-        const auto v0 = glm::make_vec3(&attrib.vertices[3 * idx0.vertex_index]);
-        const auto v1 = glm::make_vec3(&attrib.vertices[3 * idx1.vertex_index]);
-        const auto v2 = glm::make_vec3(&attrib.vertices[3 * idx2.vertex_index]);
+        struct Vertex
+        {
+            uint32_t position;
+            uint32_t normal;
+            uint32_t texcoord;
+        };
+
+        std::vector<tinyobj::real_t> positions;
+        std::vector<tinyobj::real_t> normals;
+        std::vector<tinyobj::real_t> texcoords;
+        std::vector<Vertex> vertices;
+        uint32_t vertexSize = 0;
+
+        void build(const Vertex& vertex, float* destination) const
+        {
+            memcpy(destination + 0, &positions[3 * vertex.position], 3 * sizeof(float));
+            memcpy(destination + 3, &normals[3 * vertex.normal], 3 * sizeof(float));
+            if (!texcoords.empty())
+            {
+                destination[6] = texcoords[2 * vertex.texcoord + 0];
+                destination[7] = 1.0f - texcoords[2 * vertex.texcoord + 1];
+            }
+        }
+
+        // the range may start or end within a vertex, the staging memory is handed out in chunks
+        void write(void* destination, uint64_t offset, uint64_t size) const
+        {
+            const uint64_t vertexBytes = vertexSize * sizeof(float);
+            auto target = static_cast<uint8_t*>(destination);
+            float vertex[8];
+            for (auto id = offset / vertexBytes; size > 0; id++)
+            {
+                build(vertices[id], vertex);
+                const auto begin = offset - id * vertexBytes;
+                const auto count = std::min(vertexBytes - begin, size);
+                memcpy(target, reinterpret_cast<const uint8_t*>(vertex) + begin, count);
+                target += count;
+                offset += count;
+                size -= count;
+            }
+        }
+
+        uint64_t byteSize() const
+        {
+            return (positions.size() + normals.size() + texcoords.size()) * sizeof(tinyobj::real_t) + vertices.size() * sizeof(Vertex);
+        }
+    };
+
+    glm::vec3 calculateFaceNormal(const std::vector<tinyobj::real_t>& positions, const tinyobj::index_t idx0, const tinyobj::index_t idx1, const tinyobj::index_t idx2)
+    {
+        const auto v0 = glm::make_vec3(&positions[3 * idx0.vertex_index]);
+        const auto v1 = glm::make_vec3(&positions[3 * idx1.vertex_index]);
+        const auto v2 = glm::make_vec3(&positions[3 * idx2.vertex_index]);
         const auto v10 = v1 - v0;
         const auto v20 = v2 - v0;
         return glm::normalize(glm::cross(v10, v20));
     }
 
-    void addVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t index, UniqueVertexMap& uniqueVertices, const glm::vec3& faceNormal, MeshDescription& meshDesc, uint32_t& vertexOffset)
+    // returns true if the vertex was not seen before
+    bool addVertex(InterleavedVertexSource& source, const tinyobj::index_t index, uint32_t normalIndex, UniqueVertexMap& uniqueVertices, MeshDescription& meshDesc)
     {
         assert(index.vertex_index >= 0);
+        assert(source.texcoords.empty() || index.texcoord_index >= 0);
 
-        memcpy(&meshDesc.geometry.vertices[vertexOffset + 0], &attrib.vertices[3 * index.vertex_index], 3 * sizeof(float));
-        memcpy(&meshDesc.geometry.vertices[vertexOffset + 3], &faceNormal.x, 3 * sizeof(float));
+        const InterleavedVertexSource::Vertex vertex = { static_cast<uint32_t>(index.vertex_index), normalIndex, source.texcoords.empty() ? 0u : static_cast<uint32_t>(index.texcoord_index) };
 
-        uint32_t currentSize = 6;
-        if (!attrib.texcoords.empty())
-        {
-            assert(index.texcoord_index >= 0);
-            meshDesc.geometry.vertices[vertexOffset + 6] = attrib.texcoords[2 * index.texcoord_index + 0];
-            meshDesc.geometry.vertices[vertexOffset + 7] = 1.0f - attrib.texcoords[2 * index.texcoord_index + 1];
-            currentSize += 2;
-        }
+        float data[8];
+        source.build(vertex, data);
 
-        assert(meshDesc.geometry.vertexSize == currentSize);
-
-        const auto vertexHash = Hasher::hashme(reinterpret_cast<const unsigned char*>(&meshDesc.geometry.vertices[vertexOffset]), currentSize * sizeof(float));
-        if (uniqueVertices.count(vertexHash) == 0)
+        const auto vertexHash = Hasher::hashme(reinterpret_cast<const unsigned char*>(data), source.vertexSize * sizeof(float));
+        const auto inserted = uniqueVertices.emplace(vertexHash, static_cast<uint32_t>(uniqueVertices.size()));
+        if (inserted.second)
         {
-            uniqueVertices[vertexHash] = static_cast<uint32_t>(uniqueVertices.size());
-            meshDesc.geometry.vertices.resize(meshDesc.geometry.vertices.size() + currentSize);
-            vertexOffset += currentSize;
+            source.vertices.push_back(vertex);
         }
 
-        meshDesc.geometry.indices.push_back(uniqueVertices[vertexHash]);
+        meshDesc.geometry.indices.push_back(inserted.first->second);
+        return inserted.second;
     }
 
     void mergeShapesByMaterials(MeshDescription& meshDesc)
@@ -165,11 +212,11 @@ namespace
 
         std::cout << "Merged " << meshDesc.shapes.size() << " shapes into " << mergesShapes.size() << " shapes" << std::endl;
 
-        meshDesc.geometry.indices = mergesIndicies;
-        meshDesc.shapes = mergesShapes;
+        meshDesc.geometry.indices = std::move(mergesIndicies);
+        meshDesc.shapes = std::move(mergesShapes);
     }
 
-    void createInterleavedVertexAttributes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, MeshDescription& meshDesc)
+    void createInterleavedVertexAttributes(tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, MeshDescription& meshDesc)
     {
         {
             ScopedTimeLog log("Creating interleaved vertex data");
@@ -178,17 +225,24 @@ namespace
             std::for_each(shapes.begin(), shapes.end(), [&](const tinyobj::shape_t& shape) { numIndices += static_cast<uint32_t>(shape.mesh.indices.size()); });
             meshDesc.geometry.indices.reserve(numIndices);
 
-            std::unordered_map<size_t, uint32_t> uniqueVertices;
+            UniqueVertexMap uniqueVertices;
 
             uint32_t shapeStartIndex = 0;
             assert(!shapes[0].mesh.material_ids.empty());
             int currentMaterialId = shapes[0].mesh.material_ids.front();
 
-            meshDesc.geometry.vertexSize = 6 + (attrib.texcoords.empty() ? 0 : 2); // vertex + normals + texcoords
-              
-            uint32_t vertexOffset = 0;
-            meshDesc.geometry.vertices.resize(meshDesc.geometry.vertexSize);
-            for (const auto& shape : shapes)
+            auto source = std::make_shared<InterleavedVertexSource>();
+            const bool hasNormals = !attrib.normals.empty();
+            source->positions = std::move(attrib.vertices);
+            source->normals = std::move(attrib.normals);
+            source->texcoords = std::move(attrib.texcoords);
+            source->vertexSize = 6 + (source->texcoords.empty() ? 0 : 2); // vertex + normals + texcoords
+            meshDesc.geometry.vertexSize = source->vertexSize;
+
+            // most meshes have about as many unique vertices as positions, this avoids growing the array by doubling
+            source->vertices.reserve(source->positions.size() / 3);
+
+            for (auto& shape : shapes)
             {
                 assert(!shape.mesh.material_ids.empty());
 
@@ -204,37 +258,48 @@ namespace
                     const auto idx1 = shape.mesh.indices[3 * f + 1];
                     const auto idx2 = shape.mesh.indices[3 * f + 2];
 
-                    if (attrib.normals.empty())
+                    if (!hasNormals)
                     {
-                        const auto faceNormal = calculateFaceNormal(attrib, idx0, idx1, idx2);
-                        addVertex(attrib, idx0, uniqueVertices, faceNormal, meshDesc, vertexOffset);
-                        addVertex(attrib, idx1, uniqueVertices, faceNormal, meshDesc, vertexOffset);
-                        addVertex(attrib, idx2, uniqueVertices, faceNormal, meshDesc, vertexOffset);
+                        const auto faceNormal = calculateFaceNormal(source->positions, idx0, idx1, idx2);
+                        const auto normalIndex = static_cast<uint32_t>(source->normals.size() / 3);
+                        source->normals.insert(source->normals.end(), { faceNormal.x, faceNormal.y, faceNormal.z });
+                        bool used = addVertex(*source, idx0, normalIndex, uniqueVertices, meshDesc);
+                        used |= addVertex(*source, idx1, normalIndex, uniqueVertices, meshDesc);
+                        used |= addVertex(*source, idx2, normalIndex, uniqueVertices, meshDesc);
+                        if (!used)
+                        {
+                            source->normals.resize(source->normals.size() - 3);
+                        }
                     }
                     else
                     {
-                        const auto vertexNormal0 = glm::make_vec3(&attrib.normals[3 * idx0.normal_index]);
-                        const auto vertexNormal1 = glm::make_vec3(&attrib.normals[3 * idx1.normal_index]);
-                        const auto vertexNormal2 = glm::make_vec3(&attrib.normals[3 * idx2.normal_index]);
-                        addVertex(attrib, idx0, uniqueVertices, vertexNormal0, meshDesc, vertexOffset);
-                        addVertex(attrib, idx1, uniqueVertices, vertexNormal1, meshDesc, vertexOffset);
-                        addVertex(attrib, idx2, uniqueVertices, vertexNormal2, meshDesc, vertexOffset);
+                        assert(idx0.normal_index >= 0 && idx1.normal_index >= 0 && idx2.normal_index >= 0);
+                        addVertex(*source, idx0, static_cast<uint32_t>(idx0.normal_index), uniqueVertices, meshDesc);
+                        addVertex(*source, idx1, static_cast<uint32_t>(idx1.normal_index), uniqueVertices, meshDesc);
+                        addVertex(*source, idx2, static_cast<uint32_t>(idx2.normal_index), uniqueVertices, meshDesc);
                     }
                 }
+
+                std::vector<tinyobj::index_t>().swap(shape.mesh.indices);
+                std::vector<int>().swap(shape.mesh.material_ids);
             }
             addShape(shapeStartIndex, currentMaterialId, meshDesc);
 
-            meshDesc.geometry.vertexCount = static_cast<uint32_t>(uniqueVertices.size());
+            meshDesc.geometry.vertexCount = static_cast<uint32_t>(source->vertices.size());
             meshDesc.geometry.interleavedVertexAttribs.emplace_back(0u, 3u, 0u);
             meshDesc.geometry.interleavedVertexAttribs.emplace_back(1u, 3u, static_cast<uint32_t>(3u * sizeof(float)));
-            if (!attrib.texcoords.empty())
+            if (!source->texcoords.empty())
             {
                 meshDesc.geometry.interleavedVertexAttribs.emplace_back(2u, 2u, static_cast<uint32_t>(6 * sizeof(float)));
             }
 
             std::cout << "Triangle count:\t\t " << meshDesc.geometry.indices.size() / 3 << std::endl;
-            std::cout << "Vertex count from file:\t " << attrib.vertices.size() / 3 << std::endl;
+            std::cout << "Vertex count from file:\t " << source->positions.size() / 3 << std::endl;
             std::cout << "Unique vertex count:\t " << meshDesc.geometry.vertexCount << std::endl;
+            std::cout << "Vertex source size:\t " << source->byteSize() / 1024 << " KB instead of "
+                      << uint64_t(meshDesc.geometry.vertexCount) * meshDesc.geometry.vertexSize * sizeof(float) / 1024 << " KB interleaved" << std::endl;
+
+            meshDesc.geometry.writeVertices = [source](void* destination, uint64_t offset, uint64_t size) { source->write(destination, offset, size); };
         }
     }
 